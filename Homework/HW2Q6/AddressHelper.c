@@ -6,13 +6,17 @@
 *
 * Summary:  This holds helpful routines related to addresses 
 * Revisions:
+*   10/17/26: Added the NetAddrKey routines, getFirstV4IPAddress handles
+*             IPv6 and only prints when TRACEME is set
+*   10/17/26: Added parseAddrPrefix for CIDR whitelist entries
 *
-* Last update: 4/6/2025 
+* Last update: 10/17/2026 
 *
 *********************************************************/
 #include "AddressHelper.h"
 #include "utils.h"
 #include <errno.h>
+#include <stdlib.h>  /* for strtol */
 #include <sys/socket.h> /* for socket(), connect(), sendto(), and recvfrom() */
 #include <netinet/in.h> /* for in_addr */
 #include <arpa/inet.h> /* for inet_addr ... */
@@ -31,15 +35,12 @@
 /***********************************************************
 * Function: int32_t getFirstV4IPAddress ( const struct sockaddr *address, char *callersBuffer, uint32_t callersBufSize);
 *
-* Explanation: extracts the first IP v4 address in inet_ntop format copying it into the callers buffer 
+* Explanation: extracts the IP address in inet_ntop format copying it into the callers buffer 
 *              The   A NL is added making the returned answer a string.
-*
-*              TODO:  Develop a correct version of this that will return the first IPv4 or IPv6 address 
-*                      adding a af param to specify....that code should follow PrintSocketAddresses ....
+*              Per packet code should use getAddrKey instead - this formats text.
 *
 * Inputs:   
-*  const struct sockaddr *address  :  even though this is a generic sockaddr struct , this must actually
-*                  point to a struct sockaddr_in   
+*  const struct sockaddr *address  :  a struct sockaddr_in or sockaddr_in6
 *                  This must be in network byte order.
 *
 *  char *callersBuffer  :  ptr to the caller's buffer 
@@ -60,15 +61,24 @@ int32_t getFirstV4IPAddress (const struct sockaddr *address, char *callersBuffer
   void *numericAddress = NULL; // Pointer to binary address
   in_port_t port; // Port to print
 
-  thisIP= (struct sockaddr_in *)address;
-
+  if (address->sa_family == AF_INET6) {
+    struct sockaddr_in6 *thisIPV6 = (struct sockaddr_in6 *)address;
+    numericAddress = &(thisIPV6)->sin6_addr;
+    port = ntohs((thisIPV6)->sin6_port);
+  } else if (address->sa_family == AF_INET) {
+    thisIP= (struct sockaddr_in *)address;
+    //extract the reference to the struct in_addr
+    numericAddress = &(thisIP)->sin_addr;
+    port = ntohs((thisIP)->sin_port);
+  } else {
+    return ERROR;
+  }
 
-  //extract the reference to the struct in_addr
-  numericAddress = &(thisIP)->sin_addr;
-  port = ntohs((thisIP)->sin_port);
   rc = NOERROR;
   (void) inet_ntop(address->sa_family, numericAddress, callersBuffer, (size_t)callersBufSize);
-  printf("getFirstV4IPAddress: IPV4 address: %s:%d \n", callersBuffer, (int32_t)port);
+#if TRACEME
+  printf("getFirstV4IPAddress: IP address: %s:%d \n", callersBuffer, (int32_t)port);
+#endif
   return rc;
 
     //ntopPtrReturn =  inet_ntop(address->sa_family, numericAddress, callersBuffer, (size_t)callersBufSize);
@@ -276,3 +286,171 @@ int findAF_INETSocketAddress(struct addrinfo *servAddr, struct sockaddr **caller
 
 
 
+
+/***********************************************************
+* Function: int32_t getAddrKey(const struct sockaddr *address, NetAddrKey *key)
+*
+* Explanation: Builds the binary key of an AF_INET or AF_INET6 address.
+*              IPv4 is stored v4-mapped so both families share the key.
+*              No text formatting - cheap enough for every packet.
+*
+* Output: SUCCESS, or FAILURE for other address families (key is zeroed)
+*
+**************************************************/
+int32_t getAddrKey(const struct sockaddr *address, NetAddrKey *key)
+{
+  memset(key, 0, sizeof(NetAddrKey));
+
+  if (address->sa_family == AF_INET) {
+    const struct sockaddr_in *ipv4Addr = (const struct sockaddr_in *) address;
+    key->addr[10] = 0xff;
+    key->addr[11] = 0xff;
+    memcpy(&key->addr[12], &ipv4Addr->sin_addr, sizeof(struct in_addr));
+    key->port = ipv4Addr->sin_port;
+    return SUCCESS;
+  } else if (address->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *ipv6Addr = (const struct sockaddr_in6 *) address;
+    memcpy(key->addr, &ipv6Addr->sin6_addr, sizeof(struct in6_addr));
+    key->port = ipv6Addr->sin6_port;
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+/***********************************************************
+* Function: int32_t parseAddrKey(const char *text, NetAddrKey *key)
+*
+* Explanation: Parses a dotted IPv4 or an IPv6 address (no port) into a key.
+*
+* Output: SUCCESS, or FAILURE if the text is neither
+*
+**************************************************/
+int32_t parseAddrKey(const char *text, NetAddrKey *key)
+{
+  struct in_addr ipv4;
+
+  memset(key, 0, sizeof(NetAddrKey));
+  if (inet_pton(AF_INET, text, &ipv4) == 1) {
+    key->addr[10] = 0xff;
+    key->addr[11] = 0xff;
+    memcpy(&key->addr[12], &ipv4, sizeof(ipv4));
+    return SUCCESS;
+  }
+  if (inet_pton(AF_INET6, text, key->addr) == 1)
+    return SUCCESS;
+  return FAILURE;
+}
+
+/***********************************************************
+* Function: int32_t parseAddrPrefix(const char *text, uint8_t *addr, int *prefixLen)
+*
+* Explanation: Parses address[/len], IPv4 or IPv6, into a v4-mapped 16 byte
+*              address and a prefix length over those 128 bits, so an IPv4
+*              a.b.c.d/n becomes ::ffff:a.b.c.d/(96+n).   No /len is a host
+*              (/32 or /128).   Bits past the prefix are cleared.
+*
+* Output: SUCCESS, or FAILURE if the text is not a prefix
+*
+**************************************************/
+int32_t parseAddrPrefix(const char *text, uint8_t *addr, int *prefixLen)
+{
+  char buffer[INET6_ADDRSTRLEN + 8];
+  char *slash = NULL;
+  char *end = NULL;
+  long len = -1;
+  NetAddrKey key;
+  int i = 0;
+
+  if (strlen(text) >= sizeof(buffer))
+    return FAILURE;
+  strcpy(buffer, text);
+  slash = strchr(buffer, '/');
+  if (slash != NULL) {
+    *slash++ = 0;
+    len = strtol(slash, &end, 10);
+    if ((end == slash) || (*end != 0) || (len < 0))
+      return FAILURE;
+  }
+  if (parseAddrKey(buffer, &key) != SUCCESS)
+    return FAILURE;
+
+  //A dotted address is always IPv4, its length counts from bit 96
+  if (strchr(buffer, ':') == NULL) {
+    if (len > 32)
+      return FAILURE;
+    len = (len < 0) ? 128 : len + 96;
+  } else {
+    if (len > 128)
+      return FAILURE;
+    if (len < 0)
+      len = 128;
+  }
+
+  for (i = 0; i < 16; i++) {
+    int bits = (int)len - i * 8;
+    if (bits <= 0)
+      key.addr[i] = 0;
+    else if (bits < 8)
+      key.addr[i] &= (uint8_t)(0xff << (8 - bits));
+  }
+  memcpy(addr, key.addr, sizeof(key.addr));
+  *prefixLen = (int)len;
+  return SUCCESS;
+}
+
+/***********************************************************
+* Function: bool addrKeysEqual(const NetAddrKey *key1, const NetAddrKey *key2)
+*
+* Explanation: Same address and port
+*
+**************************************************/
+bool addrKeysEqual(const NetAddrKey *key1, const NetAddrKey *key2)
+{
+  return memcmp(key1, key2, sizeof(NetAddrKey)) == 0;
+}
+
+/***********************************************************
+* Function: bool addrKeysSameHost(const NetAddrKey *key1, const NetAddrKey *key2)
+*
+* Explanation: Same address, the ports are ignored
+*
+**************************************************/
+bool addrKeysSameHost(const NetAddrKey *key1, const NetAddrKey *key2)
+{
+  return memcmp(key1->addr, key2->addr, sizeof(key1->addr)) == 0;
+}
+
+/***********************************************************
+* Function: bool addrKeyIsV4(const NetAddrKey *key)
+*
+* Explanation: True for a v4-mapped key
+*
+**************************************************/
+bool addrKeyIsV4(const NetAddrKey *key)
+{
+  static const uint8_t v4Prefix[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+  return memcmp(key->addr, v4Prefix, sizeof(v4Prefix)) == 0;
+}
+
+/***********************************************************
+* Function: char *addrKeyToString(const NetAddrKey *key, char *callersBuffer, uint32_t callersBufSize)
+*
+* Explanation: Formats a key as a.b.c.d:port or [v6]:port.   Only
+*              meant for log messages - keep it off the per packet path.
+*
+* Output: returns callersBuffer (ADDRKEY_STRLEN bytes is always enough)
+*
+**************************************************/
+char *addrKeyToString(const NetAddrKey *key, char *callersBuffer, uint32_t callersBufSize)
+{
+  char addrString[INET6_ADDRSTRLEN];
+
+  if (addrKeyIsV4(key)) {
+    (void) inet_ntop(AF_INET, &key->addr[12], addrString, sizeof(addrString));
+    snprintf(callersBuffer, callersBufSize, "%s:%u", addrString, (uint32_t)ntohs(key->port));
+  } else {
+    (void) inet_ntop(AF_INET6, key->addr, addrString, sizeof(addrString));
+    snprintf(callersBuffer, callersBufSize, "[%s]:%u", addrString, (uint32_t)ntohs(key->port));
+  }
+  return callersBuffer;
+}
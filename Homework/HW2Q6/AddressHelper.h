@@ -8,8 +8,10 @@
 *   Code should always exit using Unix convention:  exit(EXIT_SUCCESS) or exit(EXIT_FAILURE)
 *
 * A1: 4/5/25: Added getFirstV4IPAddress
+* A2: 10/17/26: Added NetAddrKey, a binary dual-stack address+port key
+* A3: 10/17/26: Added parseAddrPrefix
 *
-* Last update: 4/5/2025
+* Last update: 10/17/2026
 *
 ************************************************************************/
 #ifndef	__AddressHelper_h
@@ -18,12 +20,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 //#include <arpa/inet.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
 
+/*
+  Binary identity of a peer, taken straight from its sockaddr.
+  IPv4 addresses are stored v4-mapped (::ffff:a.b.c.d) so one key type
+  covers AF_INET, AF_INET6 and dual-stack sockets.  The port is kept in
+  network order.   Keys are compared with memcmp, so unused bytes are 0.
+*/
+typedef struct {
+  uint8_t addr[16];
+  uint16_t port;
+  uint16_t pad;
+} NetAddrKey;
+
+//inet_ntop sized buffer plus brackets and :port
+#define ADDRKEY_STRLEN 56
+
 
 
 int NumberOfAddresses(struct addrinfo *addrList);
@@ -32,6 +50,17 @@ void PrintSocketAddress(const struct sockaddr *address, FILE *stream);
 //A1
 int32_t getFirstV4IPAddress (const struct sockaddr *address, char *callersBuffer, uint32_t callersBufSize);
 
+//A2
+int32_t getAddrKey(const struct sockaddr *address, NetAddrKey *key);
+int32_t parseAddrKey(const char *text, NetAddrKey *key);
+bool addrKeysEqual(const NetAddrKey *key1, const NetAddrKey *key2);
+bool addrKeysSameHost(const NetAddrKey *key1, const NetAddrKey *key2);
+bool addrKeyIsV4(const NetAddrKey *key);
+//A3: address[/len] into a v4-mapped address and a 0..128 bit prefix length
+int32_t parseAddrPrefix(const char *text, uint8_t *addr, int *prefixLen);
+//Formats for logging only, returns callersBuffer
+char *addrKeyToString(const NetAddrKey *key, char *callersBuffer, uint32_t callersBufSize);
+
 // Test socket address equality
 //
 bool SockAddrsEqual(const struct sockaddr *addr1, const struct sockaddr *addr2);
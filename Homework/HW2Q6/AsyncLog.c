@@ -0,0 +1,435 @@
+/*********************************************************
+*
+* Module Name: AsyncLog
+*
+* File Name:  AsyncLog.c
+*
+* Summary:  Per thread lock-free log rings drained by a writer thread.
+*           See AsyncLog.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for the GNU strerror_r */
+#endif
+#include "UDPEcho.h"
+#include "AsyncLog.h"
+#include <pthread.h>
+
+#define LOG_NANOS_PER_SEC 1000000000ULL
+#define LOG_REPORT_INTERVAL_NS LOG_NANOS_PER_SEC
+#define LOG_FLUSH_TRIES 200
+
+/*
+  One producer (the owning thread), one consumer (the writer, or
+  asyncLogFlush holding drainLock).   head and tail are on their own
+  cache lines.   The counters are only written by the producer.
+*/
+typedef struct {
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tail __attribute__((aligned(64)));
+  uint64_t suppressed[LOG_MAX_CATEGORIES];
+  uint64_t dropped[LOG_MAX_CATEGORIES];
+  LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+typedef struct {
+  LogCategory category;
+  uint64_t intervalNs;    // between records at ratePerSec
+  uint64_t burstNs;
+  uint64_t tat __attribute__((aligned(64)));  // GCRA theoretical arrival time
+  uint64_t written;       // writer only
+  uint64_t lastSuppressed;
+  uint64_t lastDropped;
+} LogCategoryState;
+
+static LogCategoryState categoryStates[LOG_MAX_CATEGORIES];
+static uint32_t numCategories = 0;
+static FILE *logOut = NULL;
+static bool writerRunning = false;
+
+static LogRing *rings[LOG_MAX_THREADS];
+static uint32_t numRings = 0;
+static uint64_t ringlessDropped = 0;   // threads past LOG_MAX_THREADS
+static __thread LogRing *threadRing = NULL;
+static __thread bool threadRingless = false;
+
+static pthread_t writerThread;
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lastReportNs = 0;
+
+static uint64_t coarseNowNs(void);
+static bool allowRecord(LogCategoryState *c, uint64_t nowNs);
+static LogRing *getThreadRing(void);
+static uint32_t drainRings(void);
+static bool reportLosses(uint64_t nowNs);
+static size_t formatRecord(const LogRecord *r, char *out, size_t outSize);
+static void writeRecord(const LogRecord *r);
+static void *logWriterThread(void *arg);
+
+
+/***********************************************************
+* Function: int asyncLogInit(const LogCategory *categories, uint32_t numCategories, FILE *out)
+*
+* Explanation: Sets up the categories and their rate limits and starts
+*              the writer thread.   Called once, before the threads that
+*              log are started.
+*
+* outputs: returns ERROR (too many categories or no writer thread - records
+*          are then written directly) or NOERROR
+*
+**************************************************/
+int asyncLogInit(const LogCategory *categories, uint32_t count, FILE *out)
+{
+  uint32_t i = 0;
+
+  logOut = out;
+  if (count > LOG_MAX_CATEGORIES)
+    return ERROR;
+  for (i = 0; i < count; i++) {
+    LogCategoryState *c = &categoryStates[i];
+    memset(c, 0, sizeof(LogCategoryState));
+    c->category = categories[i];
+    if (c->category.ratePerSec > 0) {
+      c->intervalNs = LOG_NANOS_PER_SEC / c->category.ratePerSec;
+      c->burstNs = (uint64_t)(c->category.burst > 0 ? c->category.burst - 1 : 0) * c->intervalNs;
+    }
+  }
+  numCategories = count;
+  lastReportNs = coarseNowNs();
+
+  if (pthread_create(&writerThread, NULL, logWriterThread, NULL) != 0)
+    return ERROR;
+  __atomic_store_n(&writerRunning, true, __ATOMIC_RELEASE);
+  return NOERROR;
+}
+
+/***********************************************************
+* Function: void asyncLogWrite(uint32_t category, const NetAddrKey *addr, int errnum,
+*                              const char *fmt, const int64_t *args)
+*
+* Explanation: The producer side.   Applies the category's rate limit and
+*              copies the record into this thread's ring.   Use the
+*              LOG_EVENT/LOG_ADDR/LOG_ERRNO macros rather than calling it.
+*
+* notes: nothing here blocks or formats once the writer is running
+*
+**************************************************/
+void asyncLogWrite(uint32_t category, const NetAddrKey *addr, int errnum, const char *fmt, const int64_t *args)
+{
+  LogRing *ring = NULL;
+  LogRecord *r = NULL;
+  LogRecord direct;
+  uint64_t tail = 0;
+
+  if (category >= numCategories)
+    category = 0;
+
+  if (!__atomic_load_n(&writerRunning, __ATOMIC_ACQUIRE)) {
+    r = &direct;
+  } else {
+    ring = getThreadRing();
+    if (ring == NULL) {
+      __atomic_fetch_add(&ringlessDropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if (!allowRecord(&categoryStates[category], coarseNowNs())) {
+      __atomic_store_n(&ring->suppressed[category], ring->suppressed[category] + 1, __ATOMIC_RELAXED);
+      return;
+    }
+    tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+      __atomic_store_n(&ring->dropped[category], ring->dropped[category] + 1, __ATOMIC_RELAXED);
+      return;
+    }
+    r = &ring->records[tail & (LOG_RING_SIZE - 1)];
+  }
+
+  r->fmt = fmt;
+  memcpy(r->args, args, sizeof(r->args));
+  r->errnum = errnum;
+  r->category = (uint16_t)category;
+  r->hasAddr = (addr != NULL);
+  if (addr != NULL)
+    r->addr = *addr;
+
+  if (ring == NULL) {
+    writeRecord(r);
+    fflush(logOut ? logOut : stdout);
+    return;
+  }
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/***********************************************************
+* Function: void asyncLogFlush(void)
+*
+* Explanation: Drains every ring now, e.g. before a summary is printed.
+*
+**************************************************/
+void asyncLogFlush(void)
+{
+  int tries = 0;
+
+  if (!__atomic_load_n(&writerRunning, __ATOMIC_ACQUIRE))
+    return;
+  while (pthread_mutex_trylock(&drainLock) != 0) {
+    if (++tries >= LOG_FLUSH_TRIES)
+      return;
+    usleep(1000);
+  }
+  drainRings();
+  reportLosses(0);
+  fflush(logOut);
+  pthread_mutex_unlock(&drainLock);
+}
+
+/***********************************************************
+* Function: void asyncLogGetStats(uint32_t category, LogCategoryStats *stats)
+*
+* Explanation: sums the category's counters over all rings
+*
+**************************************************/
+void asyncLogGetStats(uint32_t category, LogCategoryStats *stats)
+{
+  uint32_t count = __atomic_load_n(&numRings, __ATOMIC_ACQUIRE);
+  uint32_t i = 0;
+
+  memset(stats, 0, sizeof(LogCategoryStats));
+  if (category >= numCategories)
+    return;
+  stats->written = __atomic_load_n(&categoryStates[category].written, __ATOMIC_RELAXED);
+  for (i = 0; (i < count) && (i < LOG_MAX_THREADS); i++) {
+    LogRing *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    if (ring == NULL)
+      continue;
+    stats->suppressed += __atomic_load_n(&ring->suppressed[category], __ATOMIC_RELAXED);
+    stats->dropped += __atomic_load_n(&ring->dropped[category], __ATOMIC_RELAXED);
+  }
+}
+
+/***********************************************************
+* Function: void asyncLogPrintStats(FILE *out)
+*
+* Explanation: one line per category that logged anything
+*
+**************************************************/
+void asyncLogPrintStats(FILE *out)
+{
+  LogCategoryStats stats;
+  uint32_t i = 0;
+
+  for (i = 0; i < numCategories; i++) {
+    asyncLogGetStats(i, &stats);
+    if (stats.written + stats.suppressed + stats.dropped == 0)
+      continue;
+    fprintf(out, "log %-12s written:%lu rate limited:%lu ring full:%lu\n", categoryStates[i].category.name,
+        stats.written, stats.suppressed, stats.dropped);
+  }
+  if (ringlessDropped > 0)
+    fprintf(out, "log records lost (no ring): %lu\n", ringlessDropped);
+}
+
+//CLOCK_MONOTONIC_COARSE is a vDSO read with no fence, plenty for rate limits
+static uint64_t coarseNowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * LOG_NANOS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+//GCRA, the same test as the server's checkRateLimit
+static bool allowRecord(LogCategoryState *c, uint64_t nowNs)
+{
+  uint64_t tat = 0;
+  uint64_t newTat = 0;
+
+  if (c->intervalNs == 0)
+    return true;
+  tat = __atomic_load_n(&c->tat, __ATOMIC_RELAXED);
+  do {
+    uint64_t base = (tat > nowNs) ? tat : nowNs;
+    if (base - nowNs > c->burstNs)
+      return false;
+    newTat = base + c->intervalNs;
+  } while (!__atomic_compare_exchange_n(&c->tat, &tat, newTat, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return true;
+}
+
+//The calling thread's ring, made on its first record.  NULL once
+//LOG_MAX_THREADS rings exist
+static LogRing *getThreadRing(void)
+{
+  uint32_t index = 0;
+  LogRing *ring = NULL;
+
+  if (threadRing != NULL)
+    return threadRing;
+  if (threadRingless)
+    return NULL;
+
+  threadRingless = true;
+  index = __atomic_fetch_add(&numRings, 1, __ATOMIC_ACQ_REL);
+  if (index >= LOG_MAX_THREADS)
+    return NULL;
+  if (posix_memalign((void **)&ring, 64, sizeof(LogRing)) != 0)
+    return NULL;
+  memset(ring, 0, sizeof(LogRing));
+  __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+  threadRingless = false;
+  threadRing = ring;
+  return ring;
+}
+
+//Writes out every queued record, drainLock held.  Returns the number written
+static uint32_t drainRings(void)
+{
+  uint32_t count = __atomic_load_n(&numRings, __ATOMIC_ACQUIRE);
+  uint32_t drained = 0;
+  uint32_t i = 0;
+
+  for (i = 0; (i < count) && (i < LOG_MAX_THREADS); i++) {
+    LogRing *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    uint64_t head = 0;
+    uint64_t tail = 0;
+
+    if (ring == NULL)
+      continue;
+    head = ring->head;
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      writeRecord(&ring->records[head & (LOG_RING_SIZE - 1)]);
+      drained++;
+    }
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  }
+  return drained;
+}
+
+//Reports the records suppressed or dropped since the last report, at most
+//once per LOG_REPORT_INTERVAL_NS (nowNs 0 forces a report).  True if it wrote
+static bool reportLosses(uint64_t nowNs)
+{
+  LogCategoryStats stats;
+  bool reported = false;
+  uint32_t i = 0;
+
+  if ((nowNs != 0) && (nowNs - lastReportNs < LOG_REPORT_INTERVAL_NS))
+    return false;
+  lastReportNs = (nowNs != 0) ? nowNs : coarseNowNs();
+  for (i = 0; i < numCategories; i++) {
+    LogCategoryState *c = &categoryStates[i];
+    asyncLogGetStats(i, &stats);
+    if ((stats.suppressed == c->lastSuppressed) && (stats.dropped == c->lastDropped))
+      continue;
+    fprintf(logOut, "log: %s: %lu messages rate limited, %lu dropped (ring full)\n", c->category.name,
+        stats.suppressed - c->lastSuppressed, stats.dropped - c->lastDropped);
+    c->lastSuppressed = stats.suppressed;
+    c->lastDropped = stats.dropped;
+    reported = true;
+  }
+  return reported;
+}
+
+//printf for the supported subset:  integer conversions take the next
+//argument as an int64_t, %s takes the address key
+static size_t formatRecord(const LogRecord *r, char *out, size_t outSize)
+{
+  const char *p = r->fmt;
+  char spec[32];
+  char addrText[ADDRKEY_STRLEN];
+  size_t n = 0;
+  size_t s = 0;
+  int arg = 0;
+  int w = 0;
+
+  while ((*p != 0) && (n < outSize - 1)) {
+    if (*p != '%') {
+      out[n++] = *p++;
+      continue;
+    }
+    s = 0;
+    spec[s++] = *p++;
+    while ((*p != 0) && (strchr("-+ #0123456789.", *p) != NULL) && (s < sizeof(spec) - 4))
+      spec[s++] = *p++;
+    while ((*p != 0) && (strchr("hlLqjzt", *p) != NULL))
+      p++;
+
+    w = 0;
+    switch (*p) {
+    case '%':
+      out[n++] = '%';
+      break;
+    case 'd':
+    case 'i':
+      spec[s++] = 'l';
+      spec[s++] = 'l';
+      spec[s++] = 'd';
+      spec[s] = 0;
+      w = snprintf(out + n, outSize - n, spec, (long long)((arg < LOG_MAX_ARGS) ? r->args[arg++] : 0));
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      spec[s++] = 'l';
+      spec[s++] = 'l';
+      spec[s++] = *p;
+      spec[s] = 0;
+      w = snprintf(out + n, outSize - n, spec, (unsigned long long)((arg < LOG_MAX_ARGS) ? r->args[arg++] : 0));
+      break;
+    case 's':
+      spec[s++] = 's';
+      spec[s] = 0;
+      w = snprintf(out + n, outSize - n, spec,
+                   r->hasAddr ? addrKeyToString(&r->addr, addrText, sizeof(addrText)) : "?");
+      break;
+    default:
+      break;
+    }
+    if (*p != 0)
+      p++;
+    if (w > 0)
+      n += ((size_t)w < outSize - n) ? (size_t)w : outSize - n - 1;
+  }
+  out[n] = 0;
+  return n;
+}
+
+static void writeRecord(const LogRecord *r)
+{
+  char line[LOG_LINE_SIZE];
+  char errText[128];
+  FILE *out = logOut ? logOut : stdout;
+
+  formatRecord(r, line, sizeof(line));
+  if (r->errnum != 0)
+    fprintf(out, "%s: %s\n", line, strerror_r(r->errnum, errText, sizeof(errText)));
+  else
+    fprintf(out, "%s\n", line);
+  if (r->category < numCategories)
+    __atomic_store_n(&categoryStates[r->category].written, categoryStates[r->category].written + 1,
+                     __ATOMIC_RELAXED);
+}
+
+//Drains the rings until the process exits, sleeping when they are empty
+static void *logWriterThread(void *arg)
+{
+  struct timespec idle = {0, LOG_WRITER_IDLE_NS};
+  uint32_t drained = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&drainLock);
+    drained = drainRings();
+    if (reportLosses(coarseNowNs()) || (drained > 0))
+      fflush(logOut);
+    pthread_mutex_unlock(&drainLock);
+    if (drained == 0)
+      nanosleep(&idle, NULL);
+  }
+  return NULL;
+}
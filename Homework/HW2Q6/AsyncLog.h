@@ -0,0 +1,95 @@
+/************************************************************************
+* File:  AsyncLog.h
+*
+* Purpose:
+*   Asynchronous logging for the client's and server's per packet paths.
+*   A log call copies a fixed size binary record (format pointer, integer
+*   arguments, an optional address key and errno) into the calling
+*   thread's ring and returns; a writer thread formats the records and
+*   writes them out, so a burst of errors never blocks on stdout.
+*
+* Notes:
+*   Each thread gets its own single producer ring on its first log call,
+*   so producers take no locks and share no cache lines.  A full ring
+*   drops the record and counts it.
+*
+*   Every record belongs to a category (defined by the caller, see
+*   LogCategory) with its own rate limit, a GCRA token bucket updated by
+*   CAS like the server's per client limiter.  Records over the limit are
+*   counted as suppressed, the writer reports the suppressed and dropped
+*   counts at most once a second.
+*
+*   Formats must be string literals and take only integer conversions
+*   (%d %u %x ..., length modifiers are ignored - every argument is an
+*   int64_t) plus at most one %s, which prints the record's address key.
+*   The writer adds the newline, and ": strerror(errnum)" like perror
+*   when errnum is not 0.
+*
+*   Before asyncLogInit (or if the writer could not start) records are
+*   formatted and written at once, so logging always works.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__AsyncLog_h
+#define	__AsyncLog_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "AddressHelper.h"
+
+#define LOG_MAX_ARGS 6
+#define LOG_MAX_CATEGORIES 16
+#define LOG_MAX_THREADS 128
+#define LOG_RING_SIZE 1024        // records per thread, must be a power of 2
+#define LOG_LINE_SIZE 512
+#define LOG_WRITER_IDLE_NS 1000000 // writer poll interval when the rings are empty
+
+typedef struct {
+  const char *name;
+  uint32_t ratePerSec;    // records per second let through, 0 is unlimited
+  uint32_t burst;         // records let through back to back
+} LogCategory;
+
+typedef struct {
+  const char *fmt;
+  int64_t args[LOG_MAX_ARGS];
+  NetAddrKey addr;
+  int32_t errnum;
+  uint16_t category;
+  uint8_t hasAddr;
+} LogRecord;
+
+typedef struct {
+  uint64_t written;
+  uint64_t suppressed;    // over the category's rate limit
+  uint64_t dropped;       // ring full
+} LogCategoryStats;
+
+//categories is copied, out is usually stdout.  ERROR or NOERROR
+int asyncLogInit(const LogCategory *categories, uint32_t numCategories, FILE *out);
+
+//Queues one record, see the notes above for what fmt may hold
+void asyncLogWrite(uint32_t category, const NetAddrKey *addr, int errnum, const char *fmt, const int64_t *args);
+
+//Writes out everything queued so far.  Gives up after about 200ms if the
+//writer is busy (e.g. this runs in a signal handler that interrupted it)
+void asyncLogFlush(void);
+
+void asyncLogGetStats(uint32_t category, LogCategoryStats *stats);
+void asyncLogPrintStats(FILE *out);
+
+//The arguments are converted to int64_t by the compound literal
+#define LOG_EVENT(cat, fmt, ...) \
+  asyncLogWrite((cat), NULL, 0, (fmt), (const int64_t[LOG_MAX_ARGS]){ __VA_ARGS__ })
+#define LOG_ADDR(cat, key, fmt, ...) \
+  asyncLogWrite((cat), (key), 0, (fmt), (const int64_t[LOG_MAX_ARGS]){ __VA_ARGS__ })
+#define LOG_ERRNO(cat, err, fmt, ...) \
+  asyncLogWrite((cat), NULL, (err), (fmt), (const int64_t[LOG_MAX_ARGS]){ __VA_ARGS__ })
+
+#endif
+
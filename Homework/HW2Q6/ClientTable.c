@@ -0,0 +1,446 @@
+/*********************************************************
+*
+* Module Name: ClientTable
+*
+* File Name:  ClientTable.c
+*
+* Summary:  Sharded open-addressing hash table of the server's
+*           clients with per shard LRU eviction.  See ClientTable.h
+*
+* Revisions:
+*   10/17/26: per client FlowSessions, retired into the shard when removed
+*   10/17/26: per client replay window bitmaps
+*   10/17/26: clientTableLockSession, removed entries' sessions get flowId 0
+*   10/17/26: sessions restarted in place (flowSessionRestart)
+*   10/17/26: per shard liveFlows count, bounded session walk
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "ClientTable.h"
+#include <sys/random.h>
+
+_Static_assert(sizeof(ClientHot) == 64, "ClientHot must fit one cache line");
+
+static uint64_t mix64(uint64_t x);
+static uint64_t hashKey(const ClientTable *t, const NetAddrKey *key);
+static ClientShard *shardOf(ClientTable *t, uint64_t hash);
+static void lruUnlink(ClientShard *s, uint32_t entry);
+static void lruPushHead(ClientShard *s, uint32_t entry);
+static void indexRemove(ClientShard *s, uint32_t entry, uint32_t tag);
+static void removeEntry(ClientTable *t, ClientShard *s, uint32_t entry);
+static void resetReplayWindow(ClientShard *s, uint32_t entry);
+
+
+/***********************************************************
+* Function: int clientTableInit(ClientTable *t, uint32_t capacity, uint32_t replayWindow)
+*
+* Explanation: allocates the shards.   capacity is split evenly over the
+*              shards, each index is at least twice its shard's capacity
+*              so probe chains stay short.  Every entry gets a replay
+*              window bitmap of at least replayWindow packets.
+*
+* outputs: returns ERROR or NOERROR
+*
+* notes: the entries are calloc'ed, so pages are only touched as
+*        clients arrive.
+*
+**************************************************/
+int clientTableInit(ClientTable *t, uint32_t capacity, uint32_t replayWindow)
+{
+  ReplayWindowParams replay;
+  uint32_t shardCapacity = 0;
+  uint32_t indexSize = 1;
+  uint32_t i = 0;
+
+  memset(t, 0, sizeof(ClientTable));
+  shardCapacity = (capacity + CLIENT_TABLE_SHARDS - 1) / CLIENT_TABLE_SHARDS;
+  if (shardCapacity < 1)
+    shardCapacity = 1;
+  t->capacity = shardCapacity * CLIENT_TABLE_SHARDS;
+  while (indexSize < 2 * shardCapacity)
+    indexSize <<= 1;
+  replayWindowParams(replayWindow, &replay);
+
+  if (getrandom(&t->seed, sizeof(t->seed), 0) != sizeof(t->seed))
+    t->seed = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid() ^ (uint64_t)(uintptr_t)t;
+
+  for (i = 0; i < CLIENT_TABLE_SHARDS; i++) {
+    ClientShard *s = &t->shards[i];
+    pthread_mutex_init(&s->lock, NULL);
+    s->index = calloc(indexSize, sizeof(uint64_t));
+    s->hot = calloc(shardCapacity, sizeof(ClientHot));
+    s->cold = calloc(shardCapacity, sizeof(ClientCold));
+    s->sessions = calloc(shardCapacity, sizeof(FlowSession));
+    s->replayBits = calloc((size_t)shardCapacity * replay.words, sizeof(uint64_t));
+    if (!s->index || !s->hot || !s->cold || !s->sessions || !s->replayBits)
+      return ERROR;
+    s->replay = replay;
+    flowSessionInit(&s->retired, NULL, 0);
+    s->indexMask = indexSize - 1;
+    s->capacity = shardCapacity;
+    s->freeList = CLIENT_TABLE_NIL;
+    s->lruHead = CLIENT_TABLE_NIL;
+    s->lruTail = CLIENT_TABLE_NIL;
+  }
+  return NOERROR;
+}
+
+/***********************************************************
+* Function: ClientHot *clientTableAcquire(ClientTable *t, const NetAddrKey *key,
+*                 const struct sockaddr_storage *addr, time_t now,
+*                 bool *created, ClientShard **shardOut)
+*
+* Explanation: Locks the key's shard and finds the client, creating it
+*              (evicting the shard's least recently used client if the
+*              shard is full) if it is not there.   The client moves to
+*              the head of the shard's LRU list.
+*
+* outputs: the client, with *shardOut locked - release it with
+*          clientTableRelease.  Never NULL.
+*
+**************************************************/
+ClientHot *clientTableAcquire(ClientTable *t, const NetAddrKey *key, const struct sockaddr_storage *addr,
+                              time_t now, bool *created, ClientShard **shardOut)
+{
+  uint64_t hash = hashKey(t, key);
+  uint32_t tag = (uint32_t)hash;
+  ClientShard *s = shardOf(t, hash);
+  uint32_t slot = tag & s->indexMask;
+  uint32_t entry = CLIENT_TABLE_NIL;
+
+  pthread_mutex_lock(&s->lock);
+  *shardOut = s;
+  *created = false;
+
+  //Probe until the key or an empty slot
+  while (s->index[slot] != 0) {
+    uint64_t item = s->index[slot];
+    if ((uint32_t)(item >> 32) == tag) {
+      entry = (uint32_t)item - 1;
+      if (addrKeysEqual(&s->hot[entry].key, key)) {
+        if (s->lruHead != entry) {
+          lruUnlink(s, entry);
+          lruPushHead(s, entry);
+        }
+        return &s->hot[entry];
+      }
+    }
+    slot = (slot + 1) & s->indexMask;
+  }
+
+  //Not found - take a free entry, a never used one or the LRU victim
+  if (s->freeList != CLIENT_TABLE_NIL) {
+    entry = s->freeList;
+    s->freeList = s->hot[entry].lruNext;
+  } else if (s->used < s->capacity) {
+    entry = s->used++;
+  } else {
+    entry = s->lruTail;
+    removeEntry(t, s, entry);
+    s->evictions++;
+    entry = s->freeList;
+    s->freeList = s->hot[entry].lruNext;
+    //the removal may have shifted the empty slot, probe again
+    slot = tag & s->indexMask;
+    while (s->index[slot] != 0)
+      slot = (slot + 1) & s->indexMask;
+  }
+
+  memset(&s->hot[entry], 0, sizeof(ClientHot));
+  memset(&s->cold[entry], 0, sizeof(ClientCold));
+  s->hot[entry].key = *key;
+  s->hot[entry].lastSeen = (uint32_t)now;
+  memcpy(&s->cold[entry].addr, addr, sizeof(struct sockaddr_storage));
+  s->cold[entry].firstSeen = now;
+  flowSessionRestart(&s->sessions[entry], key, now);
+  resetReplayWindow(s, entry);
+  s->index[slot] = ((uint64_t)tag << 32) | (uint64_t)(entry + 1);
+  s->count++;
+  lruPushHead(s, entry);
+  *created = true;
+  return &s->hot[entry];
+}
+
+/***********************************************************
+* Function: void clientTableRelease(ClientShard *shard)
+*
+* Explanation: unlocks the shard returned by clientTableAcquire
+*
+**************************************************/
+void clientTableRelease(ClientShard *shard)
+{
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/***********************************************************
+* Function: FlowSession *clientTableLockSession(ClientTable *t, uint32_t shardIndex,
+*                                               uint32_t entry, uint32_t flowId,
+*                                               ClientShard **shardOut)
+*
+* Explanation: For a pipelined record (see StatsRing.h):  the session it
+*              was taken from, unless the client was removed or its
+*              session restarted since
+*
+* outputs: the session with *shardOut locked, or NULL
+*
+**************************************************/
+FlowSession *clientTableLockSession(ClientTable *t, uint32_t shardIndex, uint32_t entry, uint32_t flowId,
+                                    ClientShard **shardOut)
+{
+  ClientShard *s = NULL;
+  FlowSession *session = NULL;
+
+  if (shardIndex >= CLIENT_TABLE_SHARDS)
+    return NULL;
+  s = &t->shards[shardIndex];
+  pthread_mutex_lock(&s->lock);
+  session = clientTableFindSession(s, entry, flowId);
+  if (session != NULL) {
+    *shardOut = s;
+    return session;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+/***********************************************************
+* Function: uint32_t clientTableExpire(ClientTable *t, time_t now, time_t timeout)
+*
+* Explanation: Removes the clients not seen for more than timeout
+*              seconds.   Each shard is walked from its LRU tail, so only
+*              the expired clients (plus one) are visited.
+*
+* outputs: returns the number removed
+*
+**************************************************/
+uint32_t clientTableExpire(ClientTable *t, time_t now, time_t timeout)
+{
+  uint32_t removed = 0;
+  uint32_t i = 0;
+
+  for (i = 0; i < CLIENT_TABLE_SHARDS; i++) {
+    ClientShard *s = &t->shards[i];
+    pthread_mutex_lock(&s->lock);
+    while ((s->lruTail != CLIENT_TABLE_NIL) && (now - (time_t)s->hot[s->lruTail].lastSeen > timeout)) {
+      removeEntry(t, s, s->lruTail);
+      s->expirations++;
+      removed++;
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+  return removed;
+}
+
+/***********************************************************
+* Function: void clientTableGetStats(ClientTable *t, ClientTableStats *stats)
+*
+* Explanation: sums the shard counters
+*
+**************************************************/
+void clientTableGetStats(ClientTable *t, ClientTableStats *stats)
+{
+  uint32_t i = 0;
+
+  memset(stats, 0, sizeof(ClientTableStats));
+  stats->capacity = t->capacity;
+  for (i = 0; i < CLIENT_TABLE_SHARDS; i++) {
+    ClientShard *s = &t->shards[i];
+    pthread_mutex_lock(&s->lock);
+    stats->count += s->count;
+    stats->liveFlows += s->liveFlows;
+    stats->evictions += s->evictions;
+    stats->expirations += s->expirations;
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+/***********************************************************
+* Function: void clientTableRestartSession(ClientShard *shard, ClientHot *client, time_t now)
+*
+* Explanation: for a client back after timing out - its old session is
+*              retired and a new one started
+*
+**************************************************/
+void clientTableRestartSession(ClientShard *shard, ClientHot *client, time_t now)
+{
+  FlowSession *session = clientTableSession(shard, client);
+
+  if (session->receivedCount > 0) {
+    flowSessionMerge(&shard->retired, session);
+    shard->liveFlows--;
+  }
+  flowSessionRestart(session, &client->key, now);
+  resetReplayWindow(shard, (uint32_t)(client - shard->hot));
+}
+
+/***********************************************************
+* Function: uint32_t clientTableForEachSession(ClientTable *t, FlowSessionFn fn, void *arg)
+*
+* Explanation: Walks each shard's LRU list from the tail, so within a
+*              shard the clients come oldest first.  Sessions that never
+*              accounted a packet (every packet was dropped) are skipped.
+*
+* outputs: the number of sessions passed to fn
+*
+**************************************************/
+uint32_t clientTableForEachSession(ClientTable *t, FlowSessionFn fn, void *arg)
+{
+  return clientTableForEachSessionUpTo(t, fn, arg, UINT32_MAX);
+}
+
+/***********************************************************
+* Function: uint32_t clientTableForEachSessionUpTo(ClientTable *t, FlowSessionFn fn,
+*                                                  void *arg, uint32_t maxCalls)
+*
+* Explanation: clientTableForEachSession that stops after maxCalls.  Each
+*              shard's walk also stops once it has found the shard's
+*              liveFlows sessions, so an idle shard costs only its lock.
+*
+* outputs: the number of sessions passed to fn
+*
+**************************************************/
+uint32_t clientTableForEachSessionUpTo(ClientTable *t, FlowSessionFn fn, void *arg, uint32_t maxCalls)
+{
+  uint32_t calls = 0;
+  uint32_t i = 0;
+
+  for (i = 0; i < CLIENT_TABLE_SHARDS && calls < maxCalls; i++) {
+    ClientShard *s = &t->shards[i];
+    uint32_t entry = CLIENT_TABLE_NIL;
+    uint32_t found = 0;
+
+    pthread_mutex_lock(&s->lock);
+    for (entry = s->lruTail; entry != CLIENT_TABLE_NIL && found < s->liveFlows && calls < maxCalls;
+         entry = s->hot[entry].lruPrev) {
+      if (s->sessions[entry].receivedCount == 0)
+        continue;
+      fn(&s->sessions[entry], arg);
+      found++;
+      calls++;
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+  return calls;
+}
+
+/***********************************************************
+* Function: void clientTableMergeRetired(ClientTable *t, FlowSession *into)
+*
+* Explanation: adds every shard's retired sessions to *into
+*
+**************************************************/
+void clientTableMergeRetired(ClientTable *t, FlowSession *into)
+{
+  uint32_t i = 0;
+
+  for (i = 0; i < CLIENT_TABLE_SHARDS; i++) {
+    ClientShard *s = &t->shards[i];
+    pthread_mutex_lock(&s->lock);
+    flowSessionMerge(into, &s->retired);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+static void resetReplayWindow(ClientShard *s, uint32_t entry)
+{
+  memset(&s->replayBits[(size_t)entry * s->replay.words], 0, s->replay.words * sizeof(uint64_t));
+  s->hot[entry].replayTop = 0;
+}
+
+//finalizer from MurmurHash3
+static uint64_t mix64(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+//Seeded hash of the address and port.  The low 32 bits are the index
+//tag (and home slot), the top bits pick the shard
+static uint64_t hashKey(const ClientTable *t, const NetAddrKey *key)
+{
+  uint64_t words[3] = {0, 0, 0};
+
+  memcpy(words, key, sizeof(NetAddrKey));
+  return mix64(mix64(mix64(t->seed ^ words[0]) ^ words[1]) ^ words[2]);
+}
+
+static ClientShard *shardOf(ClientTable *t, uint64_t hash)
+{
+  return &t->shards[(hash >> 58) & (CLIENT_TABLE_SHARDS - 1)];
+}
+
+static void lruUnlink(ClientShard *s, uint32_t entry)
+{
+  ClientHot *c = &s->hot[entry];
+
+  if (c->lruPrev != CLIENT_TABLE_NIL)
+    s->hot[c->lruPrev].lruNext = c->lruNext;
+  else
+    s->lruHead = c->lruNext;
+  if (c->lruNext != CLIENT_TABLE_NIL)
+    s->hot[c->lruNext].lruPrev = c->lruPrev;
+  else
+    s->lruTail = c->lruPrev;
+}
+
+static void lruPushHead(ClientShard *s, uint32_t entry)
+{
+  ClientHot *c = &s->hot[entry];
+
+  c->lruPrev = CLIENT_TABLE_NIL;
+  c->lruNext = s->lruHead;
+  if (s->lruHead != CLIENT_TABLE_NIL)
+    s->hot[s->lruHead].lruPrev = entry;
+  s->lruHead = entry;
+  if (s->lruTail == CLIENT_TABLE_NIL)
+    s->lruTail = entry;
+}
+
+//Linear probing delete by backward shift - no tombstones, so chains
+//never grow from churn
+static void indexRemove(ClientShard *s, uint32_t entry, uint32_t tag)
+{
+  uint32_t i = tag & s->indexMask;
+  uint32_t j = 0;
+
+  while ((uint32_t)s->index[i] != entry + 1)
+    i = (i + 1) & s->indexMask;
+
+  j = i;
+  for (;;) {
+    j = (j + 1) & s->indexMask;
+    if (s->index[j] == 0)
+      break;
+    uint32_t home = (uint32_t)(s->index[j] >> 32) & s->indexMask;
+    //move it back unless its home lies cyclically in (i, j]
+    if (((j - home) & s->indexMask) >= ((j - i) & s->indexMask)) {
+      s->index[i] = s->index[j];
+      i = j;
+    }
+  }
+  s->index[i] = 0;
+}
+
+//Drops an entry from the index and LRU list onto the free list, its
+//session is retired
+static void removeEntry(ClientTable *t, ClientShard *s, uint32_t entry)
+{
+  uint32_t tag = (uint32_t)hashKey(t, &s->hot[entry].key);
+
+  if (s->sessions[entry].receivedCount > 0) {
+    flowSessionMerge(&s->retired, &s->sessions[entry]);
+    s->liveFlows--;
+  }
+  s->sessions[entry].flowId = 0;
+  indexRemove(s, entry, tag);
+  lruUnlink(s, entry);
+  s->hot[entry].lruNext = s->freeList;
+  s->freeList = entry;
+  s->count--;
+}
@@ -0,0 +1,189 @@
+/************************************************************************
+* File:  ClientTable.h
+*
+* Purpose:
+*   The server's per client state, kept in a sharded open-addressing
+*   hash table keyed on the binary client address (NetAddrKey).
+*
+* Notes:
+*   Each shard has its own mutex, index, entries and LRU list.  A lookup
+*   locks one shard, probes the shard's index (tag compare first, so a
+*   probe rarely touches an entry) and returns the entry still locked.
+*   The caller must clientTableRelease the shard when done with it.
+*   When a shard is full its least recently used entry is evicted, so the
+*   cost of a lookup does not depend on how many sources are tracked.
+*   The hash is seeded at start up so spoofed sources can not aim for
+*   one probe chain.
+*
+*   Each client owns a FlowSession (the measurement state of its flow),
+*   started when the client is created.  When a client is evicted, expires
+*   or restarts its session, the old session is merged into its shard's
+*   retired session so the summary still counts it.  The entries'
+*   sessions are small, the bulk of a flow's state is its FlowDetail,
+*   allocated when the flow's first packet is accounted.  It stays with
+*   the entry for the next client's session.
+*
+*   Each client also owns a replay window bitmap (see ReplayWindow.h),
+*   cleared with its session.  The window's top is ClientHot.replayTop.
+*
+*   With the server's stats pipeline (StatsRing.h) a session is updated
+*   after the packet's shard lock was released, by another thread.  The
+*   record names the session by shard, entry and flowId;  a removed
+*   entry's session has flowId 0, and a restarted one a new flowId, so a
+*   record that outlived its session finds nothing.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: per client FlowSessions
+* A3: 10/17/26: per client replay window bitmaps
+* A4: 10/17/26: clientTableLockSession for the stats pipeline
+* A5: 10/17/26: sessions restarted in place, keeping their FlowDetail
+* A6: 10/17/26: per shard liveFlows count, clientTableForEachSessionUpTo
+* A7: 10/17/26: clientTableFindSession, a record's session in a locked shard
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__ClientTable_h
+#define	__ClientTable_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "AddressHelper.h"
+#include "FlowSession.h"
+#include "ReplayWindow.h"
+
+#define CLIENT_TABLE_SHARDS 64       // must be a power of 2
+#define CLIENT_TABLE_NIL UINT32_MAX  // end of an LRU or free list
+
+#define CLIENT_AUTH_TOKEN_SIZE 16
+
+/*
+  Hot part of a client - everything a packet touches (the key for the
+  probe, the rate limiter, the replay check and the LRU links) in one
+  cache line.
+*/
+typedef struct {
+  NetAddrKey key;
+  uint32_t lruPrev;
+  uint32_t lruNext;
+  uint32_t packetsReceived;
+  uint32_t packetsDropped;
+  uint32_t replayTop;    //highest sequence number accepted
+  uint32_t lastSeen;     //time(), 32 bits keeps this at one cache line
+  bool authenticated;
+  uint64_t rateTat;      //rate limiter: theoretical arrival time (ns)
+} __attribute__((aligned(64))) ClientHot;
+
+//Cold part - only written when a client is created
+typedef struct {
+  struct sockaddr_storage addr;
+  time_t firstSeen;
+  uint8_t authToken[CLIENT_AUTH_TOKEN_SIZE];
+} ClientCold;
+
+typedef struct {
+  pthread_mutex_t lock;
+
+  //open addressing index:  0 is empty, else (tag << 32) | (entry + 1)
+  uint64_t *index;
+  uint32_t indexMask;
+
+  ClientHot *hot;
+  ClientCold *cold;
+  FlowSession *sessions;
+  FlowSession retired;   //sessions of removed clients, merged
+  uint64_t *replayBits;  //replay.words per entry
+  ReplayWindowParams replay;
+  uint32_t capacity;
+  uint32_t used;         //entries handed out at least once
+  uint32_t count;        //entries in use
+  uint32_t liveFlows;    //entries whose session received something
+  uint32_t freeList;     //released entries, linked through lruNext
+  uint32_t lruHead;      //most recently used
+  uint32_t lruTail;      //least recently used
+
+  uint64_t evictions;
+  uint64_t expirations;
+} __attribute__((aligned(64))) ClientShard;
+
+typedef struct {
+  ClientShard shards[CLIENT_TABLE_SHARDS];
+  uint64_t seed;
+  uint32_t capacity;
+} ClientTable;
+
+typedef struct {
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t liveFlows;
+  uint64_t evictions;
+  uint64_t expirations;
+} ClientTableStats;
+
+//replayWindow is the requested window size in packets, see replayWindowParams
+int clientTableInit(ClientTable *t, uint32_t capacity, uint32_t replayWindow);
+
+//Finds or creates the client, returns it with its shard locked.
+//*created is true for a new (zeroed, key and addr filled in) entry.
+ClientHot *clientTableAcquire(ClientTable *t, const NetAddrKey *key, const struct sockaddr_storage *addr,
+                              time_t now, bool *created, ClientShard **shardOut);
+void clientTableRelease(ClientShard *shard);
+
+//Removes the clients not seen for timeout seconds, returns how many
+uint32_t clientTableExpire(ClientTable *t, time_t now, time_t timeout);
+void clientTableGetStats(ClientTable *t, ClientTableStats *stats);
+
+//The client's session, shard locked (from clientTableAcquire)
+static inline FlowSession *clientTableSession(ClientShard *shard, const ClientHot *client)
+{
+  return &shard->sessions[client - shard->hot];
+}
+//The client's replay window bitmap, shard locked
+static inline uint64_t *clientTableReplayBits(ClientShard *shard, const ClientHot *client)
+{
+  return &shard->replayBits[(size_t)(client - shard->hot) * shard->replay.words];
+}
+//Where a client is, for clientTableLockSession
+static inline uint32_t clientTableShardIndex(const ClientTable *t, const ClientShard *shard)
+{
+  return (uint32_t)(shard - t->shards);
+}
+static inline uint32_t clientTableEntry(const ClientShard *shard, const ClientHot *client)
+{
+  return (uint32_t)(client - shard->hot);
+}
+//The session of entry if it is still flowId's, else NULL.  Shard locked
+static inline FlowSession *clientTableFindSession(ClientShard *shard, uint32_t entry, uint32_t flowId)
+{
+  if ((entry < shard->used) && (flowId != 0) && (shard->sessions[entry].flowId == flowId))
+    return &shard->sessions[entry];
+  return NULL;
+}
+//The session of shard/entry with its shard locked if it is still flowId's,
+//else NULL and nothing locked.  Release with clientTableRelease
+FlowSession *clientTableLockSession(ClientTable *t, uint32_t shardIndex, uint32_t entry, uint32_t flowId,
+                                    ClientShard **shardOut);
+//Call when a session accounts its first packet, shard locked
+static inline void clientTableSessionStarted(ClientShard *shard)
+{
+  shard->liveFlows++;
+}
+//Retires the client's session and starts a new one with an empty replay
+//window, shard locked
+void clientTableRestartSession(ClientShard *shard, ClientHot *client, time_t now);
+
+//Calls fn for every live session that received something, oldest client
+//first, each with its shard locked.  Returns the number of calls
+typedef void (*FlowSessionFn)(const FlowSession *session, void *arg);
+uint32_t clientTableForEachSession(ClientTable *t, FlowSessionFn fn, void *arg);
+//Same, stopping after maxCalls.  A shard's walk ends once it has passed
+//that shard's liveFlows sessions and shards with none are not walked
+uint32_t clientTableForEachSessionUpTo(ClientTable *t, FlowSessionFn fn, void *arg, uint32_t maxCalls);
+//Merges the retired sessions of all shards into *into
+void clientTableMergeRetired(ClientTable *t, FlowSession *into);
+
+#endif
+
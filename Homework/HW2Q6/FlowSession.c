@@ -0,0 +1,624 @@
+/*********************************************************
+*
+* Module Name: FlowSession
+*
+* File Name:  FlowSession.c
+*
+* Summary:  Per flow loss/gap/OWD accounting.  See FlowSession.h
+*
+* Revisions:
+*   10/17/26: late arrivals repair the loss count, reordering histograms
+*   10/17/26: flowId
+*   10/17/26: OWD histogram and percentiles
+*   10/17/26: run length histograms, Gilbert-Elliott loss model
+*   10/17/26: jitter, IPDV and PDV
+*   10/17/26: FlowDetail, allocated on the first OWD sample
+*   10/17/26: the reordering and run histograms and the loss model moved
+*             into the FlowDetail
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "FlowSession.h"
+#include <stddef.h>     /* for offsetof */
+
+#define FLOW_MIN_OWD_INIT 10000.0
+#define FLOW_JITTER_GAIN (1.0 / 16.0)   // RFC 3550 A.8
+
+static uint32_t nextFlowId = 0;
+
+static FlowDetail *flowDetail(FlowSession *s);
+static void flowDetailReset(FlowDetail *d);
+static void recoverLoss(FlowSession *s, uint32_t seq);
+static void histogramAdd(uint32_t *hist, uint32_t value);
+static void histogramPrint(FILE *out, const char *name, const uint32_t *hist);
+static void recordRuns(FlowSession *s, FlowDetail *detail, uint32_t lost);
+static void lossModelLoss(FlowLossModel *m, uint32_t lost);
+static void lossModelReceive(FlowLossModel *m);
+static void lossModelFold(const FlowLossModel *m, FlowLossModel *totals);
+
+
+/***********************************************************
+* Function: void flowSessionInit(FlowSession *s, const NetAddrKey *key, time_t now)
+*
+* Explanation: an empty session with the next flowId.  key may be NULL for
+*              an aggregate, which then counts no flows until sessions are
+*              merged into it.  Sessions are started under different shard
+*              locks, so the flowId counter is atomic.
+*
+**************************************************/
+void flowSessionInit(FlowSession *s, const NetAddrKey *key, time_t now)
+{
+  memset(s, 0, sizeof(FlowSession));
+  if (key != NULL) {
+    s->key = *key;
+    s->numberOfFlows = 1;
+    s->flowId = __atomic_add_fetch(&nextFlowId, 1, __ATOMIC_RELAXED);
+  }
+  s->started = now;
+  s->timeOfFirstRxedMsg = -1.0;
+  s->timeOfLastRxedMsg = -1.0;
+  s->minOWDSample = FLOW_MIN_OWD_INIT;
+}
+
+/***********************************************************
+* Function: void flowSessionRestart(FlowSession *s, const NetAddrKey *key, time_t now)
+*
+* Explanation: flowSessionInit for a session that is being reused (a
+*              client table slot).  Its FlowDetail, if it has one, stays
+*              and is emptied.
+*
+**************************************************/
+void flowSessionRestart(FlowSession *s, const NetAddrKey *key, time_t now)
+{
+  FlowDetail *detail = s->detail;
+
+  flowSessionInit(s, key, now);
+  s->detail = detail;
+  if (detail != NULL)
+    flowDetailReset(detail);
+}
+
+/***********************************************************
+* Function: int flowSessionRecord(FlowSession *s, uint32_t seq, double sendTime,
+*                                 double rxTime, double alpha, FlowArrival *arrival)
+*
+* Explanation: The OWD sample, then the sequence number:  a gap opens
+*              (or grows) when numbers are skipped and ends, adding its
+*              size to the loss count, at the next in sequence arrival.
+*              A late arrival was counted as lost, see recoverLoss.
+*              The first sample allocates the FlowDetail;  if that fails
+*              the flow's histograms and loss model are left out, the
+*              counts are not.
+*
+* Inputs:
+*   sendTime : the client's send time from the header
+*   rxTime : the (kernel) receive time
+*   alpha : weight of a new sample in smoothedOWD
+*
+* outputs: FLOW_IN_ORDER, FLOW_OUT_OF_ORDER or FLOW_BAD_GAP
+*
+**************************************************/
+int flowSessionRecord(FlowSession *s, uint32_t seq, double sendTime, double rxTime, double alpha,
+                      FlowArrival *arrival)
+{
+  double OWDSample = rxTime - sendTime;
+  int32_t thisGap = 0;
+  FlowDetail *detail = flowDetail(s);
+
+  memset(arrival, 0, sizeof(FlowArrival));
+  arrival->OWDSample = OWDSample;
+  arrival->lastSeqNumber = s->lastSeqNumber;
+
+  s->timeOfLastRxedMsg = rxTime;
+  if (s->timeOfFirstRxedMsg == -1.0)
+    s->timeOfFirstRxedMsg = rxTime;
+
+  if (OWDSample < 0)
+    s->numberNegativeOWDSamples++;
+  if (OWDSample > s->maxOWDSample)
+    s->maxOWDSample = OWDSample;
+  if (OWDSample < s->minOWDSample)
+    s->minOWDSample = OWDSample;
+
+  s->OWDSum += OWDSample;
+  s->numberOWDSamples++;
+  if (detail != NULL)
+    latencyHistogramRecord(&detail->OWDHist, (int64_t)(OWDSample * 1000000000.0));
+  //Init the filter
+  if (s->numberOWDSamples == 1)
+    s->smoothedOWD = OWDSample;
+  else
+    s->smoothedOWD = alpha*OWDSample + (1-alpha)*s->smoothedOWD;
+
+  //RFC 3550 jitter:  the transit time difference of consecutive arrivals
+  if (s->numberOWDSamples > 1)
+    s->jitter += (fabs(OWDSample - s->prevOWDSample) - s->jitter) * FLOW_JITTER_GAIN;
+  s->prevOWDSample = OWDSample;
+  arrival->jitter = s->jitter;
+
+  if (seq > s->largestSeqRecv)
+    s->largestSeqRecv = seq;
+
+  if (seq <= s->lastSeqNumber) {
+    s->numberOutOfOrder++;
+    recoverLoss(s, seq);
+    return FLOW_OUT_OF_ORDER;
+  }
+
+  thisGap = seq - s->lastSeqNumber - 1;
+  arrival->thisGap = thisGap;
+
+  if ((thisGap > 0) && (s->sizeCurGap > 0)) {
+    //stay in the current active gap
+    s->sizeCurGap += thisGap;
+  }
+  if ((thisGap > 0) && (s->sizeCurGap == 0)) {
+    //start a new active gap
+    s->numberOfGaps++;
+    arrival->gapStarted = 1;
+    s->sizeCurGap = thisGap;
+    s->curGapStart = s->lastSeqNumber + 1;
+  }
+  if ((thisGap == 0) && (s->sizeCurGap > 0)) {
+    //end the active gap
+    s->sumOfAllGaps += s->sizeCurGap;
+    arrival->gapEnded = s->sizeCurGap;
+    s->sizeCurGap = 0;
+  }
+
+  if (thisGap < 0)
+    return FLOW_BAD_GAP;
+
+  //RFC 5481 IPDV:  only a pair of consecutive sequence numbers
+  if ((thisGap == 0) && (s->lastSeqNumber > 0)) {
+    double IPDV = OWDSample - s->lastInOrderOWD;
+    if ((s->numberIPDV == 0) || (IPDV < s->minIPDV))
+      s->minIPDV = IPDV;
+    if ((s->numberIPDV == 0) || (IPDV > s->maxIPDV))
+      s->maxIPDV = IPDV;
+    s->IPDVAbsSum += fabs(IPDV);
+    s->numberIPDV++;
+    arrival->haveIPDV = 1;
+    arrival->IPDV = IPDV;
+  }
+  s->lastInOrderOWD = OWDSample;
+
+  recordRuns(s, detail, (uint32_t)thisGap);
+  s->lastSeqNumber = seq;
+  return FLOW_IN_ORDER;
+}
+
+/***********************************************************
+* Function: void flowSessionReordered(FlowSession *s, uint32_t extent, uint32_t lateBy)
+*
+* Explanation: adds a late arrival to the reordering histograms
+*
+**************************************************/
+void flowSessionReordered(FlowSession *s, uint32_t extent, uint32_t lateBy)
+{
+  FlowDetail *detail = flowDetail(s);
+
+  if (extent > s->maxReorderExtent)
+    s->maxReorderExtent = extent;
+  if (lateBy > s->maxLateBy)
+    s->maxLateBy = lateBy;
+  if (detail != NULL) {
+    histogramAdd(detail->reorderExtentHist, extent);
+    histogramAdd(detail->lateByHist, lateBy);
+  }
+}
+
+/***********************************************************
+* Function: void flowSessionMerge(FlowSession *into, const FlowSession *from)
+*
+* Explanation: Adds from's counts to into.   The time span covers both,
+*              an open gap in from is not counted (as at the end of a run).
+*
+**************************************************/
+void flowSessionMerge(FlowSession *into, const FlowSession *from)
+{
+  FlowLossModel model;
+  FlowDetail *detail = NULL;
+  uint32_t i = 0;
+
+  into->numberOfFlows += from->numberOfFlows;
+  if ((from->timeOfFirstRxedMsg != -1.0) &&
+      ((into->timeOfFirstRxedMsg == -1.0) || (from->timeOfFirstRxedMsg < into->timeOfFirstRxedMsg)))
+    into->timeOfFirstRxedMsg = from->timeOfFirstRxedMsg;
+  if (from->timeOfLastRxedMsg > into->timeOfLastRxedMsg)
+    into->timeOfLastRxedMsg = from->timeOfLastRxedMsg;
+
+  into->largestSeqRecv += from->largestSeqRecv;
+  into->receivedCount += from->receivedCount;
+  into->totalBytesRxed += from->totalBytesRxed;
+  into->numberOutOfOrder += from->numberOutOfOrder;
+  into->numberOfGaps += from->numberOfGaps;
+  into->sumOfAllGaps += from->sumOfAllGaps;
+
+  if (from->numberOWDSamples > 0) {
+    if (from->maxOWDSample > into->maxOWDSample)
+      into->maxOWDSample = from->maxOWDSample;
+    if (from->minOWDSample < into->minOWDSample)
+      into->minOWDSample = from->minOWDSample;
+  }
+  if (into->numberOWDSamples + from->numberOWDSamples > 0)
+    into->jitter = (into->jitter * (double)into->numberOWDSamples + from->jitter * (double)from->numberOWDSamples) /
+                   (double)(into->numberOWDSamples + from->numberOWDSamples);
+  into->OWDSum += from->OWDSum;
+  into->numberOWDSamples += from->numberOWDSamples;
+  into->numberNegativeOWDSamples += from->numberNegativeOWDSamples;
+  if (from->detail != NULL)
+    detail = flowDetail(into);
+  if (detail != NULL)
+    latencyHistogramMerge(&detail->OWDHist, &from->detail->OWDHist);
+  if (from->numberIPDV > 0) {
+    if ((into->numberIPDV == 0) || (from->minIPDV < into->minIPDV))
+      into->minIPDV = from->minIPDV;
+    if ((into->numberIPDV == 0) || (from->maxIPDV > into->maxIPDV))
+      into->maxIPDV = from->maxIPDV;
+  }
+  into->numberIPDV += from->numberIPDV;
+  into->IPDVAbsSum += from->IPDVAbsSum;
+
+  if (from->maxReorderExtent > into->maxReorderExtent)
+    into->maxReorderExtent = from->maxReorderExtent;
+  if (from->maxLateBy > into->maxLateBy)
+    into->maxLateBy = from->maxLateBy;
+  into->numberDuplicates += from->numberDuplicates;
+  into->numberTooOld += from->numberTooOld;
+
+  //from's runs and periods in progress end here
+  if (from->maxLossRun > into->maxLossRun)
+    into->maxLossRun = from->maxLossRun;
+  if (from->maxGoodRun > into->maxGoodRun)
+    into->maxGoodRun = from->maxGoodRun;
+  if (from->curGoodRun > into->maxGoodRun)
+    into->maxGoodRun = from->curGoodRun;
+  if (detail == NULL)
+    return;
+
+  for (i = 0; i < FLOW_REORDER_BUCKETS; i++) {
+    detail->reorderExtentHist[i] += from->detail->reorderExtentHist[i];
+    detail->lateByHist[i] += from->detail->lateByHist[i];
+    detail->lossRunHist[i] += from->detail->lossRunHist[i];
+    detail->goodRunHist[i] += from->detail->goodRunHist[i];
+  }
+  if (from->curGoodRun > 0)
+    histogramAdd(detail->goodRunHist, from->curGoodRun);
+  lossModelFold(&from->detail->lossModel, &model);
+  detail->lossModel.goodPackets += model.goodPackets;
+  detail->lossModel.goodLost += model.goodLost;
+  detail->lossModel.badPackets += model.badPackets;
+  detail->lossModel.badLost += model.badLost;
+  detail->lossModel.enteredBad += model.enteredBad;
+  detail->lossModel.leftBad += model.leftBad;
+}
+
+/***********************************************************
+* Function: void flowSessionSummarize(const FlowSession *s, FlowSummary *summary)
+*
+* Explanation: the server's summary figures.  The number of trials (only
+*              the sender knows it for sure) is estimated from the largest
+*              sequence number seen.
+*
+**************************************************/
+void flowSessionSummarize(const FlowSession *s, FlowSummary *summary)
+{
+  uint64_t numberOfTrials = s->largestSeqRecv;
+
+  memset(summary, 0, sizeof(FlowSummary));
+  summary->duration = s->timeOfLastRxedMsg - s->timeOfFirstRxedMsg;
+
+  if (summary->duration > 0.0)
+    summary->avgThroughput = ((double)s->totalBytesRxed * 8.0) / summary->duration;
+
+  if (s->numberOWDSamples > 0)
+    summary->avgOWD = s->OWDSum / (double)s->numberOWDSamples;
+  flowSessionOWDPercentiles(s, &summary->OWD);
+  if (s->numberIPDV > 0)
+    summary->meanAbsIPDV = s->IPDVAbsSum / (double)s->numberIPDV;
+  //The histogram does not go below 0, a negative minimum OWD (the
+  //clocks disagree) leaves the PDV percentiles at 0
+  if ((s->numberOWDSamples > 0) && (s->minOWDSample >= 0.0)) {
+    summary->PDV.p50 = fmax(summary->OWD.p50 - s->minOWDSample, 0.0);
+    summary->PDV.p90 = fmax(summary->OWD.p90 - s->minOWDSample, 0.0);
+    summary->PDV.p99 = fmax(summary->OWD.p99 - s->minOWDSample, 0.0);
+    summary->PDV.p999 = fmax(summary->OWD.p999 - s->minOWDSample, 0.0);
+  }
+  if (s->numberOWDSamples > 0)
+    summary->maxPDV = s->maxOWDSample - s->minOWDSample;
+
+  if (numberOfTrials >= s->receivedCount)
+    summary->totalLost1 = numberOfTrials - s->receivedCount;
+  summary->totalLost2 = (s->sumOfAllGaps > 0) ? (uint64_t)s->sumOfAllGaps : 0;
+
+  if (numberOfTrials > 0)
+    summary->avgLossRate1 = (double)summary->totalLost1 / (double)numberOfTrials;
+
+  if (s->receivedCount > 0) {
+    summary->avgLossRate2 = (double)summary->totalLost2 / (double)(s->receivedCount + summary->totalLost2);
+    summary->avgLossEventRate = (double)s->numberOfGaps / ((double)s->receivedCount + (double)summary->totalLost2);
+  }
+
+  if (s->numberOfGaps > 0)
+    summary->avgGapSize = (double)s->sumOfAllGaps / (double)s->numberOfGaps;
+}
+
+void flowSessionOWDPercentiles(const FlowSession *s, LatencyPercentiles *p)
+{
+  if (s->detail == NULL) {
+    memset(p, 0, sizeof(LatencyPercentiles));
+    return;
+  }
+  latencyHistogramPercentiles(&s->detail->OWDHist, p);
+}
+
+/***********************************************************
+* Function: void flowSessionPrint(FILE *out, const FlowSession *s, const FlowSummary *summary)
+*
+* Explanation: one summary line, the columns of the server's summary header
+*
+**************************************************/
+void flowSessionPrint(FILE *out, const FlowSession *s, const FlowSummary *summary)
+{
+  //a flow that only sent the terminate signal has no OWD samples
+  double minOWDSample = (s->numberOWDSamples > 0) ? s->minOWDSample : 0.0;
+
+  fprintf(out, "%6.2f \t\t%04.9f \t%04.9f \t%04.9f \t%12.0f \t%03.6f \t%03.6f \t%03.6f \t%9d \t%9lu \t%3.6f \t%9lu  \t%9lu \t%9u \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%04.9f \n",
+      summary->duration, summary->avgOWD, minOWDSample, s->maxOWDSample, summary->avgThroughput,
+      summary->avgLossRate2, summary->avgGapSize, summary->avgLossEventRate, s->numberOfGaps,
+      summary->totalLost2, summary->avgLossRate1, summary->totalLost1, s->receivedCount,
+      s->numberNegativeOWDSamples, summary->OWD.p50, summary->OWD.p90, summary->OWD.p99, summary->OWD.p999,
+      s->jitter, summary->meanAbsIPDV, summary->PDV.p999);
+}
+
+/***********************************************************
+* Function: void flowSessionPrintReordering(FILE *out, const FlowSession *s)
+*
+* Explanation: The RFC 4737 reordered ratio (late arrivals over all
+*              arrivals), the replay window drops and the histograms
+*
+**************************************************/
+void flowSessionPrintReordering(FILE *out, const FlowSession *s)
+{
+  double ratio = (s->receivedCount > 0) ? (double)s->numberOutOfOrder / (double)s->receivedCount : 0.0;
+
+  fprintf(out, "Reordering: reordered:%u of %lu (ratio %3.6f) maxExtent:%u maxLateBy:%u duplicates:%u tooOld:%u\n",
+      s->numberOutOfOrder, s->receivedCount, ratio, s->maxReorderExtent, s->maxLateBy,
+      s->numberDuplicates, s->numberTooOld);
+  if ((s->numberOutOfOrder > 0) && (s->detail != NULL)) {
+    histogramPrint(out, "extent", s->detail->reorderExtentHist);
+    histogramPrint(out, "lateBy", s->detail->lateByHist);
+  }
+}
+
+/***********************************************************
+* Function: void flowSessionPrintLossModel(FILE *out, const FlowSession *s)
+*
+* Explanation: The run length histograms and the Gilbert-Elliott fit.
+*              Each state's parameters are its transitions and losses per
+*              packet spent in it:
+*                p = P(good -> bad), r = P(bad -> good)
+*                1-k = loss rate in gaps, 1-h = loss rate in bursts
+*              modelLoss, the loss rate the fitted model predicts, should
+*              be close to the measured one.  The periods in progress
+*              count as if the flow ended now.
+*
+**************************************************/
+void flowSessionPrintLossModel(FILE *out, const FlowSession *s)
+{
+  FlowLossModel m;
+  double p = 0.0;
+  double r = 0.0;
+  double lossGood = 0.0;
+  double lossBad = 0.0;
+  double piBad = 0.0;
+
+  if (s->detail != NULL)
+    lossModelFold(&s->detail->lossModel, &m);
+  else
+    memset(&m, 0, sizeof(FlowLossModel));
+  if (m.goodPackets > 0) {
+    p = (double)m.enteredBad / (double)m.goodPackets;
+    lossGood = (double)m.goodLost / (double)m.goodPackets;
+  }
+  if (m.badPackets > 0) {
+    r = (double)m.leftBad / (double)m.badPackets;
+    lossBad = (double)m.badLost / (double)m.badPackets;
+  }
+  if (p + r > 0.0)
+    piBad = p / (p + r);
+
+  fprintf(out, "Loss runs: maxLossRun:%u maxGoodRun:%u\n",
+      s->maxLossRun, (s->curGoodRun > s->maxGoodRun) ? s->curGoodRun : s->maxGoodRun);
+  if ((s->maxLossRun > 0) && (s->detail != NULL)) {
+    histogramPrint(out, "lossRun", s->detail->lossRunHist);
+    histogramPrint(out, "goodRun", s->detail->goodRunHist);
+  }
+  fprintf(out, "Gilbert-Elliott (Gmin %d): p:%3.6f r:%3.6f 1-k:%3.6f 1-h:%3.6f bursts:%u meanBurst:%3.2f meanGap:%3.2f modelLoss:%3.6f\n",
+      FLOW_GE_GMIN, p, r, lossGood, lossBad, m.enteredBad,
+      (m.enteredBad > 0) ? (double)m.badPackets / (double)m.enteredBad : 0.0,
+      (double)m.goodPackets / (double)(m.enteredBad + 1),
+      piBad * lossBad + (1.0 - piBad) * lossGood);
+}
+
+/***********************************************************
+* Function: void flowSessionPrintDelayVariation(FILE *out, const FlowSession *s,
+*                                               const FlowSummary *summary)
+*
+* Explanation: The RFC 3550 jitter, the RFC 5481 IPDV (mean of its
+*              magnitude, range) and PDV (percentiles, to the histogram's
+*              precision, and the exact maximum)
+*
+**************************************************/
+void flowSessionPrintDelayVariation(FILE *out, const FlowSession *s, const FlowSummary *summary)
+{
+  fprintf(out, "Delay variation: jitter:%4.9f IPDV: mean|.|:%4.9f min:%4.9f max:%4.9f (%lu pairs)\n",
+      s->jitter, summary->meanAbsIPDV, s->minIPDV, s->maxIPDV, s->numberIPDV);
+  fprintf(out, "  PDV: p50:%4.9f p90:%4.9f p99:%4.9f p99.9:%4.9f max:%4.9f\n",
+      summary->PDV.p50, summary->PDV.p90, summary->PDV.p99, summary->PDV.p999, summary->maxPDV);
+}
+
+//The session's FlowDetail, allocated if it has none yet.  NULL if that
+//fails
+static FlowDetail *flowDetail(FlowSession *s)
+{
+  if (s->detail == NULL) {
+    s->detail = calloc(1, sizeof(FlowDetail));
+  }
+  return s->detail;
+}
+
+static void flowDetailReset(FlowDetail *d)
+{
+  memset(d, 0, offsetof(FlowDetail, OWDHist));
+  latencyHistogramReset(&d->OWDHist);
+}
+
+//A late packet was counted in a gap when it went missing.  If the gap is
+//still open it shrinks (and is gone if this was all of it), else the
+//loss total is reduced - the gap itself stays a loss event
+static void recoverLoss(FlowSession *s, uint32_t seq)
+{
+  if ((s->sizeCurGap > 0) && (seq >= s->curGapStart)) {
+    s->sizeCurGap--;
+    if (s->sizeCurGap == 0)
+      s->numberOfGaps--;
+  } else if (s->sumOfAllGaps > 0) {
+    s->sumOfAllGaps--;
+  }
+}
+
+static void histogramAdd(uint32_t *hist, uint32_t value)
+{
+  uint32_t bucket = 0;
+
+  if (value > 0)
+    bucket = 31 - (uint32_t)__builtin_clz(value);
+  if (bucket >= FLOW_REORDER_BUCKETS)
+    bucket = FLOW_REORDER_BUCKETS - 1;
+  hist[bucket]++;
+}
+
+static void histogramPrint(FILE *out, const char *name, const uint32_t *hist)
+{
+  uint32_t b = 0;
+
+  fprintf(out, "  %-7s", name);
+  for (b = 0; b < FLOW_REORDER_BUCKETS; b++) {
+    if (hist[b] == 0)
+      continue;
+    if (b == FLOW_REORDER_BUCKETS - 1)
+      fprintf(out, " %u+:%u", 1U << b, hist[b]);
+    else if (b == 0)
+      fprintf(out, " 1:%u", hist[b]);
+    else
+      fprintf(out, " %u-%u:%u", 1U << b, (2U << b) - 1, hist[b]);
+  }
+  fprintf(out, "\n");
+}
+
+//An in sequence arrival after lost skipped sequence numbers:  ends the
+//good run (if lost > 0) and starts the next.  detail may be NULL
+static void recordRuns(FlowSession *s, FlowDetail *detail, uint32_t lost)
+{
+  if (lost > 0) {
+    if (s->curGoodRun > 0) {
+      if (detail != NULL)
+        histogramAdd(detail->goodRunHist, s->curGoodRun);
+      if (s->curGoodRun > s->maxGoodRun)
+        s->maxGoodRun = s->curGoodRun;
+    }
+    if (detail != NULL) {
+      histogramAdd(detail->lossRunHist, lost);
+      lossModelLoss(&detail->lossModel, lost);
+    }
+    if (lost > s->maxLossRun)
+      s->maxLossRun = lost;
+    s->curGoodRun = 0;
+  }
+  s->curGoodRun++;
+  if (detail != NULL)
+    lossModelReceive(&detail->lossModel);
+}
+
+//lost consecutive losses, O(1) however many.  A loss outside a burst
+//starts a tentative one, the second loss within FLOW_GE_GMIN arrivals
+//makes it a burst and closes the good period before it
+static void lossModelLoss(FlowLossModel *m, uint32_t lost)
+{
+  uint32_t lostBefore = 0;
+
+  if (!m->inBurst) {
+    m->inBurst = 1;
+    m->burstLen = 0;
+    m->burstLost = 0;
+  } else {
+    m->burstLen += m->recvSinceLoss;
+  }
+  lostBefore = m->burstLost;
+  m->burstLen += lost;
+  m->burstLost += lost;
+  m->recvSinceLoss = 0;
+
+  if ((lostBefore < 2) && (m->burstLost >= 2)) {
+    m->goodPackets += m->goodLen;
+    m->goodLost += m->goodLenLost;
+    m->goodLen = 0;
+    m->goodLenLost = 0;
+    m->enteredBad++;
+  }
+}
+
+//FLOW_GE_GMIN arrivals without a loss end a burst, those arrivals start
+//the next good period.  A lone loss was a gap loss after all
+static void lossModelReceive(FlowLossModel *m)
+{
+  if (!m->inBurst) {
+    m->goodLen++;
+    return;
+  }
+  m->recvSinceLoss++;
+  if (m->recvSinceLoss < FLOW_GE_GMIN)
+    return;
+
+  if (m->burstLost >= 2) {
+    m->badPackets += m->burstLen;
+    m->badLost += m->burstLost;
+    m->leftBad++;
+    m->goodLen = FLOW_GE_GMIN;
+  } else {
+    m->goodLen += m->burstLen + FLOW_GE_GMIN;
+    m->goodLenLost += m->burstLost;
+  }
+  m->inBurst = 0;
+  m->burstLen = 0;
+  m->burstLost = 0;
+  m->recvSinceLoss = 0;
+}
+
+//The closed period counts with the periods in progress closed as they
+//stand:  a burst with two losses is a burst, the rest is good period
+static void lossModelFold(const FlowLossModel *m, FlowLossModel *totals)
+{
+  memset(totals, 0, sizeof(FlowLossModel));
+  totals->goodPackets = m->goodPackets + m->goodLen;
+  totals->goodLost = m->goodLost + m->goodLenLost;
+  totals->badPackets = m->badPackets;
+  totals->badLost = m->badLost;
+  totals->enteredBad = m->enteredBad;
+  totals->leftBad = m->leftBad;
+
+  if (m->inBurst) {
+    if (m->burstLost >= 2) {
+      totals->badPackets += m->burstLen;
+      totals->badLost += m->burstLost;
+    } else {
+      totals->goodPackets += m->burstLen;
+      totals->goodLost += m->burstLost;
+    }
+    totals->goodPackets += m->recvSinceLoss;
+  }
+}
@@ -0,0 +1,219 @@
+/************************************************************************
+* File:  FlowSession.h
+*
+* Purpose:
+*   The server's measurement state for one flow (client address+port):
+*   sequence, loss/gap, OWD and throughput accounting.   Each client in
+*   the client table owns one, so concurrent clients no longer interleave
+*   their sequence spaces.
+*
+* Notes:
+*   A session is only touched under its client's shard lock.
+*   flowSessionMerge folds a session into another, which is how the
+*   aggregate and the sessions of departed clients are kept.  In a merged
+*   session largestSeqRecv is the sum of the flows' largest sequence
+*   numbers, i.e. the estimated number of packets all of them sent.
+*
+*   Late packets (reordered, let through by the replay window) are not
+*   lost:  one that fills a hole takes it out of the loss count again.
+*   Their reordering extent and how far behind they came (RFC 4737) go
+*   into log2 histograms.
+*
+*   The OWD samples also go into a LatencyHistogram, the summary line
+*   ends with their p50, p90, p99 and p99.9.  The histograms (this one
+*   and those below) and the loss model are most of a flow's state, so
+*   they live in a FlowDetail allocated on the flow's first OWD sample
+*   (after the server's filters passed it), not in the session:  a
+*   client table slot of a source that never got that far costs only
+*   the FlowSession.  A slot keeps its FlowDetail when it gets a new
+*   session (flowSessionRestart), it is reset, not reallocated.
+*
+*   Delay variation:  the RFC 3550 interarrival jitter (over consecutive
+*   arrivals), the RFC 5481 IPDV (OWD difference of consecutive sequence
+*   numbers, both arrived in order) and the PDV (OWD less the minimum
+*   OWD), whose percentiles are the OWD histogram's less the minimum.
+*
+*   Loss burstiness in constant memory:  log2 histograms of the loss runs
+*   (consecutive sequence numbers skipped) and good runs (consecutive
+*   in sequence arrivals), and an online Gilbert-Elliott fit.  The fit
+*   splits the packet sequence into bursts and gaps the RFC 3611 way (a
+*   burst ends after FLOW_GE_GMIN arrivals without a loss, a lone loss
+*   between such runs is a gap loss) and counts the packets, losses and
+*   transitions of each state.  Both are taken when a packet arrives, a
+*   late arrival has already counted as lost there.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: late arrivals repair the loss count, reordering histograms
+* A3: 10/17/26: flowId, the flow column of the sample capture
+* A4: 10/17/26: OWD percentiles from a LatencyHistogram
+* A5: 10/17/26: loss/good run histograms, Gilbert-Elliott loss model
+* A6: 10/17/26: RFC 3550 jitter, RFC 5481 IPDV and PDV
+* A7: 10/17/26: the OWD histogram moved into the lazily allocated FlowDetail
+* A8: 10/17/26: so did the reordering and run histograms and the loss model
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__FlowSession_h
+#define	__FlowSession_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "AddressHelper.h"
+#include "LatencyHistogram.h"
+
+//What flowSessionRecord made of an arrival
+#define FLOW_IN_ORDER 0
+#define FLOW_OUT_OF_ORDER 1   // at or below the last sequence number
+#define FLOW_BAD_GAP 2        // negative gap, the sequence number was not taken
+
+//Reordering and run length histogram buckets:  bucket b counts values
+//2^b .. 2^(b+1)-1, the last one everything above
+#define FLOW_REORDER_BUCKETS 16
+
+//Arrivals without a loss that end a burst (RFC 3611 Gmin)
+#define FLOW_GE_GMIN 16
+
+/*
+  Gilbert-Elliott state of a flow.  The counts of closed periods are what
+  the fit uses, the rest is the period in progress:  the good period so
+  far, and a burst that is tentative until its second loss
+*/
+typedef struct {
+  uint64_t goodPackets;     // in good periods (gaps)
+  uint64_t goodLost;
+  uint64_t badPackets;      // in bursts
+  uint64_t badLost;
+  uint32_t enteredBad;      // good to bad transitions
+  uint32_t leftBad;         // bad to good
+
+  uint32_t goodLen;
+  uint32_t goodLenLost;
+  uint32_t burstLen;        // first to last loss
+  uint32_t burstLost;
+  uint32_t recvSinceLoss;
+  uint32_t inBurst;
+} FlowLossModel;
+
+//The large part of a flow's state, see flowSessionRecord
+typedef struct {
+  uint32_t reorderExtentHist[FLOW_REORDER_BUCKETS];
+  uint32_t lateByHist[FLOW_REORDER_BUCKETS];
+  uint32_t lossRunHist[FLOW_REORDER_BUCKETS];
+  uint32_t goodRunHist[FLOW_REORDER_BUCKETS];
+  FlowLossModel lossModel;
+  LatencyHistogram OWDHist;  // last, flowDetailReset clears it separately
+} FlowDetail;
+
+typedef struct {
+  NetAddrKey key;
+  time_t started;
+  uint32_t numberOfFlows;   // 1, or the number merged into this one
+  uint32_t flowId;          // unique per session, 0 for an aggregate
+
+  double timeOfFirstRxedMsg;
+  double timeOfLastRxedMsg;
+  uint64_t largestSeqRecv;
+  uint64_t receivedCount;
+  uint64_t totalBytesRxed;
+  uint32_t numberOutOfOrder;
+
+  uint32_t lastSeqNumber;
+  int32_t numberOfGaps;
+  int32_t sumOfAllGaps;
+  int32_t sizeCurGap;       // 0 means not in a gap
+  uint32_t curGapStart;     // first sequence number missing in the current gap
+
+  double OWDSum;
+  uint32_t numberOWDSamples;
+  double maxOWDSample;
+  double minOWDSample;
+  double smoothedOWD;
+  uint32_t numberNegativeOWDSamples;
+  FlowDetail *detail;       // NULL until the first OWD sample
+
+  //Delay variation, see flowSessionPrintDelayVariation.  In a merged
+  //session jitter is the per flow jitter weighted by the OWD samples
+  double jitter;
+  double prevOWDSample;     // of the last arrival
+  double lastInOrderOWD;    // of the arrival with lastSeqNumber
+  uint64_t numberIPDV;
+  double IPDVAbsSum;
+  double minIPDV;
+  double maxIPDV;
+
+  //RFC 4737 reordering of the late arrivals, see flowSessionReordered
+  uint32_t maxReorderExtent;
+  uint32_t maxLateBy;
+  //dropped by the replay window
+  uint32_t numberDuplicates;
+  uint32_t numberTooOld;
+
+  //Loss burstiness, see flowSessionPrintLossModel
+  uint32_t curGoodRun;
+  uint32_t maxLossRun;
+  uint32_t maxGoodRun;
+} FlowSession;
+
+typedef struct {
+  double OWDSample;
+  int32_t thisGap;
+  int32_t gapEnded;         // size of the gap this arrival closed, 0 if none
+  int32_t gapStarted;       // 1 if this arrival opened a new gap
+  double jitter;            // the flow's jitter after this arrival
+  int32_t haveIPDV;         // 1 if IPDV is set (lastSeqNumber + 1 arrived)
+  double IPDV;
+  uint32_t lastSeqNumber;   // before this arrival
+} FlowArrival;
+
+//The derived figures of the summary line
+typedef struct {
+  double duration;
+  double avgOWD;
+  double avgThroughput;
+  double avgLossRate1;      // from the largest sequence number
+  double avgLossRate2;      // from the gaps
+  double avgGapSize;
+  double avgLossEventRate;
+  uint64_t totalLost1;
+  uint64_t totalLost2;
+  LatencyPercentiles OWD;
+  double meanAbsIPDV;
+  LatencyPercentiles PDV;   // OWD percentiles less the minimum OWD
+  double maxPDV;
+} FlowSummary;
+
+//An empty session in uninitialized memory, it has no FlowDetail
+void flowSessionInit(FlowSession *s, const NetAddrKey *key, time_t now);
+//An empty session in place of an initialized (or zeroed) one, keeping
+//its FlowDetail
+void flowSessionRestart(FlowSession *s, const NetAddrKey *key, time_t now);
+
+//Accounts one data packet (not the terminate signal).  Returns FLOW_IN_ORDER,
+//FLOW_OUT_OF_ORDER or FLOW_BAD_GAP, *arrival says what happened
+int flowSessionRecord(FlowSession *s, uint32_t seq, double sendTime, double rxTime, double alpha,
+                      FlowArrival *arrival);
+
+//A late arrival (FLOW_OUT_OF_ORDER):  extent is the number of packets
+//with a larger sequence number that came first, lateBy how far its
+//sequence number is behind the highest one
+void flowSessionReordered(FlowSession *s, uint32_t extent, uint32_t lateBy);
+
+void flowSessionMerge(FlowSession *into, const FlowSession *from);
+void flowSessionSummarize(const FlowSession *s, FlowSummary *summary);
+//The OWD percentiles (seconds), 0 before the first sample
+void flowSessionOWDPercentiles(const FlowSession *s, LatencyPercentiles *p);
+
+//The tab separated summary columns (duration ... numberNegativeOWDs,
+//p50OWD ... p999OWD, jitter, meanIPDV, p999PDV) and a newline
+void flowSessionPrint(FILE *out, const FlowSession *s, const FlowSummary *summary);
+//The reordering counts and the non empty histogram buckets
+void flowSessionPrintReordering(FILE *out, const FlowSession *s);
+//The run length histograms and the Gilbert-Elliott parameters
+void flowSessionPrintLossModel(FILE *out, const FlowSession *s);
+//Jitter, IPDV and PDV
+void flowSessionPrintDelayVariation(FILE *out, const FlowSession *s, const FlowSummary *summary);
+
+#endif
+
@@ -0,0 +1,98 @@
+/*********************************************************
+*
+* Module Name: LatencyHistogram
+*
+* File Name:  LatencyHistogram.c
+*
+* Summary:  Log-linear latency histogram.  See LatencyHistogram.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "LatencyHistogram.h"
+
+static uint64_t bucketTop(uint32_t index);
+
+
+void latencyHistogramInit(LatencyHistogram *h)
+{
+  memset(h, 0, sizeof(LatencyHistogram));
+}
+
+void latencyHistogramReset(LatencyHistogram *h)
+{
+  if (h->total > 0)
+    memset(h->counts, 0, (latencyHistogramIndex(h->maxValue) + 1) * sizeof(uint32_t));
+  h->total = 0;
+  h->maxValue = 0;
+}
+
+void latencyHistogramMerge(LatencyHistogram *into, const LatencyHistogram *from)
+{
+  uint32_t i = 0;
+
+  for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+    into->counts[i] += from->counts[i];
+  into->total += from->total;
+  if (from->maxValue > into->maxValue)
+    into->maxValue = from->maxValue;
+}
+
+/***********************************************************
+* Function: uint64_t latencyHistogramPercentile(const LatencyHistogram *h, double percent)
+*
+* Explanation: Walks the buckets up to the one holding the sample of
+*              rank ceil(percent/100 * total).  O(LATENCY_HIST_BUCKETS),
+*              only called for the summaries.
+*
+* outputs: the top of that bucket, at most the largest sample (ns)
+*
+**************************************************/
+uint64_t latencyHistogramPercentile(const LatencyHistogram *h, double percent)
+{
+  uint64_t rank = 0;
+  uint64_t seen = 0;
+  uint32_t i = 0;
+
+  if (h->total == 0)
+    return 0;
+  rank = (uint64_t)ceil(percent / 100.0 * (double)h->total);
+  if (rank < 1)
+    rank = 1;
+  if (rank > h->total)
+    rank = h->total;
+
+  for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t top = bucketTop(i);
+      return (top < h->maxValue) ? top : h->maxValue;
+    }
+  }
+  return h->maxValue;
+}
+
+void latencyHistogramPercentiles(const LatencyHistogram *h, LatencyPercentiles *p)
+{
+  p->p50 = (double)latencyHistogramPercentile(h, 50.0) / 1000000000.0;
+  p->p90 = (double)latencyHistogramPercentile(h, 90.0) / 1000000000.0;
+  p->p99 = (double)latencyHistogramPercentile(h, 99.0) / 1000000000.0;
+  p->p999 = (double)latencyHistogramPercentile(h, 99.9) / 1000000000.0;
+}
+
+//The largest value that falls in bucket index, the inverse of
+//latencyHistogramIndex
+static uint64_t bucketTop(uint32_t index)
+{
+  uint32_t shift = 0;
+  uint64_t sub = 0;
+
+  if (index < 2 * LATENCY_HIST_SUB_BUCKETS)
+    return index;
+  shift = (index >> LATENCY_HIST_SUB_BITS) - 1;
+  sub = index - (shift << LATENCY_HIST_SUB_BITS);
+  return ((sub + 1) << shift) - 1;
+}
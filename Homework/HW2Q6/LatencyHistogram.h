@@ -0,0 +1,114 @@
+/************************************************************************
+* File:  LatencyHistogram.h
+*
+* Purpose:
+*   HDR style log-linear latency histogram:  O(1) to record a sample,
+*   fixed size, and percentiles (p50, p90, p99, p99.9) without keeping
+*   the samples.  The server keeps one per flow for OWD (merged into the
+*   aggregate), the client one for RTT.
+*
+* Notes:
+*   Values are nanoseconds.  Below 2 * LATENCY_HIST_SUB_BUCKETS every
+*   value has its own bucket; above, each power of 2 is split into
+*   LATENCY_HIST_SUB_BUCKETS linear buckets, so a bucket is never wider
+*   than 1/LATENCY_HIST_SUB_BUCKETS (6.25%) of the values in it.  A
+*   percentile is reported as the top of its bucket (capped at the
+*   largest sample), i.e. it may read high by up to that much, never low.
+*
+*   Negative values (the client and server clocks disagree) count as 0,
+*   values from 2^LATENCY_HIST_MAX_BITS ns (68.7 s) up go to the top
+*   bucket.  Every histogram has the same layout, so they merge by adding
+*   the counts.
+*
+*   latencyHistogramReset only clears the buckets up to the largest
+*   sample, a histogram that saw only small values is cheap to reuse.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: latencyHistogramReset
+* A3: 10/17/26: latencyHistogramRecordShared
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__LatencyHistogram_h
+#define	__LatencyHistogram_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LATENCY_HIST_SUB_BITS 4
+#define LATENCY_HIST_SUB_BUCKETS (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS 36
+#define LATENCY_HIST_BUCKETS ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t total;
+  uint64_t maxValue;    // ns, the largest sample after clamping
+  uint32_t counts[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+//The percentiles of the summaries, in seconds (0 with no samples)
+typedef struct {
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+} LatencyPercentiles;
+
+void latencyHistogramInit(LatencyHistogram *h);
+//Empties a histogram, touching only the buckets that may be in use
+void latencyHistogramReset(LatencyHistogram *h);
+
+//The bucket of a value:  its top LATENCY_HIST_SUB_BITS + 1 significant
+//bits, the power of 2 selecting the group of buckets
+static inline uint32_t latencyHistogramIndex(uint64_t value)
+{
+  uint32_t shift = 0;
+  uint32_t msb = 0;
+
+  if (value >= (1ULL << LATENCY_HIST_MAX_BITS))
+    value = (1ULL << LATENCY_HIST_MAX_BITS) - 1;
+  msb = 63 - (uint32_t)__builtin_clzll(value | 1);
+  if (msb > LATENCY_HIST_SUB_BITS)
+    shift = msb - LATENCY_HIST_SUB_BITS;
+  return (shift << LATENCY_HIST_SUB_BITS) + (uint32_t)(value >> shift);
+}
+
+//Adds one sample, O(1)
+static inline void latencyHistogramRecord(LatencyHistogram *h, int64_t valueNs)
+{
+  uint64_t value = (valueNs > 0) ? (uint64_t)valueNs : 0;
+
+  if (value >= (1ULL << LATENCY_HIST_MAX_BITS))
+    value = (1ULL << LATENCY_HIST_MAX_BITS) - 1;
+  h->counts[latencyHistogramIndex(value)]++;
+  h->total++;
+  if (value > h->maxValue)
+    h->maxValue = value;
+}
+
+//latencyHistogramRecord for a histogram other threads read (relaxed
+//atomic loads) while its one writer records:  each count is published
+//with a relaxed store
+static inline void latencyHistogramRecordShared(LatencyHistogram *h, int64_t valueNs)
+{
+  uint64_t value = (valueNs > 0) ? (uint64_t)valueNs : 0;
+  uint32_t index = 0;
+
+  if (value >= (1ULL << LATENCY_HIST_MAX_BITS))
+    value = (1ULL << LATENCY_HIST_MAX_BITS) - 1;
+  index = latencyHistogramIndex(value);
+  __atomic_store_n(&h->counts[index], h->counts[index] + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELAXED);
+  if (value > h->maxValue)
+    __atomic_store_n(&h->maxValue, value, __ATOMIC_RELAXED);
+}
+
+void latencyHistogramMerge(LatencyHistogram *into, const LatencyHistogram *from);
+
+//The value (ns) percent of the samples are at or below, 0 with no samples
+uint64_t latencyHistogramPercentile(const LatencyHistogram *h, double percent);
+void latencyHistogramPercentiles(const LatencyHistogram *h, LatencyPercentiles *p);
+
+#endif
+
@@ -0,0 +1,154 @@
+/*********************************************************
+*
+* Module Name: LiveStats
+*
+* File Name:  LiveStats.c
+*
+* Summary:  The shared memory live statistics segment and its seqlock.
+*           See LiveStats.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "LiveStats.h"
+#include <stddef.h>     /* offsetof */
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/***********************************************************
+* Function: LiveStatsSegment *liveStatsCreate(const char *name)
+*
+* Explanation: A new zeroed segment of sizeof(LiveStatsSegment) with the
+*              header filled in.  A segment left behind by a server that
+*              did not exit cleanly is replaced.
+*
+**************************************************/
+LiveStatsSegment *liveStatsCreate(const char *name)
+{
+  LiveStatsSegment *seg = NULL;
+  int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+  if (fd < 0)
+    return NULL;
+  if (ftruncate(fd, sizeof(LiveStatsSegment)) < 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  seg = mmap(NULL, sizeof(LiveStatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  seg->version = LIVE_STATS_VERSION;
+  seg->headerSize = (uint16_t)offsetof(LiveStatsSegment, body);
+  seg->bodySize = sizeof(LiveStatsBody);
+  seg->histSubBits = LATENCY_HIST_SUB_BITS;
+  seg->histMaxBits = LATENCY_HIST_MAX_BITS;
+  seg->seq = 0;
+  //A reader checks the magic first, it goes in last
+  __atomic_store_n(&seg->magic, LIVE_STATS_MAGIC, __ATOMIC_RELEASE);
+  return seg;
+}
+
+/***********************************************************
+* Function: void liveStatsPublish(LiveStatsSegment *seg, const LiveStatsBody *body)
+*
+* Explanation: The seqlock write:  seq goes odd, the fence keeps the body
+*              stores after it, and the release store of the next even
+*              seq keeps them before that.  Single writer only.
+*
+**************************************************/
+void liveStatsPublish(LiveStatsSegment *seg, const LiveStatsBody *body)
+{
+  uint32_t seq = seg->seq;
+
+  __atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&seg->body, body, sizeof(LiveStatsBody));
+  __atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void liveStatsRemove(const char *name, LiveStatsSegment *seg)
+{
+  munmap(seg, sizeof(LiveStatsSegment));
+  shm_unlink(name);
+}
+
+/***********************************************************
+* Function: const LiveStatsSegment *liveStatsOpen(const char *name)
+*
+* Explanation: maps the segment read only, after checking that it is
+*              at least as large as this build's layout and that the
+*              layout is the same
+*
+**************************************************/
+const LiveStatsSegment *liveStatsOpen(const char *name)
+{
+  struct stat st;
+  const LiveStatsSegment *seg = NULL;
+  int fd = shm_open(name, O_RDONLY, 0);
+
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", name, strerror(errno));
+    return NULL;
+  }
+  if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(LiveStatsSegment))) {
+    fprintf(stderr, "%s: not a live stats segment\n", name);
+    close(fd);
+    return NULL;
+  }
+  seg = mmap(NULL, sizeof(LiveStatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", name, strerror(errno));
+    return NULL;
+  }
+
+  if ((__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != LIVE_STATS_MAGIC) ||
+      (seg->version != LIVE_STATS_VERSION) ||
+      (seg->headerSize != offsetof(LiveStatsSegment, body)) ||
+      (seg->bodySize != sizeof(LiveStatsBody)) ||
+      (seg->histSubBits != LATENCY_HIST_SUB_BITS) || (seg->histMaxBits != LATENCY_HIST_MAX_BITS)) {
+    fprintf(stderr, "%s: not a version %d live stats segment\n", name, LIVE_STATS_VERSION);
+    munmap((void *)seg, sizeof(LiveStatsSegment));
+    return NULL;
+  }
+  return seg;
+}
+
+/***********************************************************
+* Function: int liveStatsSnapshot(const LiveStatsSegment *seg, LiveStatsBody *body)
+*
+* Explanation: The seqlock read:  copies the body and keeps the copy if
+*              seq was even and unchanged around it (the acquire fence
+*              keeps the copy's loads before the second seq load).  An
+*              update takes well under a millisecond, the reader yields
+*              between tries.
+*
+* outputs: NOERROR, or ERROR after LIVE_STATS_READ_TRIES torn copies
+*
+**************************************************/
+int liveStatsSnapshot(const LiveStatsSegment *seg, LiveStatsBody *body)
+{
+  uint32_t tries = 0;
+
+  for (tries = 0; tries < LIVE_STATS_READ_TRIES; tries++) {
+    uint32_t before = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+    if ((before & 1) == 0) {
+      memcpy(body, (const void *)&seg->body, sizeof(LiveStatsBody));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == before)
+        return NOERROR;
+    }
+    sched_yield();
+  }
+  return ERROR;
+}
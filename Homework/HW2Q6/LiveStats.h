@@ -0,0 +1,119 @@
+/************************************************************************
+* File:  LiveStats.h
+*
+* Purpose:
+*   The server's live statistics in a POSIX shared memory segment
+*   (/dev/shm), so a monitor (udpecho-stat) can watch a running server
+*   instead of waiting for serverResults.dat.  The segment holds the
+*   totals over all workers, the aggregate OWD histogram and the stats
+*   of the first LIVE_STATS_MAX_FLOWS flows.
+*
+* Notes:
+*   The server's publisher thread is the only writer.  It builds a
+*   LiveStatsBody in private memory and copies it in under a seqlock:
+*   seq is odd while the copy is in progress.  A reader copies the body
+*   out and keeps the copy if seq was the same even number before and
+*   after.  Neither side takes a lock or makes a system call per update,
+*   and the receive path is not involved at all.
+*
+*   The layout is versioned:  a reader checks magic, version, the body
+*   size and the histogram layout before it trusts anything else.  Any
+*   change to the structs below must bump LIVE_STATS_VERSION.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: per flow jitter and IPDV (version 2)
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__LiveStats_h
+#define	__LiveStats_h
+
+#include <stdint.h>
+#include "AddressHelper.h"
+#include "LatencyHistogram.h"
+
+#define LIVE_STATS_MAGIC 0x54534c55     // "ULST"
+#define LIVE_STATS_VERSION 2
+#define LIVE_STATS_MAX_FLOWS 256
+#define LIVE_STATS_INTERVAL_MS 100      // how often the server publishes
+#define LIVE_STATS_READ_TRIES 1000      // a reader's attempts at a consistent copy
+
+typedef struct {
+  char addr[ADDRKEY_STRLEN];
+  uint32_t flowId;
+  uint64_t receivedCount;
+  uint64_t totalBytesRxed;
+  uint64_t largestSeqRecv;
+  uint32_t numberOutOfOrder;
+  int32_t numberOfGaps;
+  int32_t sumOfAllGaps;
+  uint32_t numberNegativeOWDSamples;
+  double timeOfFirstRxedMsg;
+  double timeOfLastRxedMsg;
+  double meanOWD;
+  double minOWD;
+  double maxOWD;
+  double smoothedOWD;
+  LatencyPercentiles OWD;
+  double jitter;            // RFC 3550
+  double meanAbsIPDV;       // RFC 5481
+} LiveFlowStats;
+
+typedef struct {
+  uint32_t pid;
+  uint32_t numWorkers;
+  double startTime;         // getCurTimeD() of the server start
+  double updateTime;        // and of this update
+  uint64_t updates;
+
+  //Summed over the workers
+  uint64_t receivedCount;
+  uint64_t totalBytesRxed;
+  uint64_t OWDSamples;
+  int64_t OWDSumNs;
+  uint64_t lostPackets;     // sequence numbers skipped
+  uint64_t recoveredPackets;// late arrivals, skipped before
+  uint64_t gapsStarted;
+  uint32_t RxErrorCount;
+  uint32_t TxErrorCount;
+  uint32_t packetsDroppedByRateLimit;
+  uint32_t packetsDroppedByAuth;
+  uint32_t packetsDroppedByWhitelist;
+  uint32_t packetsDroppedByReplay;
+  LatencyHistogram OWDHist;
+
+  uint32_t clientsTracked;
+  uint32_t liveFlows;       // flows with packets in the client table
+  uint32_t numFlows;        // of them in flows[]
+  LiveFlowStats flows[LIVE_STATS_MAX_FLOWS];
+} LiveStatsBody;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;      // offset of body
+  uint32_t bodySize;
+  uint16_t histSubBits;     // the LatencyHistogram layout
+  uint16_t histMaxBits;
+  uint32_t seq;             // odd while the body is being written
+  uint8_t pad[44];
+  LiveStatsBody body;
+} LiveStatsSegment;
+
+//The server side:  creates (or replaces) the segment name ("/..."),
+//NULL on failure
+LiveStatsSegment *liveStatsCreate(const char *name);
+//Copies body into the segment under the seqlock
+void liveStatsPublish(LiveStatsSegment *seg, const LiveStatsBody *body);
+//Unmaps and unlinks the segment
+void liveStatsRemove(const char *name, LiveStatsSegment *seg);
+
+//The reader side:  maps an existing segment read only and checks its
+//layout, NULL (and a message on stderr) if it is not usable
+const LiveStatsSegment *liveStatsOpen(const char *name);
+//A consistent copy of the body.  ERROR if the writer kept it busy
+int liveStatsSnapshot(const LiveStatsSegment *seg, LiveStatsBody *body);
+
+#endif
+
@@ -0,0 +1,170 @@
+/*********************************************************
+*
+* Module Name: Pacer
+*
+* File Name:  Pacer.c
+*
+* Summary:  The client's sleep-then-spin send pacer.  See Pacer.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "utils.h"
+#include "Pacer.h"
+#include <sys/resource.h>
+
+static void sleepUntil(Pacer *p, double target, double now);
+
+
+/***********************************************************
+* Function: void pacerInit(Pacer *p, bool spinOnly)
+*
+* Explanation: Sleeps PACER_CALIBRATION_SLEEPS times for
+*              PACER_CALIBRATION_SECS to seed the lateness statistics,
+*              a few milliseconds at startup.  The calibration sleeps
+*              are not counted as waits.
+*
+**************************************************/
+void pacerInit(Pacer *p, bool spinOnly)
+{
+  uint32_t i = 0;
+  double now = 0.0;
+
+  memset(p, 0, sizeof(Pacer));
+  latencyHistogramInit(&p->errorHist);
+  p->spinOnly = spinOnly;
+  p->margin = PACER_INITIAL_MARGIN;
+  p->startTime = getTimestampD();
+  if (spinOnly)
+    return;
+
+  for (i = 0; i < PACER_CALIBRATION_SLEEPS; i++) {
+    now = getTimestampD();
+    sleepUntil(p, now + PACER_CALIBRATION_SECS, now);
+  }
+  p->calibrationMean = p->latenessMean;
+  p->calibrationMax = p->latenessMax;
+  p->sleeps = 0;
+  p->latenessMax = 0.0;
+  p->startTime = getTimestampD();
+}
+
+/***********************************************************
+* Function: void pacerObserveWake(Pacer *p, double target, double woke)
+*
+* Explanation: Folds one wake-up lateness into the smoothed mean and
+*              deviation and recomputes the margin.  The first sample
+*              sets the mean, with half of it as the deviation.
+*
+**************************************************/
+void pacerObserveWake(Pacer *p, double target, double woke)
+{
+  double lateness = fmax(woke - target, 0.0);
+  double err = 0.0;
+
+  if (p->wakes == 0) {
+    p->latenessMean = lateness;
+    p->latenessDev = lateness / 2.0;
+  } else {
+    err = lateness - p->latenessMean;
+    p->latenessMean += err * PACER_MEAN_GAIN;
+    p->latenessDev += (fabs(err) - p->latenessDev) * PACER_DEV_GAIN;
+  }
+  p->wakes++;
+  if (lateness > p->latenessMax)
+    p->latenessMax = lateness;
+
+  p->margin = p->latenessMean + PACER_DEV_FACTOR * p->latenessDev;
+  if (p->margin < PACER_MIN_MARGIN)
+    p->margin = PACER_MIN_MARGIN;
+  if (p->margin > PACER_MAX_MARGIN)
+    p->margin = PACER_MAX_MARGIN;
+}
+
+void pacerRecordSend(Pacer *p, double deadline, double start, double now)
+{
+  if (start >= deadline) {
+    p->behind++;
+    return;
+  }
+  p->waits++;
+  latencyHistogramRecord(&p->errorHist, (int64_t)((now - deadline) * 1000000000.0));
+}
+
+/***********************************************************
+* Function: void pacerWait(Pacer *p, double deadline)
+*
+* Explanation: Sleeps until margin before deadline if that is still
+*              ahead, then spins the rest.  A sleep that returns after
+*              the deadline is an overshoot, the margin was too small.
+*
+**************************************************/
+void pacerWait(Pacer *p, double deadline)
+{
+  double start = getTimestampD();
+  double now = start;
+
+  if (p->spinOnly) {
+    (void) busyWait(deadline);
+    pacerRecordSend(p, deadline, start, getTimestampD());
+    return;
+  }
+
+  if (deadline - now > p->margin) {
+    sleepUntil(p, deadline - p->margin, now);
+    now = getTimestampD();
+    if (now > deadline)
+      p->overshoots++;
+  }
+  while (now < deadline)
+    now = getTimestampD();
+  pacerRecordSend(p, deadline, start, now);
+}
+
+/***********************************************************
+* Function: void pacerPrintStats(const Pacer *p, FILE *out)
+*
+* Explanation: One line:  the waits, how many slept, the overshoots,
+*              the waits that started behind schedule, the margin and
+*              lateness, the send-time error percentiles and max (us),
+*              and the process CPU time as a share of the wall time
+*              since pacerInit.
+*
+**************************************************/
+void pacerPrintStats(const Pacer *p, FILE *out)
+{
+  struct rusage usage;
+  LatencyPercentiles error;
+  double cpu = 0.0;
+  double wall = getTimestampD() - p->startTime;
+
+  memset(&usage, 0, sizeof(usage));
+  (void) getrusage(RUSAGE_SELF, &usage);
+  cpu = convertTimeval(&usage.ru_utime) + convertTimeval(&usage.ru_stime);
+  latencyHistogramPercentiles(&p->errorHist, &error);
+
+  fprintf(out, "pacer: %s waits:%lu slept:%lu overshoot:%lu behind:%lu margin:%.1fus lateness mean:%.1fus max:%.1fus error p50:%.1fus p99:%.1fus p999:%.1fus max:%.1fus cpu:%.1f%% \n",
+          p->spinOnly ? "spin" : "sleep+spin", p->waits, p->sleeps, p->overshoots, p->behind,
+          p->margin * 1e6, p->latenessMean * 1e6, p->latenessMax * 1e6,
+          error.p50 * 1e6, error.p99 * 1e6, error.p999 * 1e6, (double)p->errorHist.maxValue / 1e3,
+          (wall > 0.0) ? 100.0 * cpu / wall : 0.0);
+}
+
+//clock_nanosleep until target (getTimestampD() seconds, now is the
+//current one) on CLOCK_MONOTONIC, then observes the lateness
+static void sleepUntil(Pacer *p, double target, double now)
+{
+  struct timespec wake;
+  double wakeD = 0.0;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &wake);
+  wakeD = convertTS2D(&wake) + (target - now);
+  (void) convertD2TS(&wakeD, &wake);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+    ;
+  p->sleeps++;
+  pacerObserveWake(p, target, getTimestampD());
+}
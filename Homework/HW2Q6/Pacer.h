@@ -0,0 +1,92 @@
+/************************************************************************
+* File:  Pacer.h
+*
+* Purpose:
+*   The client's send pacer:  waits for a send deadline by sleeping in
+*   clock_nanosleep(TIMER_ABSTIME) until a margin before it, then
+*   spinning only for that margin.  It replaces busyWait's spin over the
+*   whole inter-packet gap, which kept a core at 100% even at 10 pps.
+*
+* Notes:
+*   The margin tunes itself from the observed wake-up lateness (how late
+*   a sleep returns after its target) the way RFC 6298 tunes an RTO:
+*   smoothed mean + PACER_DEV_FACTOR * mean deviation, clamped to
+*   PACER_MIN_MARGIN..PACER_MAX_MARGIN.  pacerInit seeds it with a few
+*   calibration sleeps.  Other sleepers (the client's epoll event loop)
+*   feed their lateness in with pacerObserveWake and use the same margin.
+*
+*   Deadlines are getTimestampD() (CLOCK_MONOTONIC_RAW) seconds.
+*   clock_nanosleep does not take that clock, so the sleep target is
+*   carried over to CLOCK_MONOTONIC, which differs from it by a slew of
+*   ppm:  nothing against a margin of microseconds.
+*
+*   Send-time accuracy (wait return - deadline) goes into a
+*   LatencyHistogram, and the CPU time of the process is reported with it.
+*   A wait whose deadline had already passed when it started (the sender
+*   is behind its schedule, e.g. held back by the RTT window) says
+*   nothing about the pacer:  it is counted as behind instead.
+*   spinOnly keeps the old busyWait behavior, for comparing.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__Pacer_h
+#define	__Pacer_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "LatencyHistogram.h"
+
+#define PACER_MIN_MARGIN 0.000005
+#define PACER_MAX_MARGIN 0.002
+#define PACER_INITIAL_MARGIN 0.0001
+#define PACER_DEV_FACTOR 4.0
+#define PACER_MEAN_GAIN (1.0 / 8.0)
+#define PACER_DEV_GAIN (1.0 / 4.0)
+#define PACER_CALIBRATION_SLEEPS 16
+#define PACER_CALIBRATION_SECS 0.0002
+
+typedef struct {
+  bool spinOnly;
+  double margin;            // seconds spun before a deadline
+  double latenessMean;      // smoothed wake-up lateness
+  double latenessDev;       // its smoothed mean deviation
+  double latenessMax;
+  double calibrationMean;   // what pacerInit measured
+  double calibrationMax;
+
+  uint64_t waits;
+  uint64_t sleeps;
+  uint64_t wakes;           // lateness observations
+  uint64_t overshoots;      // woke up after the deadline itself
+  uint64_t behind;          // the deadline had passed before the wait
+  LatencyHistogram errorHist;   // wait return - deadline, ns
+
+  double startTime;         // for the CPU share
+} Pacer;
+
+//Calibrates the margin (unless spinOnly)
+void pacerInit(Pacer *p, bool spinOnly);
+
+//The margin a sleeper should wake up ahead of its deadline by
+static inline double pacerMargin(const Pacer *p)
+{
+  return p->margin;
+}
+
+//A sleep aimed at target (getTimestampD() seconds) returned at woke
+void pacerObserveWake(Pacer *p, double target, double woke);
+
+//A wait for deadline that started at start returned at now
+void pacerRecordSend(Pacer *p, double deadline, double start, double now);
+
+//Sleeps, then spins, until deadline (getTimestampD() seconds)
+void pacerWait(Pacer *p, double deadline);
+
+//Prints the pacer line of the summary
+void pacerPrintStats(const Pacer *p, FILE *out);
+
+#endif
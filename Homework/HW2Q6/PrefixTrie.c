@@ -0,0 +1,238 @@
+/*********************************************************
+*
+* Module Name: PrefixTrie
+*
+* File Name:  PrefixTrie.c
+*
+* Summary:  Longest prefix match trie of IPv4/IPv6 CIDR prefixes.
+*           See PrefixTrie.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "PrefixTrie.h"
+
+#define PREFIX_TRIE_INITIAL_NODES 64
+
+static const uint8_t v4MappedPrefix[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+
+static uint32_t newNode(PrefixTrie *t);
+static void expandPrefix(uint32_t *table, uint32_t first, uint32_t count, uint32_t value);
+static int insertBits(PrefixTrie *t, uint32_t *root, const uint8_t *bytes, int bits, int prefixLen);
+static bool prefixCovers(const uint8_t *addr, int prefixLen, const uint8_t *other, int otherLen);
+
+
+/***********************************************************
+* Function: PrefixTrie *prefixTrieCreate(void)
+*
+* Explanation: an empty trie - every lookup misses
+*
+* outputs: the trie, NULL if out of memory
+*
+**************************************************/
+PrefixTrie *prefixTrieCreate(void)
+{
+  PrefixTrie *t = calloc(1, sizeof(PrefixTrie));
+
+  if (t == NULL)
+    return NULL;
+  t->nodes = calloc(PREFIX_TRIE_INITIAL_NODES, sizeof(t->nodes[0]));
+  if (t->nodes == NULL) {
+    free(t);
+    return NULL;
+  }
+  t->maxNodes = PREFIX_TRIE_INITIAL_NODES;
+  t->numNodes = 1;
+  return t;
+}
+
+/***********************************************************
+* Function: void prefixTrieFree(PrefixTrie *t)
+*
+* Explanation: frees the trie.  Nobody may still be looking up in it.
+*
+**************************************************/
+void prefixTrieFree(PrefixTrie *t)
+{
+  if (t == NULL)
+    return;
+  free(t->nodes);
+  free(t);
+}
+
+/***********************************************************
+* Function: int prefixTrieInsert(PrefixTrie *t, const uint8_t *addr, int prefixLen)
+*
+* Explanation: Adds addr/prefixLen.   A v4-mapped prefix of at least 96 bits
+*              goes in the IPv4 trie, anything else in the IPv6 trie.  A
+*              short IPv6 prefix that covers all of ::ffff:0:0/96 (::/0 for
+*              one) is added to the IPv4 trie as well, since v4-mapped keys
+*              only look there.
+*
+* outputs: returns ERROR (bad length or out of memory) or NOERROR
+*
+**************************************************/
+int prefixTrieInsert(PrefixTrie *t, const uint8_t *addr, int prefixLen)
+{
+  static const uint8_t anyV4[4] = {0, 0, 0, 0};
+
+  if ((prefixLen < 0) || (prefixLen > 128))
+    return ERROR;
+
+  if ((prefixLen >= 96) && (memcmp(addr, v4MappedPrefix, sizeof(v4MappedPrefix)) == 0)) {
+    if (insertBits(t, t->v4Root, addr + 12, prefixLen - 96, prefixLen) == ERROR)
+      return ERROR;
+    t->v4Prefixes++;
+    return NOERROR;
+  }
+
+  if (insertBits(t, t->v6Root, addr, prefixLen, prefixLen) == ERROR)
+    return ERROR;
+  if (prefixCovers(addr, prefixLen, v4MappedPrefix, 96)) {
+    if (insertBits(t, t->v4Root, anyV4, 0, prefixLen) == ERROR)
+      return ERROR;
+  }
+  t->v6Prefixes++;
+  return NOERROR;
+}
+
+/***********************************************************
+* Function: int prefixTrieLookup(const PrefixTrie *t, const NetAddrKey *key)
+*
+* Explanation: Walks the key's address down the trie, remembering the
+*              longest prefix seen.  The port is ignored.
+*
+* outputs: the matching prefix length (0..128), -1 if no prefix matches
+*
+**************************************************/
+int prefixTrieLookup(const PrefixTrie *t, const NetAddrKey *key)
+{
+  const uint8_t *bytes = key->addr;
+  const uint32_t *root = t->v6Root;
+  int numBytes = 16;
+  uint32_t entry = 0;
+  int best = -1;
+  int i = 0;
+
+  if (memcmp(bytes, v4MappedPrefix, sizeof(v4MappedPrefix)) == 0) {
+    bytes += 12;
+    root = t->v4Root;
+    numBytes = 4;
+  }
+
+  entry = root[((uint32_t)bytes[0] << 8) | bytes[1]];
+  best = (int)(entry >> PREFIX_TRIE_LEN_SHIFT) - 1;
+  for (i = 2; (i < numBytes) && (entry & PREFIX_TRIE_CHILD_MASK); i++) {
+    entry = t->nodes[entry & PREFIX_TRIE_CHILD_MASK][bytes[i]];
+    if (entry >> PREFIX_TRIE_LEN_SHIFT)
+      best = (int)(entry >> PREFIX_TRIE_LEN_SHIFT) - 1;
+  }
+  return best;
+}
+
+/***********************************************************
+* Function: size_t prefixTrieSize(const PrefixTrie *t)
+*
+* Explanation: bytes allocated, the two roots plus the node array
+*
+**************************************************/
+size_t prefixTrieSize(const PrefixTrie *t)
+{
+  return sizeof(PrefixTrie) + (size_t)t->maxNodes * sizeof(t->nodes[0]);
+}
+
+//Hands out a zeroed node, growing the node array when needed.
+//Returns 0 when out of memory or nodes
+static uint32_t newNode(PrefixTrie *t)
+{
+  if (t->numNodes == t->maxNodes) {
+    uint32_t maxNodes = t->maxNodes * 2;
+    void *nodes = NULL;
+
+    if (maxNodes > PREFIX_TRIE_MAX_NODES)
+      maxNodes = PREFIX_TRIE_MAX_NODES;
+    if (maxNodes == t->maxNodes)
+      return 0;
+    nodes = realloc(t->nodes, (size_t)maxNodes * sizeof(t->nodes[0]));
+    if (nodes == NULL)
+      return 0;
+    t->nodes = nodes;
+    memset(t->nodes[t->maxNodes], 0, (size_t)(maxNodes - t->maxNodes) * sizeof(t->nodes[0]));
+    t->maxNodes = maxNodes;
+  }
+  return t->numNodes++;
+}
+
+//Prefix expansion:  marks count entries from first as covered by a
+//prefix, unless a longer prefix already covers them
+static void expandPrefix(uint32_t *table, uint32_t first, uint32_t count, uint32_t value)
+{
+  uint32_t i = 0;
+
+  for (i = first; i < first + count; i++) {
+    if ((table[i] >> PREFIX_TRIE_LEN_SHIFT) < (value >> PREFIX_TRIE_LEN_SHIFT))
+      table[i] = (table[i] & PREFIX_TRIE_CHILD_MASK) | value;
+  }
+}
+
+//Adds the first bits of bytes below root.  The entries get prefixLen,
+//which for the IPv4 trie is the 128 bit (v4-mapped) length
+static int insertBits(PrefixTrie *t, uint32_t *root, const uint8_t *bytes, int bits, int prefixLen)
+{
+  uint32_t value = (uint32_t)(prefixLen + 1) << PREFIX_TRIE_LEN_SHIFT;
+  uint32_t index = ((uint32_t)bytes[0] << 8) | bytes[1];
+  uint32_t node = 0;
+  uint32_t next = 0;
+  int consumed = PREFIX_TRIE_ROOT_BITS;
+
+  if (bits <= PREFIX_TRIE_ROOT_BITS) {
+    uint32_t span = 1U << (PREFIX_TRIE_ROOT_BITS - bits);
+    expandPrefix(root, index & ~(span - 1), span, value);
+    return NOERROR;
+  }
+
+  node = root[index] & PREFIX_TRIE_CHILD_MASK;
+  if (node == 0) {
+    if ((node = newNode(t)) == 0)
+      return ERROR;
+    root[index] |= node;
+  }
+
+  for (;;) {
+    uint32_t b = bytes[consumed / 8];
+    int remaining = bits - consumed;
+
+    if (remaining <= 8) {
+      uint32_t span = 1U << (8 - remaining);
+      expandPrefix(t->nodes[node], b & ~(span - 1), span, value);
+      return NOERROR;
+    }
+    //newNode may move t->nodes, so look the entry up again after it
+    next = t->nodes[node][b] & PREFIX_TRIE_CHILD_MASK;
+    if (next == 0) {
+      if ((next = newNode(t)) == 0)
+        return ERROR;
+      t->nodes[node][b] |= next;
+    }
+    node = next;
+    consumed += 8;
+  }
+}
+
+//True if addr/prefixLen holds all of other/otherLen
+static bool prefixCovers(const uint8_t *addr, int prefixLen, const uint8_t *other, int otherLen)
+{
+  int i = 0;
+
+  if (prefixLen > otherLen)
+    return false;
+  for (i = 0; i < prefixLen; i++) {
+    uint8_t bit = (uint8_t)(0x80 >> (i % 8));
+    if ((addr[i / 8] & bit) != (other[i / 8] & bit))
+      return false;
+  }
+  return true;
+}
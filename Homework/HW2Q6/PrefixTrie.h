@@ -0,0 +1,69 @@
+/************************************************************************
+* File:  PrefixTrie.h
+*
+* Purpose:
+*   A longest prefix match table of IPv4 and IPv6 CIDR prefixes, used
+*   for the server's whitelist.   Addresses are the v4-mapped 16 byte
+*   NetAddrKey addresses, prefix lengths count over all 128 bits (see
+*   parseAddrPrefix).
+*
+* Notes:
+*   A multibit trie with controlled prefix expansion.  IPv4 and IPv6 each
+*   have a 2^16 entry root indexed by the first 16 bits (of the IPv4
+*   address for v4-mapped keys), below that every node is 256 entries
+*   indexed by the next byte.   An entry holds its child node and the
+*   length of the longest prefix covering it, so a lookup is at most 3
+*   (IPv4) or 15 (IPv6) array reads however many prefixes are loaded.
+*
+*   A trie is built by one thread and is read only once it is published,
+*   so any number of threads can look up in it without locks.  The server
+*   swaps in a new trie on a reload, see whitelistReloadThread.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__PrefixTrie_h
+#define	__PrefixTrie_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "AddressHelper.h"
+
+#define PREFIX_TRIE_ROOT_BITS 16
+#define PREFIX_TRIE_ROOT_SIZE (1 << PREFIX_TRIE_ROOT_BITS)
+#define PREFIX_TRIE_NODE_SIZE 256
+
+//entry:  (longest covering prefix length + 1) << 24 | child node, 0 is empty
+#define PREFIX_TRIE_CHILD_MASK 0x00ffffffU
+#define PREFIX_TRIE_LEN_SHIFT 24
+#define PREFIX_TRIE_MAX_NODES PREFIX_TRIE_CHILD_MASK
+
+typedef struct {
+  uint32_t v4Root[PREFIX_TRIE_ROOT_SIZE];
+  uint32_t v6Root[PREFIX_TRIE_ROOT_SIZE];
+
+  //node 0 is never used, so a child of 0 means none
+  uint32_t (*nodes)[PREFIX_TRIE_NODE_SIZE];
+  uint32_t numNodes;
+  uint32_t maxNodes;
+
+  uint32_t v4Prefixes;
+  uint32_t v6Prefixes;
+} PrefixTrie;
+
+PrefixTrie *prefixTrieCreate(void);
+void prefixTrieFree(PrefixTrie *t);
+
+//addr is v4-mapped, prefixLen 0..128 (see parseAddrPrefix).  ERROR or NOERROR
+int prefixTrieInsert(PrefixTrie *t, const uint8_t *addr, int prefixLen);
+
+//Length (0..128) of the longest prefix holding key's address, -1 if none
+int prefixTrieLookup(const PrefixTrie *t, const NetAddrKey *key);
+
+//Bytes allocated for the trie
+size_t prefixTrieSize(const PrefixTrie *t);
+
+#endif
+
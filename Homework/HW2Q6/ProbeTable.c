@@ -0,0 +1,148 @@
+/*********************************************************
+*
+* Module Name: ProbeTable
+*
+* File Name:  ProbeTable.c
+*
+* Summary:  The client's in-flight probe table for the pipelined RTT
+*           mode.  See ProbeTable.h
+*
+* Revisions:
+*   10/17/26: stale replies (slot reused) are no longer counted as late
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "ProbeTable.h"
+
+static void probeTimedOut(WheelTimer *timer, void *arg);
+
+
+int probeTableInit(ProbeTable *t, uint32_t window, double timeout, double now)
+{
+  uint32_t size = 1;
+
+  memset(t, 0, sizeof(ProbeTable));
+  if (window < 1)
+    window = 1;
+  if (window > PROBE_TABLE_MAX_WINDOW)
+    window = PROBE_TABLE_MAX_WINDOW;
+  while ((size < window * PROBE_TABLE_SLOTS_PER_WINDOW) || (size < PROBE_TABLE_MIN_SLOTS))
+    size <<= 1;
+
+  t->slots = calloc(size, sizeof(ProbeSlot));
+  if (t->slots == NULL)
+    return ERROR;
+  t->size = size;
+  t->mask = size - 1;
+  t->window = window;
+  t->timeout = timeout;
+  timingWheelInit(&t->wheel, PROBE_TABLE_TICK_NS, (uint64_t)(now * 1e9));
+  return NOERROR;
+}
+
+void probeTableFree(ProbeTable *t)
+{
+  free(t->slots);
+  t->slots = NULL;
+}
+
+/***********************************************************
+* Function: void probeTableSent(ProbeTable *t, uint32_t seq, double sendTime)
+*
+* Explanation: Takes seq's slot.  A probe size sequence numbers back
+*              that still holds it is timed out early, so the table
+*              covers at least size / (probe rate) seconds of timeout.
+*              Starts the probe's timer.
+*
+**************************************************/
+void probeTableSent(ProbeTable *t, uint32_t seq, double sendTime)
+{
+  ProbeSlot *slot = &t->slots[seq & t->mask];
+
+  if (slot->state == PROBE_OUTSTANDING) {
+    timingWheelCancel(&t->wheel, &slot->timer);
+    slot->state = PROBE_TIMED_OUT;
+    t->outstanding--;
+    t->timedOut++;
+  }
+  slot->seq = seq;
+  slot->sendTime = sendTime;
+  slot->state = PROBE_OUTSTANDING;
+  timingWheelAdd(&t->wheel, &slot->timer, (uint64_t)((sendTime + t->timeout) * 1e9));
+  t->outstanding++;
+  t->sent++;
+  t->nextSeq = seq + 1;
+}
+
+/***********************************************************
+* Function: int probeTableReply(ProbeTable *t, uint32_t seq, double rxTime, double *RTT)
+*
+* Explanation: Matches a reply by its echoed sequence number.  A slot
+*              holding a newer probe means seq is older than the table
+*              remembers:  stale, as it may be the late reply or a
+*              duplicate of one already counted.  Only a timed out
+*              probe's first reply is late, so late <= timedOut.
+*
+* outputs: PROBE_REPLY_ANSWERED (and *RTT), PROBE_REPLY_LATE,
+*          PROBE_REPLY_DUPLICATE, PROBE_REPLY_STALE or
+*          PROBE_REPLY_UNEXPECTED
+*
+**************************************************/
+int probeTableReply(ProbeTable *t, uint32_t seq, double rxTime, double *RTT)
+{
+  ProbeSlot *slot = &t->slots[seq & t->mask];
+
+  if ((t->sent == 0) || (seq >= t->nextSeq) || (slot->state == PROBE_FREE) || (slot->seq < seq)) {
+    t->unexpected++;
+    return PROBE_REPLY_UNEXPECTED;
+  }
+  if (slot->seq != seq) {
+    t->stale++;
+    return PROBE_REPLY_STALE;
+  }
+
+  switch (slot->state) {
+  case PROBE_OUTSTANDING:
+    timingWheelCancel(&t->wheel, &slot->timer);
+    slot->state = PROBE_ANSWERED;
+    t->outstanding--;
+    t->answered++;
+    *RTT = rxTime - slot->sendTime;
+    return PROBE_REPLY_ANSWERED;
+  case PROBE_TIMED_OUT:
+    //Counted once, a duplicate of a late reply is a duplicate
+    slot->state = PROBE_ANSWERED;
+    t->late++;
+    return PROBE_REPLY_LATE;
+  default:
+    t->duplicates++;
+    return PROBE_REPLY_DUPLICATE;
+  }
+}
+
+uint32_t probeTableExpire(ProbeTable *t, double now)
+{
+  return timingWheelAdvance(&t->wheel, (uint64_t)(now * 1e9), probeTimedOut, t);
+}
+
+double probeTableNextExpiry(const ProbeTable *t)
+{
+  uint64_t next = timingWheelNextEvent(&t->wheel);
+
+  if (next == UINT64_MAX)
+    return -1.0;
+  return (double)next / 1e9;
+}
+
+//Wheel callback:  the probe owning timer was not answered in time
+static void probeTimedOut(WheelTimer *timer, void *arg)
+{
+  ProbeTable *t = (ProbeTable *)arg;
+  ProbeSlot *slot = (ProbeSlot *)timer;
+
+  slot->state = PROBE_TIMED_OUT;
+  t->outstanding--;
+  t->timedOut++;
+}
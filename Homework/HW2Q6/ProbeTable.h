@@ -0,0 +1,119 @@
+/************************************************************************
+* File:  ProbeTable.h
+*
+* Purpose:
+*   The client's in-flight table for the pipelined RTT mode (-W):  up
+*   to window probes are outstanding at once, each reply is matched to
+*   its probe by the echoed sequence number.  Replies are classified as
+*   answered (an RTT sample), late (after the probe timed out),
+*   duplicate (the probe was already answered), stale (the probe's slot
+*   holds a newer one, so it can not tell late from duplicate) or
+*   unexpected (a sequence number that was never sent).
+*
+* Notes:
+*   Slots are indexed by sequence number & mask.  The table is at least
+*   PROBE_TABLE_SLOTS_PER_WINDOW times the window (and PROBE_TABLE_MIN_SLOTS),
+*   so a timed out probe's slot stays readable for a while and its late
+*   reply is still recognized.  A probe whose slot is needed again while
+*   it is still outstanding is timed out early.
+*
+*   Each outstanding probe has a timer in a hierarchical timing wheel
+*   (TimingWheel.h):  starting, cancelling (on the reply) and firing it
+*   are O(1), thousands of probes in flight cost no more per probe than
+*   one.  probeTableExpire advances the wheel, the caller's event loop
+*   sleeps until probeTableNextExpiry.
+*
+*   Times are getTimestampD() (CLOCK_MONOTONIC_RAW) seconds.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: timeouts on a timing wheel, the table owns the timeout
+* A3: 10/17/26: stale replies counted apart from late ones, probeTableLost
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__ProbeTable_h
+#define	__ProbeTable_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "TimingWheel.h"
+
+#define PROBE_TABLE_MAX_WINDOW 65536
+#define PROBE_TABLE_SLOTS_PER_WINDOW 4
+#define PROBE_TABLE_MIN_SLOTS 65536
+#define PROBE_TABLE_TICK_NS 1000000   // timeout resolution
+
+//Slot states
+#define PROBE_FREE 0
+#define PROBE_OUTSTANDING 1
+#define PROBE_ANSWERED 2
+#define PROBE_TIMED_OUT 3
+
+//probeTableReply outcomes
+#define PROBE_REPLY_ANSWERED 0
+#define PROBE_REPLY_LATE 1
+#define PROBE_REPLY_DUPLICATE 2
+#define PROBE_REPLY_UNEXPECTED 3
+#define PROBE_REPLY_STALE 4
+
+typedef struct {
+  WheelTimer timer;       // first:  the wheel hands it back
+  double sendTime;
+  uint32_t seq;
+  uint32_t state;
+} ProbeSlot;
+
+typedef struct {
+  ProbeSlot *slots;
+  uint32_t size;          // a power of 2
+  uint32_t mask;
+  uint32_t window;        // most probes outstanding at once
+  uint32_t outstanding;
+  uint32_t nextSeq;       // one past the highest sequence number sent
+
+  uint64_t sent;
+  uint64_t answered;
+  uint64_t late;          // answered after timing out, once per probe
+  uint64_t duplicates;
+  uint64_t stale;         // the slot was reused:  late or duplicate
+  uint64_t unexpected;
+  uint64_t timedOut;      // lost = timedOut - late, see probeTableLost
+  uint64_t windowFull;    // sends held back by a full window
+
+  double timeout;
+  TimingWheel wheel;      // one timer per outstanding probe
+} ProbeTable;
+
+//window is clamped to 1..PROBE_TABLE_MAX_WINDOW, a probe not answered
+//within timeout seconds times out.  now starts the wheel.  ERROR or NOERROR
+int probeTableInit(ProbeTable *t, uint32_t window, double timeout, double now);
+void probeTableFree(ProbeTable *t);
+
+//true if count more probes fit in the window
+static inline bool probeTableHasRoom(const ProbeTable *t, uint32_t count)
+{
+  return t->outstanding + count <= t->window;
+}
+
+//A probe went out at sendTime
+void probeTableSent(ProbeTable *t, uint32_t seq, double sendTime);
+
+//A reply to seq arrived at rxTime.  PROBE_REPLY_ANSWERED sets *RTT
+int probeTableReply(ProbeTable *t, uint32_t seq, double rxTime, double *RTT);
+
+//The probes that timed out and were never answered.  A stale reply's
+//probe is among them, whether or not it was really lost
+static inline uint64_t probeTableLost(const ProbeTable *t)
+{
+  return (t->timedOut > t->late) ? t->timedOut - t->late : 0;
+}
+
+//Times out the probes sent more than timeout before now, returns how many
+uint32_t probeTableExpire(ProbeTable *t, double now);
+
+//When probeTableExpire next may time a probe out (at most a tick
+//early), a negative value if no probe is outstanding
+double probeTableNextExpiry(const ProbeTable *t);
+
+#endif
@@ -0,0 +1,115 @@
+/*********************************************************
+*
+* Module Name: ReplayWindow
+*
+* File Name:  ReplayWindow.c
+*
+* Summary:  Sliding window anti-replay bitmap.  See ReplayWindow.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "ReplayWindow.h"
+
+#define REPLAY_WORD_BITS 64
+
+
+/***********************************************************
+* Function: void replayWindowParams(uint32_t requested, ReplayWindowParams *p)
+*
+* Explanation: the smallest power of 2 number of bitmap words whose
+*              window (all words but one) holds requested packets.
+*              requested is clamped to REPLAY_WINDOW_MIN..REPLAY_WINDOW_MAX
+*
+**************************************************/
+void replayWindowParams(uint32_t requested, ReplayWindowParams *p)
+{
+  uint32_t words = 2;
+
+  if (requested < REPLAY_WINDOW_MIN)
+    requested = REPLAY_WINDOW_MIN;
+  if (requested > REPLAY_WINDOW_MAX)
+    requested = REPLAY_WINDOW_MAX;
+  while ((words - 1) * REPLAY_WORD_BITS < requested)
+    words <<= 1;
+  p->words = words;
+  p->size = (words - 1) * REPLAY_WORD_BITS;
+}
+
+/***********************************************************
+* Function: int replayWindowUpdate(const ReplayWindowParams *p, uint64_t *bits,
+*                                  uint32_t *top, uint32_t seq)
+*
+* Explanation: A sequence number above *top clears the bitmap words
+*              between the old and the new top (the ones that now stand
+*              for sequence numbers not seen yet) and becomes the top.
+*              Below it, the sequence number's bit says if it was seen.
+*
+* outputs: REPLAY_NEW, REPLAY_LATE, REPLAY_DUPLICATE or REPLAY_TOO_OLD.
+*          The bit is only set for REPLAY_NEW and REPLAY_LATE.
+*
+**************************************************/
+int replayWindowUpdate(const ReplayWindowParams *p, uint64_t *bits, uint32_t *top, uint32_t seq)
+{
+  uint32_t mask = p->words - 1;
+  uint32_t word = seq / REPLAY_WORD_BITS;
+  uint64_t bit = 1ULL << (seq % REPLAY_WORD_BITS);
+
+  if (seq > *top) {
+    uint32_t topWord = *top / REPLAY_WORD_BITS;
+    uint32_t slide = word - topWord;
+    uint32_t i = 0;
+
+    if (slide > p->words)
+      slide = p->words;
+    for (i = 1; i <= slide; i++)
+      bits[(topWord + i) & mask] = 0;
+    bits[word & mask] |= bit;
+    *top = seq;
+    return REPLAY_NEW;
+  }
+
+  if (*top - seq >= p->size)
+    return REPLAY_TOO_OLD;
+  if (bits[word & mask] & bit)
+    return REPLAY_DUPLICATE;
+  bits[word & mask] |= bit;
+  return REPLAY_LATE;
+}
+
+/***********************************************************
+* Function: uint32_t replayWindowCountAbove(const ReplayWindowParams *p,
+*                                           const uint64_t *bits, uint32_t top, uint32_t seq)
+*
+* Explanation: For a late arrival this is how many packets with a larger
+*              sequence number got here first, i.e. its RFC 4737
+*              reordering extent (less any other late arrivals in
+*              between, which the bitmap can not tell apart).
+*              seq must be inside the window.
+*
+**************************************************/
+uint32_t replayWindowCountAbove(const ReplayWindowParams *p, const uint64_t *bits, uint32_t top, uint32_t seq)
+{
+  uint32_t mask = p->words - 1;
+  uint32_t word = seq / REPLAY_WORD_BITS;
+  uint32_t topWord = top / REPLAY_WORD_BITS;
+  uint32_t topBit = top % REPLAY_WORD_BITS;
+  //bits above seq in its word:  shifted in two steps, seq % 64 may be 63
+  uint64_t wanted = (~0ULL << (seq % REPLAY_WORD_BITS)) << 1;
+  uint32_t count = 0;
+
+  for (;;) {
+    uint64_t b = bits[word & mask] & wanted;
+    if (word == topWord) {
+      if (topBit < REPLAY_WORD_BITS - 1)
+        b &= (1ULL << (topBit + 1)) - 1;
+      return count + (uint32_t)__builtin_popcountll(b);
+    }
+    count += (uint32_t)__builtin_popcountll(b);
+    wanted = ~0ULL;
+    word++;
+  }
+}
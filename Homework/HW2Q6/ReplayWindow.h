@@ -0,0 +1,58 @@
+/************************************************************************
+* File:  ReplayWindow.h
+*
+* Purpose:
+*   IPsec style sliding window anti-replay check (RFC 4303 3.4.3, with
+*   the ring of bitmap words of RFC 6479).  A packet ahead of the highest
+*   sequence number seen slides the window forward; a packet behind it is
+*   accepted once if it is still inside the window, so network reordering
+*   is no longer mistaken for a replay.
+*
+* Notes:
+*   The caller owns the state - the highest sequence number and
+*   ReplayWindowParams.words bitmap words per flow - and serializes the
+*   calls for one flow (the server holds the client's shard lock).
+*   Sliding forward clears the words passed over, at most words of them,
+*   so every check is O(1).
+*
+*   The window covers (words - 1) * 64 packets, one word is the slack
+*   that lets the ring slide a word at a time.  replayWindowParams picks
+*   the smallest power of 2 words that covers the requested size.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__ReplayWindow_h
+#define	__ReplayWindow_h
+
+#include <stdint.h>
+
+#define REPLAY_WINDOW_DEFAULT 960  // packets, 16 words (128 bytes) per flow
+#define REPLAY_WINDOW_MIN 64
+#define REPLAY_WINDOW_MAX 16320    // 256 words (2KB) per flow
+
+//What replayWindowUpdate made of a sequence number
+#define REPLAY_NEW 0        // above the highest seen, the window slid forward
+#define REPLAY_LATE 1       // behind the highest, not seen before: reordered
+#define REPLAY_DUPLICATE 2  // seen before
+#define REPLAY_TOO_OLD 3    // behind the window, can not tell
+
+typedef struct {
+  uint32_t size;    // packets accepted behind the highest sequence number
+  uint32_t words;   // bitmap words per flow, a power of 2
+} ReplayWindowParams;
+
+//Rounds requested (packets) up to a whole power of 2 number of words
+void replayWindowParams(uint32_t requested, ReplayWindowParams *p);
+
+//Marks seq as seen unless it is a duplicate or too old, *top is the
+//highest sequence number seen (0 for a new flow, with all bits clear)
+int replayWindowUpdate(const ReplayWindowParams *p, uint64_t *bits, uint32_t *top, uint32_t seq);
+
+//The number of sequence numbers above seq, up to top, marked as seen
+uint32_t replayWindowCountAbove(const ReplayWindowParams *p, const uint64_t *bits, uint32_t top, uint32_t seq);
+
+#endif
+
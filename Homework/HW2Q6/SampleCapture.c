@@ -0,0 +1,504 @@
+/*********************************************************
+*
+* Module Name: SampleCapture
+*
+* File Name:  SampleCapture.c
+*
+* Summary:  Double buffered per worker sample chunks written by a
+*           writer thread to rotating memory-mapped files.
+*           See SampleCapture.h
+*
+* Revisions:
+*   10/17/26: chunks hold delta + zig-zag + bit-packed groups
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "SampleCapture.h"
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define SAMPLE_NAME_SIZE 512
+
+typedef unsigned __int128 BitBuffer;
+
+typedef struct {
+  char base[SAMPLE_NAME_SIZE];
+  size_t fileBytes;
+  int fd;
+  uint8_t *map;
+  size_t used;
+  uint32_t fileIndex;
+  uint32_t files;
+  uint64_t written;
+  uint64_t writtenBytes;
+} SampleFile;
+
+static SampleProducer *producers = NULL;
+static uint32_t numProducers = 0;
+static SampleFile sampleFile;
+static pthread_t writerThread;
+static bool writerRunning = false;
+static uint32_t stopWriter = 0;
+
+static void *sampleWriterThread(void *arg);
+static uint32_t writeFullChunks(bool giveBack);
+static void writeBlock(uint32_t producer, const uint8_t *data, uint32_t bytes, uint32_t count);
+static uint32_t packGroup(uint8_t *out, const SampleRecord *records, uint32_t n, SampleRecord *prev);
+static uint32_t packColumn(uint8_t *out, const uint64_t *values, uint32_t n, uint32_t width);
+static const uint8_t *unpackColumn(const uint8_t *in, const uint8_t *end, uint64_t *values, uint32_t n, uint32_t width);
+static uint64_t zigzag(int64_t v);
+static int64_t unzigzag(uint64_t v);
+static int openSampleFile(SampleFile *f);
+static void closeSampleFile(SampleFile *f);
+static uint64_t wallClockNs(void);
+
+
+/***********************************************************
+* Function: int sampleCaptureInit(const char *base, uint32_t numProducers, uint32_t fileMB)
+*
+* Explanation: allocates a producer per receive worker, opens the first
+*              file and starts the writer thread
+*
+* outputs: returns ERROR or NOERROR
+*
+**************************************************/
+int sampleCaptureInit(const char *base, uint32_t producerCount, uint32_t fileMB)
+{
+  uint32_t i = 0;
+
+  if ((producerCount == 0) || (producerCount > SAMPLE_MAX_PRODUCERS))
+    return ERROR;
+  if (fileMB < SAMPLE_MIN_FILE_MB)
+    fileMB = SAMPLE_MIN_FILE_MB;
+
+  producers = aligned_alloc(64, producerCount * sizeof(SampleProducer));
+  if (producers == NULL)
+    return ERROR;
+  memset(producers, 0, producerCount * sizeof(SampleProducer));
+  for (i = 0; i < producerCount; i++)
+    producers[i].id = i;
+  numProducers = producerCount;
+
+  memset(&sampleFile, 0, sizeof(SampleFile));
+  snprintf(sampleFile.base, sizeof(sampleFile.base), "%s", base);
+  sampleFile.fileBytes = (size_t)fileMB << 20;
+  sampleFile.fd = -1;
+  if (openSampleFile(&sampleFile) == ERROR)
+    return ERROR;
+
+  if (pthread_create(&writerThread, NULL, sampleWriterThread, NULL) != 0) {
+    closeSampleFile(&sampleFile);
+    return ERROR;
+  }
+  writerRunning = true;
+  return NOERROR;
+}
+
+/***********************************************************
+* Function: SampleProducer *sampleCaptureProducer(uint32_t id)
+*
+* Explanation: the producer of receive worker id, NULL if there is none
+*
+**************************************************/
+SampleProducer *sampleCaptureProducer(uint32_t id)
+{
+  if (id >= numProducers)
+    return NULL;
+  return &producers[id];
+}
+
+/***********************************************************
+* Function: void sampleCapturePack(SampleProducer *p)
+*
+* Explanation: Packs the pending records as one group into the active
+*              chunk (which starts with its first record raw).  The
+*              chunk goes to the writer, and the producer to its other
+*              chunk, when another group might not fit or the chunk's
+*              first sample is older than SAMPLE_CHUNK_MAX_AGE_NS.  If
+*              the writer still has the active chunk the group is dropped.
+*
+**************************************************/
+void sampleCapturePack(SampleProducer *p)
+{
+  SampleChunk *c = &p->chunks[p->active];
+  uint32_t n = p->pendingCount;
+  uint32_t used = 0;
+
+  //The writer resets used and count before it gives the chunk back
+  if (__atomic_load_n(&c->full, __ATOMIC_ACQUIRE)) {
+    p->dropped += n;
+  } else {
+    if (c->count == 0) {
+      memcpy(c->data, &p->pending[0], sizeof(SampleRecord));
+      c->prev = p->pending[0];
+      c->firstNs = p->pending[0].rxTimeNs;
+      c->used = sizeof(SampleRecord);
+    }
+    used = c->used + packGroup(c->data + c->used, p->pending, n, &c->prev);
+    __atomic_store_n(&c->used, used, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->count, c->count + n, __ATOMIC_RELEASE);
+    if ((SAMPLE_CHUNK_BYTES - used < SAMPLE_GROUP_MAX_BYTES) ||
+        ((int64_t)(c->prev.rxTimeNs - c->firstNs) > (int64_t)SAMPLE_CHUNK_MAX_AGE_NS)) {
+      __atomic_store_n(&c->full, 1, __ATOMIC_RELEASE);
+      p->active ^= 1;
+    }
+  }
+  __atomic_store_n(&p->packs, p->packs + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&p->pendingCount, 0, __ATOMIC_RELEASE);
+}
+
+/***********************************************************
+* Function: void sampleCaptureClose(void)
+*
+* Explanation: Stops the writer once it has written the full chunks,
+*              then writes what the producers have collected so far:  the
+*              chunks (kept full, so a producer still receiving drops
+*              from now on) and the pending groups.  A pending group that
+*              changes while it is copied is left out.
+*
+**************************************************/
+void sampleCaptureClose(void)
+{
+  static uint8_t tail[sizeof(SampleRecord) + SAMPLE_GROUP_MAX_BYTES];
+  SampleRecord pending[SAMPLE_GROUP_RECORDS];
+  uint32_t i = 0;
+  uint32_t k = 0;
+
+  if (!writerRunning)
+    return;
+  __atomic_store_n(&stopWriter, 1, __ATOMIC_RELEASE);
+  pthread_join(writerThread, NULL);
+  writerRunning = false;
+
+  writeFullChunks(false);
+  for (i = 0; i < numProducers; i++) {
+    SampleProducer *p = &producers[i];
+    uint32_t packs = __atomic_load_n(&p->packs, __ATOMIC_ACQUIRE);
+    uint32_t n = __atomic_load_n(&p->pendingCount, __ATOMIC_ACQUIRE);
+    SampleRecord prev;
+
+    //older chunk first, only the part packed so far
+    for (k = 0; k < 2; k++) {
+      SampleChunk *c = &p->chunks[(p->active + 1 + k) & 1];
+      uint32_t count = __atomic_load_n(&c->count, __ATOMIC_ACQUIRE);
+      uint32_t used = __atomic_load_n(&c->used, __ATOMIC_RELAXED);
+      if (!__atomic_load_n(&c->full, __ATOMIC_ACQUIRE) && (count > 0))
+        writeBlock(p->id, c->data, used, count);
+      __atomic_store_n(&c->full, 1, __ATOMIC_RELEASE);
+    }
+
+    if (n == 0)
+      continue;
+    memcpy(pending, p->pending, n * sizeof(SampleRecord));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&p->packs, __ATOMIC_ACQUIRE) != packs)
+      continue;
+    memcpy(tail, &pending[0], sizeof(SampleRecord));
+    prev = pending[0];
+    writeBlock(p->id, tail, sizeof(SampleRecord) + packGroup(tail + sizeof(SampleRecord), pending, n, &prev), n);
+  }
+  closeSampleFile(&sampleFile);
+}
+
+/***********************************************************
+* Function: void sampleCaptureGetStats(SampleCaptureStats *stats)
+*
+* Explanation: sums the producers' counters, the written and file counts
+*              are final after sampleCaptureClose
+*
+**************************************************/
+void sampleCaptureGetStats(SampleCaptureStats *stats)
+{
+  uint32_t i = 0;
+
+  memset(stats, 0, sizeof(SampleCaptureStats));
+  for (i = 0; i < numProducers; i++) {
+    stats->captured += producers[i].captured;
+    stats->dropped += producers[i].dropped;
+  }
+  stats->written = sampleFile.written;
+  stats->writtenBytes = sampleFile.writtenBytes;
+  stats->files = sampleFile.files;
+}
+
+//Writes the chunks handed over until told to stop, sleeping when there
+//are none
+static void *sampleWriterThread(void *arg)
+{
+  struct timespec idle = {0, SAMPLE_WRITER_IDLE_NS};
+
+  for (;;) {
+    if (writeFullChunks(true) > 0)
+      continue;
+    if (__atomic_load_n(&stopWriter, __ATOMIC_ACQUIRE))
+      break;
+    nanosleep(&idle, NULL);
+  }
+  return NULL;
+}
+
+//Writes every full chunk, and gives it back to its producer if
+//giveBack.  Returns how many
+static uint32_t writeFullChunks(bool giveBack)
+{
+  uint32_t chunks = 0;
+  uint32_t i = 0;
+  uint32_t k = 0;
+
+  for (i = 0; i < numProducers; i++) {
+    SampleProducer *p = &producers[i];
+    for (k = 0; k < 2; k++) {
+      SampleChunk *c = &p->chunks[k];
+      if (!__atomic_load_n(&c->full, __ATOMIC_ACQUIRE))
+        continue;
+      writeBlock(p->id, c->data, c->used, c->count);
+      chunks++;
+      if (!giveBack)
+        continue;
+      c->used = 0;
+      c->count = 0;
+      __atomic_store_n(&c->full, 0, __ATOMIC_RELEASE);
+    }
+  }
+  return chunks;
+}
+
+//Appends one block of chunk bytes.  Rotates to the next file when the
+//block does not fit; samples are dropped (counted as not written) if no
+//file can be opened
+static void writeBlock(uint32_t producer, const uint8_t *data, uint32_t bytes, uint32_t count)
+{
+  SampleFile *f = &sampleFile;
+  size_t blockBytes = sizeof(SampleBlockHeader) + (((size_t)bytes + 7) & ~(size_t)7);
+  SampleFileHeader *header = NULL;
+  SampleBlockHeader *block = NULL;
+
+  if ((f->map != NULL) && (f->used + blockBytes > f->fileBytes) && (f->used > sizeof(SampleFileHeader))) {
+    closeSampleFile(f);
+    f->fileIndex++;
+    openSampleFile(f);
+  }
+  if ((f->map == NULL) || (f->used + blockBytes > f->fileBytes))
+    return;
+
+  block = (SampleBlockHeader *)(f->map + f->used);
+  memcpy(block + 1, data, bytes);
+  block->count = count;
+  block->producer = producer;
+  block->bytes = bytes;
+  block->magic = SAMPLE_BLOCK_MAGIC;
+
+  f->used += blockBytes;
+  f->written += count;
+  f->writtenBytes += bytes;
+  header = (SampleFileHeader *)f->map;
+  header->dataBytes = f->used - sizeof(SampleFileHeader);
+  header->numRecords += count;
+  header->numBlocks++;
+}
+
+//Creates <base>.NNNN.bin at its full size and maps it, the pages are
+//only allocated as blocks are written
+static int openSampleFile(SampleFile *f)
+{
+  char path[SAMPLE_NAME_SIZE + 16];
+  SampleFileHeader *header = NULL;
+
+  snprintf(path, sizeof(path), "%s.%04u.bin", f->base, f->fileIndex);
+  f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (f->fd < 0) {
+    perror("server: sample capture open");
+    return ERROR;
+  }
+  if (ftruncate(f->fd, (off_t)f->fileBytes) < 0) {
+    perror("server: sample capture ftruncate");
+    close(f->fd);
+    f->fd = -1;
+    return ERROR;
+  }
+  f->map = mmap(NULL, f->fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
+  if (f->map == MAP_FAILED) {
+    perror("server: sample capture mmap");
+    f->map = NULL;
+    close(f->fd);
+    f->fd = -1;
+    return ERROR;
+  }
+
+  header = (SampleFileHeader *)f->map;
+  header->magic = SAMPLE_FILE_MAGIC;
+  header->version = SAMPLE_FILE_VERSION;
+  header->headerSize = sizeof(SampleFileHeader);
+  header->fileIndex = f->fileIndex;
+  header->columns = SAMPLE_COLUMNS;
+  header->createdNs = wallClockNs();
+  f->used = sizeof(SampleFileHeader);
+  f->files++;
+  return NOERROR;
+}
+
+//Unmaps the file and cuts it back to the bytes used
+static void closeSampleFile(SampleFile *f)
+{
+  if (f->map != NULL) {
+    munmap(f->map, f->fileBytes);
+    f->map = NULL;
+  }
+  if (f->fd >= 0) {
+    if (ftruncate(f->fd, (off_t)f->used) < 0)
+      perror("server: sample capture ftruncate");
+    close(f->fd);
+    f->fd = -1;
+  }
+}
+
+static uint64_t wallClockNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/***********************************************************
+* Function: int sampleChunkDecode(const uint8_t *data, uint32_t bytes,
+*                                 uint32_t count, SampleRecord *out)
+*
+* Explanation: undoes the bit-packing, zig-zag and delta coding of a
+*              chunk:  its first record, then groups until count records
+*
+* outputs: ERROR if the bytes run out or a group is malformed, else NOERROR
+*
+**************************************************/
+int sampleChunkDecode(const uint8_t *data, uint32_t bytes, uint32_t count, SampleRecord *out)
+{
+  uint64_t columns[SAMPLE_COLUMNS][SAMPLE_GROUP_RECORDS];
+  const uint8_t *end = data + bytes;
+  const uint8_t *pos = data + sizeof(SampleRecord);
+  SampleRecord prev;
+  uint32_t done = 0;
+  uint32_t i = 0;
+  uint32_t k = 0;
+
+  if (bytes < sizeof(SampleRecord))
+    return ERROR;
+  memcpy(&prev, data, sizeof(SampleRecord));
+
+  while (done < count) {
+    const uint8_t *widths = pos + 1;
+    uint32_t n = 0;
+
+    if (end - pos < 1 + SAMPLE_COLUMNS)
+      return ERROR;
+    n = *pos;
+    if ((n == 0) || (n > SAMPLE_GROUP_RECORDS) || (done + n > count))
+      return ERROR;
+    pos += 1 + SAMPLE_COLUMNS;
+    for (k = 0; k < SAMPLE_COLUMNS; k++) {
+      if (widths[k] > 64)
+        return ERROR;
+      pos = unpackColumn(pos, end, columns[k], n, widths[k]);
+      if (pos == NULL)
+        return ERROR;
+    }
+    for (i = 0; i < n; i++) {
+      prev.rxTimeNs += (uint64_t)unzigzag(columns[0][i]);
+      prev.owdNs += unzigzag(columns[1][i]);
+      prev.seq += (uint32_t)unzigzag(columns[2][i]);
+      prev.size += (uint32_t)unzigzag(columns[3][i]);
+      prev.flow += (uint32_t)unzigzag(columns[4][i]);
+      out[done + i] = prev;
+    }
+    done += n;
+  }
+  return NOERROR;
+}
+
+//One group:  its count, the 5 column widths, then the columns of
+//zig-zag deltas from the previous record.  Returns the bytes written
+static uint32_t packGroup(uint8_t *out, const SampleRecord *records, uint32_t n, SampleRecord *prev)
+{
+  uint64_t columns[SAMPLE_COLUMNS][SAMPLE_GROUP_RECORDS];
+  uint64_t widest[SAMPLE_COLUMNS] = {0};
+  uint32_t bytes = 1 + SAMPLE_COLUMNS;
+  uint32_t i = 0;
+  uint32_t k = 0;
+
+  for (i = 0; i < n; i++) {
+    columns[0][i] = zigzag((int64_t)(records[i].rxTimeNs - prev->rxTimeNs));
+    columns[1][i] = zigzag((int64_t)((uint64_t)records[i].owdNs - (uint64_t)prev->owdNs));
+    columns[2][i] = zigzag((int32_t)(records[i].seq - prev->seq));
+    columns[3][i] = zigzag((int32_t)(records[i].size - prev->size));
+    columns[4][i] = zigzag((int32_t)(records[i].flow - prev->flow));
+    for (k = 0; k < SAMPLE_COLUMNS; k++)
+      widest[k] |= columns[k][i];
+    *prev = records[i];
+  }
+
+  out[0] = (uint8_t)n;
+  for (k = 0; k < SAMPLE_COLUMNS; k++) {
+    uint32_t width = (widest[k] == 0) ? 0 : 64 - (uint32_t)__builtin_clzll(widest[k]);
+    out[1 + k] = (uint8_t)width;
+    bytes += packColumn(out + bytes, columns[k], n, width);
+  }
+  return bytes;
+}
+
+//n values of width bits each, least significant bit first
+static uint32_t packColumn(uint8_t *out, const uint64_t *values, uint32_t n, uint32_t width)
+{
+  BitBuffer acc = 0;
+  uint32_t bits = 0;
+  uint32_t bytes = 0;
+  uint32_t i = 0;
+
+  if (width == 0)
+    return 0;
+  for (i = 0; i < n; i++) {
+    acc |= (BitBuffer)values[i] << bits;
+    bits += width;
+    while (bits >= 8) {
+      out[bytes++] = (uint8_t)acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0)
+    out[bytes++] = (uint8_t)acc;
+  return bytes;
+}
+
+//Reverse of packColumn, returns the byte after the column or NULL
+static const uint8_t *unpackColumn(const uint8_t *in, const uint8_t *end, uint64_t *values, uint32_t n, uint32_t width)
+{
+  uint64_t mask = (width == 64) ? ~0ULL : ((1ULL << width) - 1);
+  size_t bytes = ((size_t)n * width + 7) / 8;
+  BitBuffer acc = 0;
+  uint32_t bits = 0;
+  uint32_t i = 0;
+
+  if ((size_t)(end - in) < bytes)
+    return NULL;
+  for (i = 0; i < n; i++) {
+    while (bits < width) {
+      acc |= (BitBuffer)(*in++) << bits;
+      bits += 8;
+    }
+    values[i] = (uint64_t)acc & mask;
+    acc >>= width;
+    bits -= width;
+  }
+  return in;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
@@ -0,0 +1,152 @@
+/************************************************************************
+* File:  SampleCapture.h
+*
+* Purpose:
+*   Continuous capture of the server's per packet samples to binary
+*   files.  The receive path appends a fixed size SampleRecord to its
+*   producer's pending group; every SAMPLE_GROUP_RECORDS records the group
+*   is compressed into the producer's active chunk.  A full chunk is
+*   handed to a writer thread, which stores it as one block in a
+*   memory-mapped file, and the producer carries on in its second chunk.
+*   The files rotate at a size limit, so a run records for as long as it
+*   lasts.
+*
+* Notes:
+*   Each producer (a receive worker) has two chunks, a chunk is either
+*   the producer's or, once full, the writer's.  If the writer has not
+*   given back the other chunk yet the new samples are dropped and
+*   counted, the receive path never waits.  A chunk is also handed over
+*   when its first sample is older than SAMPLE_CHUNK_MAX_AGE_NS, so
+*   slow flows reach the disk too.
+*
+*   Compression:  each column (rxTimeNs, owdNs, seq, size, flow) is
+*   delta coded against the previous record, zig-zag mapped (so small
+*   negative deltas stay small) and bit-packed per group at the width of
+*   the group's largest delta (frame of reference).  A steady flow costs
+*   about 2 bits of seq and 0 bits of size and flow per sample, the
+*   timestamp and OWD deltas take what their jitter needs.  A chunk
+*   starts with its first record raw, so every block decodes on its own.
+*
+*   File layout (host byte order):  a SampleFileHeader, then blocks of a
+*   SampleBlockHeader followed by the chunk's bytes, padded to 8 bytes.
+*   Chunk:  the first SampleRecord, then groups of a count byte, 5 width
+*   bytes and the 5 packed columns, each padded to a byte.  The header
+*   is rewritten after every block, a reader can stop at dataBytes or at
+*   the first block without SAMPLE_BLOCK_MAGIC.  Files are named
+*   <base>.NNNN.bin.   samplesToText turns them back into the text of
+*   the old serverSamplesArray.dat.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: delta + zig-zag + bit-packed chunks (file version 2)
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__SampleCapture_h
+#define	__SampleCapture_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SAMPLE_FILE_MAGIC 0x43534555    // "UESC"
+#define SAMPLE_BLOCK_MAGIC 0x4b4c4253   // "SBLK"
+#define SAMPLE_FILE_VERSION 2
+#define SAMPLE_COLUMNS 5
+
+#define SAMPLE_CHUNK_BYTES (128 * 1024)
+#define SAMPLE_GROUP_RECORDS 128        // records packed at a time, at most 255
+#define SAMPLE_GROUP_MAX_BYTES (1 + SAMPLE_COLUMNS + SAMPLE_COLUMNS * SAMPLE_GROUP_RECORDS * 8)
+#define SAMPLE_CHUNK_MAX_AGE_NS 1000000000ULL
+#define SAMPLE_MAX_PRODUCERS 64
+#define SAMPLE_DEFAULT_FILE_MB 64       // rotation size
+#define SAMPLE_MIN_FILE_MB 1
+#define SAMPLE_WRITER_IDLE_NS 1000000
+
+typedef struct {
+  uint64_t rxTimeNs;    // receive time, CLOCK_REALTIME
+  int64_t owdNs;
+  uint32_t seq;
+  uint32_t size;        // bytes
+  uint32_t flow;        // FlowSession flowId
+} SampleRecord;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t fileIndex;   // rotation number, the NNNN of the name
+  uint32_t columns;
+  uint64_t createdNs;
+  uint64_t dataBytes;   // bytes of blocks after the header
+  uint64_t numRecords;
+  uint32_t numBlocks;
+  uint32_t reserved;
+} SampleFileHeader;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t count;       // records in the block
+  uint32_t producer;
+  uint32_t bytes;       // chunk bytes that follow, before the padding
+} SampleBlockHeader;
+
+typedef struct {
+  uint8_t data[SAMPLE_CHUNK_BYTES];  // first record, then packed groups
+  uint32_t used;        // bytes of data, written by the owner
+  uint32_t count;       // records, released to the writer after used
+  uint32_t full;        // 1 while the writer owns the chunk
+  uint64_t firstNs;
+  SampleRecord prev;    // producer only:  the next delta's base
+} SampleChunk;
+
+typedef struct {
+  SampleChunk chunks[2];
+  SampleRecord pending[SAMPLE_GROUP_RECORDS];
+  uint32_t pendingCount;  // released, so sampleCaptureClose can take them
+  uint32_t packs;         // groups packed, bumped before pending is reused
+  uint32_t active;        // producer only
+  uint32_t id;
+  uint64_t captured;
+  uint64_t dropped;       // both chunks were full
+} __attribute__((aligned(64))) SampleProducer;
+
+typedef struct {
+  uint64_t captured;
+  uint64_t dropped;
+  uint64_t written;
+  uint64_t writtenBytes;  // of the compressed chunks
+  uint32_t files;
+} SampleCaptureStats;
+
+//Starts the writer, the first file is <base>.0000.bin.  ERROR or NOERROR
+int sampleCaptureInit(const char *base, uint32_t numProducers, uint32_t fileMB);
+SampleProducer *sampleCaptureProducer(uint32_t id);
+
+//Compresses the pending group into the active chunk, handing the chunk
+//to the writer when it is full or old.  Called by the producer only
+void sampleCapturePack(SampleProducer *p);
+
+//The receive path:  O(1), a copy into the pending group and every
+//SAMPLE_GROUP_RECORDS records a sampleCapturePack
+static inline void sampleCaptureAppend(SampleProducer *p, const SampleRecord *r)
+{
+  uint32_t n = p->pendingCount;
+
+  p->pending[n] = *r;
+  __atomic_store_n(&p->pendingCount, n + 1, __ATOMIC_RELEASE);
+  p->captured++;
+  if ((n + 1 == SAMPLE_GROUP_RECORDS) ||
+      ((int64_t)(r->rxTimeNs - p->pending[0].rxTimeNs) > (int64_t)SAMPLE_CHUNK_MAX_AGE_NS))
+    sampleCapturePack(p);
+}
+
+//Decodes a block's chunk bytes into out[count].  ERROR if they are bad
+int sampleChunkDecode(const uint8_t *data, uint32_t bytes, uint32_t count, SampleRecord *out);
+
+//Stops the writer and writes out every chunk, including the samples
+//still being collected, then closes the file
+void sampleCaptureClose(void);
+void sampleCaptureGetStats(SampleCaptureStats *stats);
+
+#endif
+
@@ -0,0 +1,46 @@
+/*********************************************************
+*
+* Module Name: StatsRing
+*
+* File Name:  StatsRing.c
+*
+* Summary:  The single producer/single consumer ring between a receive
+*           worker and its stats thread.  See StatsRing.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "StatsRing.h"
+
+
+StatsRing *statsRingCreate(uint32_t records)
+{
+  StatsRing *r = NULL;
+  uint32_t size = STATS_RING_MIN_RECORDS;
+
+  while ((size < records) && (size < STATS_RING_MAX_RECORDS))
+    size <<= 1;
+
+  if (posix_memalign((void **)&r, 64, sizeof(StatsRing)) != 0)
+    return NULL;
+  memset(r, 0, sizeof(StatsRing));
+  r->records = calloc(size, sizeof(StatsRecord));
+  if (r->records == NULL) {
+    free(r);
+    return NULL;
+  }
+  r->size = size;
+  r->mask = size - 1;
+  return r;
+}
+
+void statsRingDestroy(StatsRing *r)
+{
+  if (r == NULL)
+    return;
+  free(r->records);
+  free(r);
+}
@@ -0,0 +1,143 @@
+/************************************************************************
+* File:  StatsRing.h
+*
+* Purpose:
+*   The server's receive/statistics pipeline (-P).  A worker's receive
+*   loop only receives, runs the filters, echoes and pushes one compact
+*   StatsRecord per accepted packet onto its ring; the worker's stats
+*   thread pops the records and does the flow accounting (sequence and
+*   gap tracking, OWD min/max/EWMA and histograms, the sample capture
+*   and the outputFile lines), so none of that delays the next receive.
+*
+* Notes:
+*   One producer (the worker), one consumer (its stats thread), no
+*   locks.  head and tail are on their own cache lines and each side
+*   keeps a cached copy of the other's index, so a push or pop only
+*   touches the other side's line when its copy says the ring is full
+*   (or empty).  A push onto a full ring drops the record and counts it:
+*   the receive path never waits for the stats thread.  A dropped record
+*   is a packet that was echoed but not accounted, its sequence number
+*   shows up as lost.
+*
+*   highWater is the most records that were queued at once, a measure of
+*   how far behind the stats thread got.  The producer's counters are
+*   only written by the producer.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__StatsRing_h
+#define	__StatsRing_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STATS_RING_MIN_RECORDS 1024
+#define STATS_RING_MAX_RECORDS (1 << 24)
+#define STATS_RING_BATCH 256            // records popped before head is published
+#define STATS_RING_IDLE_NS 100000       // consumer poll interval when the ring is empty
+
+#define STATS_RECORD_TERMINATE 0x0001   // the client's terminate signal, counted but not a sample
+
+//What the stats thread needs of an accepted packet
+typedef struct {
+  double rxWallTime;        // (kernel) receive time
+  uint32_t timeSentSeconds; // the client's send time, from the header
+  uint32_t timeSentNanoSeconds;
+  uint32_t seq;
+  uint32_t size;            // bytes
+  uint32_t flowId;          // the session it belongs to, see clientTableLockSession
+  uint32_t entry;           // the client's entry in its shard
+  uint32_t reorderExtent;   // a late arrival's, from the replay window
+  uint32_t lateBy;
+  uint16_t shard;
+  uint16_t opMode;
+  uint16_t flags;
+} StatsRecord;
+
+typedef struct {
+  //Producer
+  uint64_t tail __attribute__((aligned(64)));
+  uint64_t headCache;       // the producer's last look at head
+  uint64_t pushed;
+  uint64_t dropped;         // ring full, the stats thread is behind
+  uint64_t highWater;
+
+  //Consumer
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tailCache;
+
+  uint32_t size __attribute__((aligned(64)));   // a power of 2
+  uint32_t mask;
+  StatsRecord *records;
+} StatsRing;
+
+//A ring of at least records (rounded up to a power of 2 and clamped to
+//STATS_RING_MIN_RECORDS..STATS_RING_MAX_RECORDS), NULL on failure
+StatsRing *statsRingCreate(uint32_t records);
+void statsRingDestroy(StatsRing *r);
+
+/***********************************************************
+* Function: bool statsRingPush(StatsRing *r, const StatsRecord *rec)
+*
+* Explanation: The producer's side.  The cached head may be stale, so
+*              the occupancy it gives is an upper bound:  head is only
+*              reloaded when that bound says the ring is full or would
+*              set a new high water mark.
+*
+* outputs: false (and counted) if the ring was full
+*
+**************************************************/
+static inline bool statsRingPush(StatsRing *r, const StatsRecord *rec)
+{
+  uint64_t tail = r->tail;
+  uint64_t used = tail - r->headCache;
+
+  if (used >= r->size) {
+    r->headCache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    used = tail - r->headCache;
+    if (used >= r->size) {
+      r->dropped++;
+      return false;
+    }
+  }
+  r->records[tail & r->mask] = *rec;
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+  r->pushed++;
+
+  if (used + 1 > r->highWater) {
+    r->headCache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    used = tail - r->headCache;
+    if (used + 1 > r->highWater)
+      r->highWater = used + 1;
+  }
+  return true;
+}
+
+//The consumer's side:  the number of records ready (at most max), which
+//are statsRingAt(r, 0 .. n-1) until statsRingConsume(r, n) hands their
+//slots back to the producer
+static inline uint32_t statsRingAvailable(StatsRing *r, uint32_t max)
+{
+  uint64_t ready = r->tailCache - r->head;
+
+  if (ready == 0) {
+    r->tailCache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    ready = r->tailCache - r->head;
+  }
+  return (ready < max) ? (uint32_t)ready : max;
+}
+
+static inline const StatsRecord *statsRingAt(const StatsRing *r, uint32_t i)
+{
+  return &r->records[(r->head + i) & r->mask];
+}
+
+static inline void statsRingConsume(StatsRing *r, uint32_t n)
+{
+  __atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*********************************************************
+*
+* Module Name: TimingWheel
+*
+* File Name:  TimingWheel.c
+*
+* Summary:  Hierarchical timing wheel.  See TimingWheel.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "TimingWheel.h"
+
+static void place(TimingWheel *w, WheelTimer *timer, uint64_t base);
+static void cascade(TimingWheel *w, uint32_t level, uint64_t tick);
+
+
+void timingWheelInit(TimingWheel *w, uint64_t tickNs, uint64_t nowNs)
+{
+  uint32_t level = 0;
+  uint32_t slot = 0;
+
+  memset(w, 0, sizeof(TimingWheel));
+  w->tickNs = (tickNs > 0) ? tickNs : 1;
+  w->now = nowNs / w->tickNs;
+  for (level = 0; level < TIMING_WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TIMING_WHEEL_SLOTS; slot++) {
+      WheelTimer *head = &w->slots[level][slot];
+      head->next = head;
+      head->prev = head;
+    }
+  }
+}
+
+/***********************************************************
+* Function: void timingWheelAdd(TimingWheel *w, WheelTimer *timer, uint64_t expiryNs)
+*
+* Explanation: An expiry that is already due fires on the next advance,
+*              one past the wheel's span is clamped to it
+*
+**************************************************/
+void timingWheelAdd(TimingWheel *w, WheelTimer *timer, uint64_t expiryNs)
+{
+  uint64_t expiry = expiryNs / w->tickNs;
+
+  timingWheelCancel(w, timer);
+  if (expiry <= w->now)
+    expiry = w->now + 1;
+  if (expiry - w->now >= TIMING_WHEEL_SPAN)
+    expiry = w->now + TIMING_WHEEL_SPAN - 1;
+  timer->expiry = expiry;
+  timer->pending = true;
+  place(w, timer, w->now);
+  w->count++;
+}
+
+/***********************************************************
+* Function: uint32_t timingWheelAdvance(TimingWheel *w, uint64_t nowNs,
+*                                       WheelTimerFn fn, void *arg)
+*
+* Explanation: Steps the wheel a tick at a time.  At each tick the
+*              levels that wrapped are cascaded, highest first (so a
+*              timer can come down several levels in one tick), then
+*              level 0's slot fires.  An empty wheel jumps straight to
+*              nowNs.
+*
+* outputs: the number of timers fired
+*
+**************************************************/
+uint32_t timingWheelAdvance(TimingWheel *w, uint64_t nowNs, WheelTimerFn fn, void *arg)
+{
+  uint64_t target = nowNs / w->tickNs;
+  uint32_t fired = 0;
+
+  while (w->now < target) {
+    uint64_t tick = 0;
+    uint32_t level = 0;
+    WheelTimer *head = NULL;
+
+    if (w->count == 0) {
+      w->now = target;
+      break;
+    }
+    tick = w->now + 1;
+    for (level = TIMING_WHEEL_LEVELS - 1; level > 0; level--) {
+      if ((tick & ((1ULL << (TIMING_WHEEL_BITS * level)) - 1)) == 0)
+        cascade(w, level, tick);
+    }
+
+    head = &w->slots[0][tick & TIMING_WHEEL_MASK];
+    while (head->next != head) {
+      WheelTimer *timer = head->next;
+      timingWheelCancel(w, timer);
+      fired++;
+      fn(timer, arg);
+    }
+    w->now = tick;
+  }
+  return fired;
+}
+
+/***********************************************************
+* Function: uint64_t timingWheelNextEvent(const TimingWheel *w)
+*
+* Explanation: The first busy level 0 slot before level 0 wraps, else
+*              the wrap itself (a cascade may bring timers down)
+*
+**************************************************/
+uint64_t timingWheelNextEvent(const TimingWheel *w)
+{
+  uint64_t tick = w->now + 1;
+
+  if (w->count == 0)
+    return UINT64_MAX;
+  for (; ; tick++) {
+    const WheelTimer *head = &w->slots[0][tick & TIMING_WHEEL_MASK];
+    if ((head->next != head) || ((tick & TIMING_WHEEL_MASK) == 0))
+      return tick * w->tickNs;
+  }
+}
+
+//Puts timer in the lowest level whose span covers its expiry from base
+static void place(TimingWheel *w, WheelTimer *timer, uint64_t base)
+{
+  uint64_t delta = timer->expiry - base;
+  uint32_t level = 0;
+  WheelTimer *head = NULL;
+
+  while ((level < TIMING_WHEEL_LEVELS - 1) && (delta >= (1ULL << (TIMING_WHEEL_BITS * (level + 1)))))
+    level++;
+  head = &w->slots[level][(timer->expiry >> (TIMING_WHEEL_BITS * level)) & TIMING_WHEEL_MASK];
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+//Moves the timers of level's slot for tick down, tick is where that
+//slot's span starts
+static void cascade(TimingWheel *w, uint32_t level, uint64_t tick)
+{
+  WheelTimer *head = &w->slots[level][(tick >> (TIMING_WHEEL_BITS * level)) & TIMING_WHEEL_MASK];
+  WheelTimer *timer = head->next;
+
+  head->next = head;
+  head->prev = head;
+  while (timer != head) {
+    WheelTimer *next = timer->next;
+    place(w, timer, tick);
+    timer = next;
+  }
+}
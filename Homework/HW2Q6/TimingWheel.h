@@ -0,0 +1,80 @@
+/************************************************************************
+* File:  TimingWheel.h
+*
+* Purpose:
+*   Hierarchical timing wheel (Varghese and Lauck) for the client's per
+*   probe timeouts:  adding and cancelling a timer are O(1), and so is
+*   firing it, whatever the number of timers pending.  No signals and no
+*   system calls, the owner advances the wheel from its event loop.
+*
+* Notes:
+*   Time is in ticks of tickNs.  Level L has TIMING_WHEEL_SLOTS slots of
+*   TIMING_WHEEL_SLOTS^L ticks each;  a timer goes into the lowest level
+*   whose span covers it.  When level 0 wraps, the next slot of level 1
+*   is cascaded down (re-placed by its remaining time), and so on up.
+*   Each timer is cascaded at most TIMING_WHEEL_LEVELS - 1 times.
+*   Four levels of 64 slots cover 2^24 ticks (4.6 hours at 1 ms);  a
+*   later expiry is clamped to that.  A timer fires on the first advance
+*   into its tick:  up to a tick early, and as late as the advance.
+*
+*   Timers are intrusive:  the owner embeds a WheelTimer in its own
+*   struct and gets it back in the expiry callback.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__TimingWheel_h
+#define	__TimingWheel_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_BITS)
+#define TIMING_WHEEL_MASK (TIMING_WHEEL_SLOTS - 1)
+#define TIMING_WHEEL_SPAN (1ULL << (TIMING_WHEEL_BITS * TIMING_WHEEL_LEVELS))
+
+typedef struct WheelTimer {
+  struct WheelTimer *next;
+  struct WheelTimer *prev;
+  uint64_t expiry;          // tick
+  bool pending;
+} WheelTimer;
+
+typedef void (*WheelTimerFn)(WheelTimer *timer, void *arg);
+
+typedef struct {
+  WheelTimer slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];  // list heads
+  uint64_t tickNs;
+  uint64_t now;             // the last tick advanced to, every earlier timer fired
+  uint32_t count;           // timers pending
+} TimingWheel;
+
+void timingWheelInit(TimingWheel *w, uint64_t tickNs, uint64_t nowNs);
+
+//Starts (or restarts) timer to fire at expiryNs, O(1)
+void timingWheelAdd(TimingWheel *w, WheelTimer *timer, uint64_t expiryNs);
+
+//Stops timer if it is pending, O(1)
+static inline void timingWheelCancel(TimingWheel *w, WheelTimer *timer)
+{
+  if (!timer->pending)
+    return;
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->pending = false;
+  w->count--;
+}
+
+//Fires (fn(timer, arg)) every timer due at or before nowNs, returns how
+//many.  fn may add or cancel timers
+uint32_t timingWheelAdvance(TimingWheel *w, uint64_t nowNs, WheelTimerFn fn, void *arg);
+
+//When the next advance may have something to do (ns), UINT64_MAX if no
+//timer is pending.  Never later than the first expiry
+uint64_t timingWheelNextEvent(const TimingWheel *w);
+
+#endif
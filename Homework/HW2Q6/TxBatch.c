@@ -0,0 +1,228 @@
+/*********************************************************
+*
+* Module Name: TxBatch
+*
+* File Name:  TxBatch.c
+*
+* Summary:  The client's batched (sendmmsg) sender with optional
+*           SO_TXTIME departure times.  See TxBatch.h
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for sendmmsg */
+#endif
+#include "UDPEcho.h"
+#include "TxBatch.h"
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+
+#define TX_BATCH_CONTROL_SIZE CMSG_SPACE(sizeof(uint64_t))
+
+
+/***********************************************************
+* Function: int txBatchInit(TxBatch *b, int sock, const struct sockaddr *dest,
+*                           socklen_t destLen, uint32_t size, int32_t messageSize,
+*                           uint16_t opMode, bool txTime)
+*
+* Explanation: Every message gets the client's header layout (sequence
+*              number, timestamp seconds and nanoseconds, opMode and the
+*              0x5555 marker), the rest of it zeroes.  The control
+*              buffers hold one SCM_TXTIME cmsg each, only its value
+*              changes per send.
+*
+* outputs: ERROR or NOERROR
+*
+**************************************************/
+int txBatchInit(TxBatch *b, int sock, const struct sockaddr *dest, socklen_t destLen,
+                uint32_t size, int32_t messageSize, uint16_t opMode, bool txTime)
+{
+  struct sock_txtime txTimeConfig;
+  struct cmsghdr *cmsg = NULL;
+  uint16_t *shortPtr = NULL;
+  uint32_t i = 0;
+  int on = 1;
+
+  memset(b, 0, sizeof(TxBatch));
+  if (size < 1)
+    size = 1;
+  if (size > TX_BATCH_MAX)
+    size = TX_BATCH_MAX;
+  b->sock = sock;
+  b->size = size;
+  b->messageSize = messageSize;
+  b->txTime = txTime;
+
+  if (dest->sa_family == AF_INET6) {
+    if (setsockopt(sock, SOL_IPV6, IPV6_RECVERR, &on, sizeof(on)) < 0)
+      return ERROR;
+  } else if (setsockopt(sock, SOL_IP, IP_RECVERR, &on, sizeof(on)) < 0)
+    return ERROR;
+
+  if (txTime) {
+    txTimeConfig.clockid = CLOCK_MONOTONIC;
+    txTimeConfig.flags = SOF_TXTIME_REPORT_ERRORS;
+    if (setsockopt(sock, SOL_SOCKET, SO_TXTIME, &txTimeConfig, sizeof(txTimeConfig)) < 0)
+      return ERROR;
+  }
+
+  b->buffers = calloc(size, (size_t)messageSize);
+  b->msgs = calloc(size, sizeof(struct mmsghdr));
+  b->iovs = calloc(size, sizeof(struct iovec));
+  b->controls = calloc(size, TX_BATCH_CONTROL_SIZE);
+  if ((b->buffers == NULL) || (b->msgs == NULL) || (b->iovs == NULL) || (b->controls == NULL)) {
+    txBatchFree(b);
+    errno = ENOMEM;
+    return ERROR;
+  }
+
+  for (i = 0; i < size; i++) {
+    char *buffer = b->buffers + (size_t)i * messageSize;
+
+    shortPtr = (uint16_t *)(buffer + 3 * sizeof(uint32_t));
+    *shortPtr++ = htons(opMode);
+    *shortPtr++ = htons(0x5555);
+
+    b->iovs[i].iov_base = buffer;
+    b->iovs[i].iov_len = messageSize;
+    b->msgs[i].msg_hdr.msg_name = (void *)dest;
+    b->msgs[i].msg_hdr.msg_namelen = destLen;
+    b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+    b->msgs[i].msg_hdr.msg_iovlen = 1;
+    if (txTime) {
+      b->msgs[i].msg_hdr.msg_control = b->controls + i * TX_BATCH_CONTROL_SIZE;
+      b->msgs[i].msg_hdr.msg_controllen = TX_BATCH_CONTROL_SIZE;
+      cmsg = CMSG_FIRSTHDR(&b->msgs[i].msg_hdr);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_TXTIME;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    }
+  }
+  return NOERROR;
+}
+
+void txBatchFree(TxBatch *b)
+{
+  free(b->buffers);
+  free(b->msgs);
+  free(b->iovs);
+  free(b->controls);
+  b->buffers = NULL;
+  b->msgs = NULL;
+  b->iovs = NULL;
+  b->controls = NULL;
+}
+
+void txBatchStamp(TxBatch *b, uint32_t i, uint32_t seq, const struct timespec *sentTime, uint64_t txTimeNs)
+{
+  uint32_t *intPtr = (uint32_t *)(b->buffers + (size_t)i * b->messageSize);
+
+  *intPtr++ = htonl(seq);
+  *intPtr++ = htonl((uint32_t)sentTime->tv_sec);
+  *intPtr++ = htonl((uint32_t)sentTime->tv_nsec);
+  if (b->txTime)
+    memcpy(CMSG_DATA(CMSG_FIRSTHDR(&b->msgs[i].msg_hdr)), &txTimeNs, sizeof(uint64_t));
+}
+
+/***********************************************************
+* Function: uint32_t txBatchSend(TxBatch *b, uint32_t count)
+*
+* Explanation: sendmmsg until all count messages are out or it fails.
+*              An interrupted call, or one failed by an earlier ICMP
+*              error, is retried;  a full socket buffer or device queue
+*              is waited out (see TxBatch.h).
+*
+* outputs: the number of messages sent
+*
+**************************************************/
+uint32_t txBatchSend(TxBatch *b, uint32_t count)
+{
+  struct pollfd pfd;
+  uint32_t done = 0;
+  uint32_t retries = 0;
+  int rc = 0;
+
+  pfd.fd = b->sock;
+  pfd.events = POLLOUT;
+  if (count > b->size)
+    count = b->size;
+  b->batches++;
+  while (done < count) {
+    rc = sendmmsg(b->sock, &b->msgs[done], count - done, 0);
+    if (rc < 0) {
+      //With IP_RECVERR an ICMP error fails the next call once
+      if ((errno == EINTR) || (errno == ECONNREFUSED))
+        continue;
+      b->errors++;
+      b->lastErrno = errno;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)) {
+        if (errno == ENOBUFS)
+          b->enobufs++;
+        else
+          b->eagain++;
+        if (retries++ < TX_BATCH_FULL_RETRIES) {
+          (void) poll(&pfd, 1, TX_BATCH_FULL_WAIT_MS);
+          continue;
+        }
+      }
+      b->unsent += count - done;
+      break;
+    }
+    retries = 0;
+    done += (uint32_t)rc;
+    if (done < count)
+      b->partial++;
+  }
+  b->sent += done;
+  b->bytes += (uint64_t)done * b->messageSize;
+  return done;
+}
+
+/***********************************************************
+* Function: void txBatchDrainErrors(TxBatch *b)
+*
+* Explanation: Reads the error queue until it is empty, so IP_RECVERR
+*              does not fill it.  A txtime drop comes back as a
+*              sock_extended_err of origin SO_EE_ORIGIN_TXTIME (IP_RECVERR
+*              or IPV6_RECVERR cmsg);  anything else (ICMP errors) is
+*              ignored.
+*
+**************************************************/
+void txBatchDrainErrors(TxBatch *b)
+{
+  char data[64];
+  char control[256];
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsg = NULL;
+  struct sock_extended_err *err = NULL;
+
+  while (true) {
+    iov.iov_base = data;
+    iov.iov_len = sizeof(data);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(b->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      return;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(((cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR)) ||
+            ((cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR))))
+        continue;
+      err = (struct sock_extended_err *)CMSG_DATA(cmsg);
+      if (err->ee_origin != SO_EE_ORIGIN_TXTIME)
+        continue;
+      if (err->ee_code == SO_EE_CODE_TXTIME_MISSED)
+        b->txTimeMissed++;
+      else
+        b->txTimeInvalid++;
+    }
+  }
+}
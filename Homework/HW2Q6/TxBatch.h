@@ -0,0 +1,85 @@
+/************************************************************************
+* File:  TxBatch.h
+*
+* Purpose:
+*   The client's batched sender:  a set of pre-built messages sent with
+*   one sendmmsg.  The header is packed once at init, each send patches
+*   only the sequence number and the timestamp.  Optionally every
+*   message carries an SCM_TXTIME departure time (SO_TXTIME), so the fq
+*   or etf qdisc releases it rather than the client's pacing.
+*
+* Notes:
+*   Departure times are CLOCK_MONOTONIC ns, the clock fq paces on (etf
+*   must be configured with clockid CLOCK_MONOTONIC).  Without fq or etf
+*   on the egress device SO_TXTIME is ignored and the batch leaves at
+*   once.  With SOF_TXTIME_REPORT_ERRORS the qdisc reports a message it
+*   dropped (its departure time had passed, or was invalid) on the error
+*   queue, txBatchDrainErrors counts them.
+*
+*   A partial sendmmsg is continued from the first unsent message.
+*   EAGAIN (a non-blocking socket's buffer is full) and ENOBUFS (the
+*   device queue dropped it) mean the network side is the limit:  they
+*   are counted, and the send waits up to TX_BATCH_FULL_WAIT_MS for room
+*   and retries, at most TX_BATCH_FULL_RETRIES times in a row.  Any other
+*   error ends the send, the rest of the batch is not sent.  UDP reports
+*   ENOBUFS only with IP_RECVERR, so txBatchInit sets it.
+*
+* A1: 10/17/26: initial version
+* A2: 10/17/26: EAGAIN/ENOBUFS and unsent datagram counts
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__TxBatch_h
+#define	__TxBatch_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#define TX_BATCH_MAX 1024     // sendmmsg vlen is capped at UIO_MAXIOV
+#define TX_BATCH_FULL_WAIT_MS 1
+#define TX_BATCH_FULL_RETRIES 100
+
+typedef struct {
+  int sock;
+  uint32_t size;              // messages per batch
+  int32_t messageSize;
+  bool txTime;
+  char *buffers;              // size * messageSize, the headers pre-built
+  struct mmsghdr *msgs;
+  struct iovec *iovs;
+  char *controls;             // an SCM_TXTIME cmsg per message (txTime)
+
+  uint64_t batches;
+  uint64_t sent;
+  uint64_t bytes;
+  uint64_t partial;           // sendmmsg calls that sent part of the rest
+  uint64_t errors;            // sendmmsg calls that failed
+  uint64_t eagain;            //   of them with EAGAIN/EWOULDBLOCK
+  uint64_t enobufs;           //   of them with ENOBUFS
+  uint64_t unsent;            // datagrams a failed call left unsent
+  int lastErrno;
+  uint64_t txTimeMissed;      // dropped by the qdisc, departure time passed
+  uint64_t txTimeInvalid;     // dropped by the qdisc, bad departure time
+} TxBatch;
+
+//Allocates size (1..TX_BATCH_MAX) messages of messageSize bytes to
+//dest, packs their header for opMode, sets IP_RECVERR and with txTime
+//enables SO_TXTIME on sock.  ERROR (errno set) or NOERROR
+int txBatchInit(TxBatch *b, int sock, const struct sockaddr *dest, socklen_t destLen,
+                uint32_t size, int32_t messageSize, uint16_t opMode, bool txTime);
+void txBatchFree(TxBatch *b);
+
+//Patches message i:  its sequence number, its header timestamp and (in
+//txTime mode) its departure time
+void txBatchStamp(TxBatch *b, uint32_t i, uint32_t seq, const struct timespec *sentTime, uint64_t txTimeNs);
+
+//Sends messages 0..count-1, returns how many went out
+uint32_t txBatchSend(TxBatch *b, uint32_t count);
+
+//Empties the error queue, counting the qdisc's txtime drops
+void txBatchDrainErrors(TxBatch *b);
+
+#endif
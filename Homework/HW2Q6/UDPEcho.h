@@ -10,8 +10,10 @@
 * Revisions:
 * 
 * $A1: 4/2/25: Added updatedMessageHeader 
+* $A2: 10/17/26: Added the UDP GSO/GRO limits
+* $A3: 10/17/26: Added GSO_MIN_SEGMENT (room for the response token)
 *
-* Last Update: 4/2/2025
+* Last Update: 10/17/2026
 *
 *********************************************************/
 #ifndef	__UDPEcho_h
@@ -81,6 +83,21 @@ enum sizeConstants {
 
 #define MAX_MSG_HDR 128
 
+//UDP GSO/GRO:  a large message is carried as MTU sized segments, each
+//with its own message header.   A GSO send is limited to 64 segments and
+//one (64KB) UDP datagram, the GRO receive buffer must hold a full datagram
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_MESSAGE 65000
+#define GSO_DEFAULT_SEGMENT 1472   // 1500 byte MTU less the IPv4 and UDP headers
+#define GRO_BUFFER_SIZE 65536
+
+//The server writes a response token into every message it echoes,
+//after the header and the 0x5555 marker.  An echoed GSO segment must
+//hold it, else it would run into the next segment
+#define MSG_TOKEN_OFFSET 18
+#define MSG_TOKEN_SIZE 16
+#define GSO_MIN_SEGMENT (MSG_TOKEN_OFFSET + MSG_TOKEN_SIZE)
+
 
 #define ECHOMAX 10000     /* Longest string to echo */
 #define ERROR_LIMIT 5
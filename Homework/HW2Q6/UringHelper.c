@@ -0,0 +1,291 @@
+/*********************************************************
+*
+* Module Name: UringHelper 
+*
+* File Name:  UringHelper.c
+*
+* Summary:  A minimal io_uring wrapper built directly on the
+*           io_uring_setup/enter/register syscalls.
+*
+* Revisions:
+*
+* Last update: 10/17/2026 
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "UringHelper.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+/***********************************************************
+* Function: int uringInit(UringContext *u, uint32_t entries)
+*
+* Explanation: creates a ring with (at least) entries SQEs and maps the
+*              SQ/CQ rings and the SQE array.
+*
+* inputs:   
+*   UringContext *u : caller's context, filled in
+*   uint32_t entries : requested SQ size (the CQ is twice that)
+*
+* outputs: returns ERROR or NOERROR.  On ERROR errno is set and
+*          nothing is left open.
+*
+**************************************************/
+int uringInit(UringContext *u, uint32_t entries)
+{
+  struct io_uring_params p;
+  int savedErrno = 0;
+
+  memset(u, 0, sizeof(UringContext));
+  memset(&p, 0, sizeof(p));
+  u->ringFd = -1;
+
+  u->ringFd = (int) syscall(__NR_io_uring_setup, entries, &p);
+  if (u->ringFd < 0) {
+    u->ringFd = -1;
+    return ERROR;
+  }
+  u->sqEntries = p.sq_entries;
+
+  u->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cqRingSize > u->sqRingSize)
+      u->sqRingSize = u->cqRingSize;
+    u->cqRingSize = u->sqRingSize;
+  }
+
+  u->sqRingPtr = mmap(NULL, u->sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->ringFd, IORING_OFF_SQ_RING);
+  if (u->sqRingPtr == MAP_FAILED) {
+    u->sqRingPtr = NULL;
+    goto fail;
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cqRingPtr = u->sqRingPtr;
+  } else {
+    u->cqRingPtr = mmap(NULL, u->cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, u->ringFd, IORING_OFF_CQ_RING);
+    if (u->cqRingPtr == MAP_FAILED) {
+      u->cqRingPtr = NULL;
+      goto fail;
+    }
+  }
+
+  u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->ringFd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    goto fail;
+  }
+
+  u->sqHead = (unsigned *)((char *)u->sqRingPtr + p.sq_off.head);
+  u->sqTail = (unsigned *)((char *)u->sqRingPtr + p.sq_off.tail);
+  u->sqMask = (unsigned *)((char *)u->sqRingPtr + p.sq_off.ring_mask);
+  u->sqArray = (unsigned *)((char *)u->sqRingPtr + p.sq_off.array);
+  u->cqHead = (unsigned *)((char *)u->cqRingPtr + p.cq_off.head);
+  u->cqTail = (unsigned *)((char *)u->cqRingPtr + p.cq_off.tail);
+  u->cqMask = (unsigned *)((char *)u->cqRingPtr + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)((char *)u->cqRingPtr + p.cq_off.cqes);
+  u->sqeTail = *u->sqTail;
+
+  return NOERROR;
+
+fail:
+  savedErrno = errno;
+  uringExit(u);
+  errno = savedErrno;
+  return ERROR;
+}
+
+/***********************************************************
+* Function: void uringExit(UringContext *u)
+*
+* Explanation: unmaps everything and closes the ring
+*
+**************************************************/
+void uringExit(UringContext *u)
+{
+  if (u->bufBase)
+    munmap(u->bufBase, (size_t)u->bufCount * u->bufSize);
+  if (u->bufRing)
+    munmap(u->bufRing, u->bufRingSize);
+  if (u->sqes)
+    munmap(u->sqes, u->sqesSize);
+  if (u->cqRingPtr && u->cqRingPtr != u->sqRingPtr)
+    munmap(u->cqRingPtr, u->cqRingSize);
+  if (u->sqRingPtr)
+    munmap(u->sqRingPtr, u->sqRingSize);
+  if (u->ringFd >= 0)
+    close(u->ringFd);
+  memset(u, 0, sizeof(UringContext));
+  u->ringFd = -1;
+}
+
+/***********************************************************
+* Function: struct io_uring_sqe *uringGetSqe(UringContext *u)
+*
+* Explanation: hands out the next free (zeroed) SQE.  It is only
+*              seen by the kernel after the next uringSubmit.
+*
+* outputs: returns the SQE or NULL if the SQ is full
+*
+**************************************************/
+struct io_uring_sqe *uringGetSqe(UringContext *u)
+{
+  struct io_uring_sqe *sqe = NULL;
+  unsigned head = __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE);
+
+  if (u->sqeTail - head >= u->sqEntries)
+    return NULL;
+
+  sqe = &u->sqes[u->sqeTail & *u->sqMask];
+  u->sqeTail++;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  return sqe;
+}
+
+/***********************************************************
+* Function: int uringSubmit(UringContext *u, uint32_t waitNr)
+*
+* Explanation: publishes all SQEs handed out since the last call and
+*              enters the kernel to submit them and/or wait for
+*              waitNr completions.   No syscall is made when there is
+*              nothing to submit and nothing to wait for.
+*
+* outputs: returns the number of SQEs consumed or ERROR (errno set).
+*          EINTR is not treated as an error - 0 is returned.
+*
+**************************************************/
+int uringSubmit(UringContext *u, uint32_t waitNr)
+{
+  unsigned tail = *u->sqTail;
+  unsigned toSubmit = u->sqeTail - tail;
+  unsigned flags = 0;
+  int rc = 0;
+
+  for (; tail != u->sqeTail; tail++) {
+    u->sqArray[tail & *u->sqMask] = tail & *u->sqMask;
+  }
+  __atomic_store_n(u->sqTail, tail, __ATOMIC_RELEASE);
+
+  if (toSubmit == 0 && waitNr == 0)
+    return 0;
+
+  if (waitNr > 0)
+    flags |= IORING_ENTER_GETEVENTS;
+
+  rc = (int) syscall(__NR_io_uring_enter, u->ringFd, toSubmit, waitNr, flags, NULL, 0);
+  if (rc < 0) {
+    if (errno == EINTR)
+      return 0;
+    return ERROR;
+  }
+  return rc;
+}
+
+/***********************************************************
+* Function: struct io_uring_cqe *uringPeekCqe(UringContext *u)
+*
+* outputs: returns the oldest unseen CQE or NULL if there is none.
+*          The CQE is valid until uringCqeSeen is called.
+*
+**************************************************/
+struct io_uring_cqe *uringPeekCqe(UringContext *u)
+{
+  unsigned head = *u->cqHead;
+  unsigned tail = __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+    return NULL;
+  return &u->cqes[head & *u->cqMask];
+}
+
+void uringCqeSeen(UringContext *u)
+{
+  __atomic_store_n(u->cqHead, *u->cqHead + 1, __ATOMIC_RELEASE);
+}
+
+/***********************************************************
+* Function: int uringSetupBufRing(UringContext *u, uint16_t bufGroup,
+*                                 uint32_t bufCount, uint32_t bufSize)
+*
+* Explanation: allocates bufCount buffers of bufSize bytes, registers
+*              a provided buffer ring for them under bufGroup and
+*              hands every buffer to the kernel.
+*
+* inputs:   
+*   bufCount must be a power of 2 (at most 32768)
+*
+* outputs: returns ERROR or NOERROR
+*
+**************************************************/
+int uringSetupBufRing(UringContext *u, uint16_t bufGroup, uint32_t bufCount, uint32_t bufSize)
+{
+  struct io_uring_buf_reg reg;
+  uint32_t i = 0;
+
+  if (bufCount == 0 || (bufCount & (bufCount - 1)) != 0 || bufCount > 32768) {
+    errno = EINVAL;
+    return ERROR;
+  }
+
+  u->bufRingSize = bufCount * sizeof(struct io_uring_buf);
+  u->bufRing = mmap(NULL, u->bufRingSize, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (u->bufRing == MAP_FAILED) {
+    u->bufRing = NULL;
+    return ERROR;
+  }
+
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)u->bufRing;
+  reg.ring_entries = bufCount;
+  reg.bgid = bufGroup;
+  if (syscall(__NR_io_uring_register, u->ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    munmap(u->bufRing, u->bufRingSize);
+    u->bufRing = NULL;
+    return ERROR;
+  }
+
+  u->bufBase = mmap(NULL, (size_t)bufCount * bufSize, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (u->bufBase == MAP_FAILED) {
+    u->bufBase = NULL;
+    return ERROR;
+  }
+
+  u->bufGroup = bufGroup;
+  u->bufCount = bufCount;
+  u->bufSize = bufSize;
+  u->bufTail = 0;
+  for (i = 0; i < bufCount; i++) {
+    uringRecycleBuffer(u, (uint16_t)i);
+  }
+  return NOERROR;
+}
+
+char *uringBuffer(UringContext *u, uint16_t bufId)
+{
+  return u->bufBase + ((size_t)bufId * u->bufSize);
+}
+
+/***********************************************************
+* Function: void uringRecycleBuffer(UringContext *u, uint16_t bufId)
+*
+* Explanation: gives a buffer back to the kernel for the next receive
+*
+**************************************************/
+void uringRecycleBuffer(UringContext *u, uint16_t bufId)
+{
+  struct io_uring_buf *buf = &u->bufRing->bufs[u->bufTail & (u->bufCount - 1)];
+
+  buf->addr = (uint64_t)(uintptr_t)uringBuffer(u, bufId);
+  buf->len = u->bufSize;
+  buf->bid = bufId;
+  u->bufTail++;
+  __atomic_store_n(&u->bufRing->tail, u->bufTail, __ATOMIC_RELEASE);
+}
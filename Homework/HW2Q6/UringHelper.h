@@ -0,0 +1,79 @@
+/************************************************************************
+* File:  UringHelper.h
+*
+* Purpose:
+*   A minimal io_uring wrapper (raw syscalls, no liburing) used by the
+*   server's io_uring receive/echo engine.  It covers just what the engine
+*   needs:  ring setup, SQE/CQE access and a registered provided-buffer ring.
+*
+* Notes:
+*   All routines return ERROR/NOERROR unless noted.   uringInit fails
+*   cleanly (nothing left allocated) when the kernel lacks io_uring so the
+*   caller can fall back to the recvfrom/recvmmsg loops.
+*
+* A1: 10/17/26: initial version
+*
+* Last update: 10/17/2026
+*
+************************************************************************/
+#ifndef	__UringHelper_h
+#define	__UringHelper_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+typedef struct {
+  int ringFd;
+
+  //submission queue
+  unsigned *sqHead;
+  unsigned *sqTail;
+  unsigned *sqMask;
+  unsigned *sqArray;
+  struct io_uring_sqe *sqes;
+  unsigned sqeTail;       //next sqe to hand out
+
+  //completion queue
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned *cqMask;
+  struct io_uring_cqe *cqes;
+
+  void *sqRingPtr;
+  size_t sqRingSize;
+  void *cqRingPtr;
+  size_t cqRingSize;
+  size_t sqesSize;
+  uint32_t sqEntries;
+
+  //provided buffer ring (one buffer group)
+  struct io_uring_buf_ring *bufRing;
+  size_t bufRingSize;
+  char *bufBase;
+  uint32_t bufSize;
+  uint32_t bufCount;
+  uint16_t bufGroup;
+  uint16_t bufTail;
+} UringContext;
+
+int uringInit(UringContext *u, uint32_t entries);
+void uringExit(UringContext *u);
+
+//returns NULL when the SQ is full - call uringSubmit and retry
+struct io_uring_sqe *uringGetSqe(UringContext *u);
+//publishes the pending SQEs and optionally waits for completions,
+//returns the number submitted or ERROR
+int uringSubmit(UringContext *u, uint32_t waitNr);
+
+//returns NULL when the CQ is empty, each returned CQE must be released
+struct io_uring_cqe *uringPeekCqe(UringContext *u);
+void uringCqeSeen(UringContext *u);
+
+int uringSetupBufRing(UringContext *u, uint16_t bufGroup, uint32_t bufCount, uint32_t bufSize);
+char *uringBuffer(UringContext *u, uint16_t bufId);
+void uringRecycleBuffer(UringContext *u, uint16_t bufId);
+
+#endif
+
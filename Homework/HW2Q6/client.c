@@ -18,7 +18,7 @@
 *  double  sendRate = atof(argv[7])
 *  char *outputFile = atoi(argv[8]);
 *
-*  Usage :   client
+*  Usage :   client [-g segSize] [-W window] [-s] [-T window] [-b batchSize]
 *             <Server IP>
 *             <Server Port>
 *             [<Iteration Delay (secs.nano)>]
@@ -28,6 +28,30 @@
 *             <sendRate>
 *             <outputFile>
 *
+*     -g segSize : send each message as segSize byte segments with one
+*                  UDP_SEGMENT (GSO) sendmsg.  Every segment carries its own
+*                  message header and sequence number, so the server accounts
+*                  for segments rather than messages.  0 picks the default
+*                  (1472, a 1500 byte MTU).  Avoids IP fragmentation of large
+*                  messages; pair with server -g.
+*     -W window  : pipelined RTT mode (opMode 0).  Probes go out every
+*                  iterationDelay without waiting for the reply, up to window
+*                  of them outstanding;  replies are matched by the echoed
+*                  sequence number (ProbeTable.c).  Late (after the 2 second
+*                  timeout), duplicate and lost replies are counted apart.
+*                  Without -W the client is stop-and-wait:  a window of one
+*                  message, matched the same way.
+*     -s         : pace by spinning for the whole gap (busyWait) instead of
+*                  sleeping until a calibrated margin before each send.
+*     -T window  : kernel paced opMode 1 (SO_TXTIME):  every datagram carries
+*                  its departure time and the fq or etf qdisc releases it;
+*                  window datagrams are queued per sendmmsg (0: 32).
+*     -b batchSize : high-rate opMode 1:  batchSize pre-built datagrams per
+*                  sendmmsg (0: 64), only their sequence numbers and
+*                  timestamps patched, paced at batch granularity.  The
+*                  summary compares the achieved with the requested rate and
+*                  counts EAGAIN/ENOBUFS.
+*
 * outputs:  
 *    The per iteration information printed to stdout:
 *      printf("%f %4.9f %4.9f %d %d\n", 
@@ -46,16 +70,75 @@
 *
 * $A2: 4/3/25 :  Finished the updates
 *     
-* Last update: 4/3/2025
+* $A3: 10/17/26:  Added the -g UDP GSO segment mode
+*
+* $A4: 10/17/26:  sendto/recvfrom errors and timeouts are logged through
+*                 the AsyncLog ring (rate limited) instead of printf/perror
+*
+* $A5: 10/17/26:  RTT samples go into a LatencyHistogram, the summary line
+*                 ends with the p50, p90, p99 and p99.9 RTT
+*
+* $A6: 10/17/26:  RTT delay variation:  the RFC 3550 jitter of the RTT
+*                 samples, the mean IPDV (RFC 5481) of consecutive
+*                 samples and the p99.9 PDV (p99.9 RTT - min RTT) end the
+*                 summary line
+*
+* $A7: 10/17/26:  Pipelined RTT mode (-W window):  up to window probes
+*                 outstanding, replies matched by their echoed sequence
+*                 number in a ProbeTable, late, duplicate and lost replies
+*                 counted separately
+*
+* $A8: 10/17/26:  opModeRTT runs on an epoll event loop (the socket and
+*                 a pacing timerfd) with the per probe timeouts on a
+*                 timing wheel;  no more SIGALRM and alarm() per probe.
+*                 Stop-and-wait is the pipelined mode with a one message
+*                 window
+*
+* $A9: 10/17/26:  Sends are paced by a Pacer:  clock_nanosleep until a
+*                 self-tuning margin before the deadline, then a spin,
+*                 instead of busyWait's spin over the whole gap (-s keeps
+*                 it).  The summary has a pacer line with the send-time
+*                 error and the CPU share
+*
+* $A10: 10/17/26: SO_TXTIME kernel pacing for opModeOWD (-T window),
+*                 departure times stamped per datagram, a window queued
+*                 per sendmmsg (TxBatch.c)
+*
+* $A11: 10/17/26: High-rate opModeOWD sender (-b batchSize):  sendmmsg
+*                 batches of pre-built datagrams on a non-blocking
+*                 socket, a "sender:" summary line with the achieved vs
+*                 requested rate and the EAGAIN/ENOBUFS counts
+*
+* Last update: 10/17/2026
 *
 *********************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "UDPEcho.h"
 #include "AddressHelper.h"
 #include "utils.h"
+#include <netinet/udp.h>    /* for UDP_SEGMENT */
+#include "AsyncLog.h"
+#include "LatencyHistogram.h"
+#include "ProbeTable.h"
+#include "Pacer.h"
+#include "TxBatch.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+//Log categories, see clientLogCategories
+#define LOG_CAT_TX_ERROR 0
+#define LOG_CAT_RX_ERROR 1
+#define LOG_CAT_TIMEOUT 2
 
 void myUsage();
 void clientCNTCCode();
-void CatchAlarm(int ignored);
+void recordRTTSample(double RTTSample, int32_t RxedMsgSize);
+void eventLoopInit(int sock);
+void probeReceive(int sock, char *RxBuffer, int32_t bufferSize);
+void probeWait(int sock, char *RxBuffer, int32_t bufferSize, double deadline, uint32_t needed, bool untilIdle);
+void batchSend(double iterationDelay, uint32_t nIterations, bool loopForever, uint32_t sequenceNumber);
 
 extern char Version[];
 
@@ -93,12 +176,62 @@ uint32_t totalGaps=0;
 
 uint32_t TxErrorCount=0;
 uint32_t RxErrorCount=0;
+
+//Messages per second (and burst) each category may write
+const LogCategory clientLogCategories[] = {
+  {"tx-error", 10, 10},
+  {"rx-error", 10, 10},
+  {"timeout",  10, 10},
+};
 uint32_t largestSeqRecv = 0;
 uint32_t receivedCount = 0;
 
 
 double RTTSum = 0.0;
 uint32_t numberRTTSamples=0;
+LatencyHistogram RTTHist;
+//smoothed avg
+double smoothedRTT = 0.0;
+double alpha = ALPHA;
+
+//RTT delay variation:  RFC 3550 jitter with its 1/16 gain, the IPDV of
+//consecutive samples (RFC 5481) and the minimum for the PDV
+#define RTT_JITTER_GAIN (1.0 / 16.0)
+double RTTJitter = 0.0;
+double lastRTTSample = 0.0;
+double minRTT = 0.0;
+double IPDVAbsSum = 0.0;
+uint32_t numberIPDV = 0;
+
+//opModeRTT probes:  up to probeWindow outstanding (-W), by default one
+//message (stop-and-wait).  The event loop sleeps in epoll_wait on the
+//socket and the pacing timerfd;  the last pacer margin before a send is
+//spent polling the socket instead, for the pacing
+uint32_t probeWindow = 0;
+bool pipelined = false;
+ProbeTable probes;
+int epollFd = -1;
+int pacingTimerFd = -1;
+Pacer pacer;
+bool spinPacing = false;
+
+//Kernel paced opModeOWD (-T):  every datagram carries its departure time
+//(SO_TXTIME), txTimeWindow of them are queued per sendmmsg.  The first
+//departs TXTIME_LEAD_SECS after the start.  The qdisc holds up to two
+//windows, TXTIME_MAX_WINDOW keeps them under fq's default flow_limit
+//(100 packets).  Above it fq drops datagrams, which would look like
+//network loss
+#define TXTIME_DEFAULT_WINDOW 32
+#define TXTIME_MAX_WINDOW 50
+#define TXTIME_LEAD_SECS 0.001
+uint32_t txTimeWindow = 0;
+
+//High-rate opModeOWD (-b):  sendBatchSize datagrams per sendmmsg, the
+//iteration delay kept per batch.  -T uses the same sender
+#define SEND_BATCH_DEFAULT 64
+uint32_t sendBatchSize = 0;
+TxBatch txBatch;
+double requestedRate = 0.0;
 
 //Maintains current wall clock time
 double wallTime = 0.0;
@@ -113,9 +246,14 @@ static const unsigned int TIMEOUT_SECS = 2; // Seconds between retransmits
 
 void myUsage()
 {
-  printf("UDPEchoV2:client(v%s): <Server IP> <Server Port> <Iteration Delay(secs.nanos)> <Message Size (bytes)>] <# of iterations> <opMode> <sendRate> <outFile> \n", Version);
+  printf("UDPEchoV2:client(v%s): [-g segSize] [-W window] <Server IP> <Server Port> <Iteration Delay(secs.nanos)> <Message Size (bytes)>] <# of iterations> <opMode> <sendRate> <outFile> \n", Version);
   printf(" ---> nIterations: 0 is forever \n");
   printf(" ---> opMode: 0:RTT Mode,  1: OWD Mode \n");
+  printf(" ---> -g segSize: send each message as GSO segments of segSize bytes (0: %d) \n", GSO_DEFAULT_SEGMENT);
+  printf(" ---> -W window: opMode 0 keeps up to window probes outstanding (pipelined RTT) \n");
+  printf(" ---> -s: pace by spinning (busyWait) rather than sleep then spin \n");
+  printf(" ---> -T window: opMode 1 paced by the qdisc (SO_TXTIME, fq or etf), window datagrams per sendmmsg (0: %d, max %d) \n", TXTIME_DEFAULT_WINDOW, TXTIME_MAX_WINDOW);
+  printf(" ---> -b batchSize: opMode 1 high-rate sender, batchSize datagrams per sendmmsg (0: %d), one timestamp per batch \n", SEND_BATCH_DEFAULT);
 }
 
 
@@ -127,7 +265,6 @@ void myUsage()
 
 int main(int argc, char *argv[]) 
 {
-  int32_t rc = NOERROR;
    uint16_t txMarker = 0x5555;
 
   //uint32_t delay=0;
@@ -136,7 +273,6 @@ int main(int argc, char *argv[])
   double   sendRate = 0.0;
   int32_t  messageSize=0;
 
-  int32_t  RxedMsgSize=0;
   int32_t nIterations=  -1;
   char *service = NULL;
 
@@ -146,18 +282,13 @@ int main(int argc, char *argv[])
 
   int rtnVal = 0;
   int sock = -1;
-  struct sigaction handler; // Signal handler
   ssize_t numBytes = 0;
-  struct sockaddr_storage fromAddr; // Source address of server
-  socklen_t fromAddrLen = 0;
   char *TxBuffer = NULL;
   char *RxBuffer = NULL;
   //Used to help pack and unpack the network buffer
   //A2
   uint16_t *TxShortPtr  = NULL;
-  uint16_t *RxShortPtr  = NULL;
   uint32_t *TxIntPtr  = NULL;
-  uint32_t *RxIntPtr  = NULL;
   bool loopForever=false;
   bool loopFlag=true;
   uint32_t sequenceNumber=0;
@@ -166,15 +297,8 @@ int main(int argc, char *argv[])
 
   //Used for the RTT sample
   double  Tstart = 0.0;
-  double  Tstop = 0.0;
-  //most recent RTT sample
-  double RTTSample = 0.0;
-  //smoothed avg
-  double smoothedRTT = 0.0;
-  double alpha = ALPHA;
   //double alpha = 0.10;
   updatedMessageHeader *TxHeaderPtr=NULL;
-  updatedMessageHeader *RxHeaderPtr=NULL;
 //$A1
 //  messageHeaderDefault *TxHeaderPtr=NULL;
 //  messageHeaderDefault *RxHeaderPtr=NULL;
@@ -189,6 +313,58 @@ int main(int argc, char *argv[])
   double TSstartD=0.0;
   double nextWakeUpTimeD=0.0;
 
+  //UDP GSO: each message goes out as segCount segments of segSize bytes
+  bool useGSO = false;
+  int32_t segSize = 0;
+  int32_t segCount = 1;
+  int32_t lastSegSize = 0;
+  int32_t txLength = 0;
+  int32_t seg = 0;
+  char txControl[CMSG_SPACE(sizeof(uint16_t))];
+  struct iovec txIov;
+  struct msghdr txMsg;
+  struct cmsghdr *cmsg = NULL;
+  uint32_t firstSeqOfMsg = 0;
+  int opt;
+
+  //Options come first, the positional params follow
+  while ((opt = getopt(argc, argv, "+g:W:sT:b:")) != -1) {
+    switch (opt) {
+    case 'g':
+      useGSO = true;
+      segSize = atoi(optarg);
+      if (segSize <= 0)
+        segSize = GSO_DEFAULT_SEGMENT;
+      break;
+    case 'W':
+      probeWindow = (uint32_t) atoi(optarg);
+      break;
+    case 's':
+      spinPacing = true;
+      break;
+    case 'T':
+      txTimeWindow = (uint32_t) atoi(optarg);
+      if (txTimeWindow == 0)
+        txTimeWindow = TXTIME_DEFAULT_WINDOW;
+      if (txTimeWindow > TXTIME_MAX_WINDOW) {
+        printf("client: -T window %u would overrun fq's flow_limit, using %d \n", txTimeWindow, TXTIME_MAX_WINDOW);
+        txTimeWindow = TXTIME_MAX_WINDOW;
+      }
+      break;
+    case 'b':
+      sendBatchSize = (uint32_t) atoi(optarg);
+      if (sendBatchSize == 0)
+        sendBatchSize = SEND_BATCH_DEFAULT;
+      break;
+    default:
+      myUsage();
+      exit(1);
+    }
+  }
+  //Shift so the positional params keep their argv[1..8] slots
+  argv += optind - 1;
+  argc -= optind - 1;
+
 
 //The 8th param is optional
   if (argc < 7)    /* need at least server name and port */
@@ -198,6 +374,10 @@ int main(int argc, char *argv[])
     exit(1);
   }
 
+  //Errors on the send/receive path are queued and written by the log thread
+  if (asyncLogInit(clientLogCategories, sizeof(clientLogCategories) / sizeof(clientLogCategories[0]), stdout) != NOERROR)
+    printf("client: log thread not started, messages are written inline \n");
+
   wallTime = getCurTimeD();
   startTime = wallTime;
 
@@ -217,7 +397,10 @@ int main(int argc, char *argv[])
 
 //messageSize in bytes
   messageSize= atoi(argv[4]);
-  if (messageSize > MAX_DATA_BUFFER)
+  if (useGSO) {
+    if (messageSize > GSO_MAX_MESSAGE)
+      messageSize = GSO_MAX_MESSAGE;
+  } else if (messageSize > MAX_DATA_BUFFER)
     messageSize = MAX_DATA_BUFFER;
 
   nIterations = atoi(argv[5]);
@@ -282,6 +465,7 @@ int main(int argc, char *argv[])
   
 
 
+  requestedRate = sendRate;
   reqDelay.tv_sec = (uint32_t)floor(iterationDelay);
   if (reqDelay.tv_sec >= 1)
     reqDelay.tv_nsec = (uint32_t)( 1000000000 * (iterationDelay - (double)reqDelay.tv_sec));
@@ -300,18 +484,40 @@ int main(int argc, char *argv[])
   remDelay.tv_sec = 0;
   remDelay.tv_nsec = 0;
 
+  //Every segment must hold a message header and the server's response
+  //token, and a GSO send is at most GSO_MAX_SEGMENTS
+  if (useGSO) {
+    if (segSize < GSO_MIN_SEGMENT)
+      segSize = GSO_MIN_SEGMENT;
+    if (messageSize > segSize * GSO_MAX_SEGMENTS)
+      segSize = (messageSize + GSO_MAX_SEGMENTS - 1) / GSO_MAX_SEGMENTS;
+    if (messageSize <= segSize) {
+      //fits in one segment, nothing to do
+      useGSO = false;
+    } else {
+      segCount = (messageSize + segSize - 1) / segSize;
+      lastSegSize = messageSize - ((segCount - 1) * segSize);
+      if (lastSegSize < msgHeaderSize)
+        lastSegSize = msgHeaderSize;
+      printf("client: GSO: %d byte messages sent as %d segments of %d bytes (last %d) \n", 
+          messageSize, segCount, segSize, lastSegSize);
+    }
+  }
+
 
 //First seq num is 1
   sequenceNumber++;
 
 
   //Init memory for first send
-  TxBuffer = malloc((size_t)messageSize);
+  //In GSO mode the segments are laid out back to back
+  txLength = useGSO ? ((segCount - 1) * segSize + lastSegSize) : messageSize;
+  TxBuffer = malloc((size_t)txLength);
   if (TxBuffer == NULL) {
-    printf("client: HARD ERROR malloc of Tx  %d bytes failed \n", messageSize);
+    printf("client: HARD ERROR malloc of Tx  %d bytes failed \n", txLength);
     exit(1);
   }
-  memset(TxBuffer, 0, messageSize);
+  memset(TxBuffer, 0, txLength);
   //This pointer is used when packing the header into the network buffer
   TxIntPtr  = (uint32_t *) TxBuffer;
 
@@ -336,14 +542,6 @@ int main(int argc, char *argv[])
   }
   memset(RxBuffer, 0, messageSize);
 
-  //$A1
-  //messageHeaderDefault RxHeader;
-  updatedMessageHeader RxHeader;
-  RxHeaderPtr=&RxHeader;
-
-  //These pointers are  used when packing the header fieldsss  into the network buffer
-  RxIntPtr  = (uint32_t *) RxBuffer;
-
 
   // Tell the system what kind(s) of address info we want
   memset(&addrCriteria, 0, sizeof(addrCriteria)); // Zero out structure
@@ -417,15 +615,6 @@ int main(int argc, char *argv[])
   if (sock < 0)
     DieWithSystemMessage("socket() failed");
 
-  // Set signal handler for alarm signal
-  handler.sa_handler = CatchAlarm;
-  if (sigfillset(&handler.sa_mask) < 0) // Block everything in handler
-    DieWithSystemMessage("sigfillset() failed");
-  handler.sa_flags = 0;
-
-  if (sigaction(SIGALRM, &handler, 0) < 0)
-    DieWithSystemMessage("sigaction() failed for SIGALRM");
-
 
   if (doSampleOutput )
   {
@@ -433,10 +622,66 @@ int main(int argc, char *argv[])
     outputFID = fopen(outputFile,"w");
   }
 
+  if (opMode != opModeRTT)
+    probeWindow = 0;
+  else {
+    pipelined = (probeWindow > 0);
+    if (probeTableInit(&probes, probeWindow, (double)TIMEOUT_SECS, getTimestampD()) != NOERROR) {
+      printf("client: HARD ERROR probe table for a window of %u \n", probeWindow);
+      exit(1);
+    }
+    probeWindow = probes.window;
+    //The window counts datagrams, a GSO message must fit
+    if (probeWindow < (uint32_t)segCount)
+      probeWindow = probes.window = segCount;
+    if (pipelined)
+      printf("client: pipelined RTT, up to %u probes outstanding \n", probeWindow);
+    eventLoopInit(sock);
+  }
+
+  //-T takes precedence over -b, both send through txBatch
+  if (txTimeWindow > 0)
+    sendBatchSize = txTimeWindow;
+  if (sendBatchSize > 0) {
+    if ((opMode != opModeOWD) || useGSO) {
+      printf("client: -T and -b need opMode 1 without -g, ignored \n");
+      txTimeWindow = 0;
+      sendBatchSize = 0;
+    } else {
+      if (messageSize < msgHeaderSize)
+        messageSize = msgHeaderSize;
+      if (txBatchInit(&txBatch, sock, servAddr->ai_addr, servAddr->ai_addrlen, sendBatchSize, messageSize, opMode, (txTimeWindow > 0)) != NOERROR) {
+        printf("client: HARD ERROR batch of %u datagrams: %s \n", sendBatchSize, strerror(errno));
+        exit(1);
+      }
+      sendBatchSize = txBatch.size;
+      if (txTimeWindow > 0) {
+        txTimeWindow = sendBatchSize;
+        printf("client: SO_TXTIME pacing, %u datagrams per sendmmsg (the fq or etf qdisc must be on the egress device) \n", txTimeWindow);
+      } else {
+        //A full socket buffer shows up as EAGAIN rather than a blocked send
+        sockBlockingOff(sock);
+        printf("client: high-rate sender, %u datagrams per sendmmsg, one batch every %4.9f secs \n",
+              sendBatchSize, iterationDelay * (double)sendBatchSize);
+      }
+    }
+  }
+
+
+  pacerInit(&pacer, spinPacing);
+  if (!spinPacing)
+    printf("client: pacer calibrated, wake-up lateness mean:%.1fus max:%.1fus, margin:%.1fus \n",
+          pacer.calibrationMean * 1e6, pacer.calibrationMax * 1e6, pacerMargin(&pacer) * 1e6);
 
   //Must be an accurate timestamp
   TSstartD = getTimestamp(&TSstartTS);
   nextWakeUpTimeD=TSstartD;
+
+  //The batch sender replaces the loop below
+  if (sendBatchSize > 0) {
+    batchSend(iterationDelay, (uint32_t)nIterations, loopForever, sequenceNumber);
+    loopFlag = false;
+  }
   while (loopFlag)
   {
 
@@ -452,24 +697,26 @@ int main(int argc, char *argv[])
       //exit(1);
     }
 
-    //Update the TxHeader
-    TxHeaderPtr->sequenceNum = sequenceNumber++;
-    TxHeaderPtr->timeSentSeconds = msgTxTime.tv_sec;
-    TxHeaderPtr->timeSentNanoSeconds = msgTxTime.tv_nsec;
-    TxHeaderPtr->opMode = opMode;
-
-    //pack the header into the network buffer
-    TxIntPtr  = (uint32_t *) TxBuffer;
-    *TxIntPtr++  = htonl(TxHeaderPtr->sequenceNum);
-    *TxIntPtr++  = htonl(TxHeaderPtr->timeSentSeconds);
-    *TxIntPtr++  = htonl(TxHeaderPtr->timeSentNanoSeconds);
-    TxShortPtr  = (uint16_t *) TxIntPtr;
-    *TxShortPtr++  =  htons(TxHeaderPtr->opMode);
-    txMarker = 0x5555;
-    //Add a marker  
-    *TxShortPtr++  = htons(txMarker);
-
-    rc = NOERROR;
+    //Update the TxHeader - in GSO mode every segment gets its own header
+    firstSeqOfMsg = sequenceNumber;
+    for (seg = 0; seg < segCount; seg++) {
+      TxHeaderPtr->sequenceNum = sequenceNumber++;
+      TxHeaderPtr->timeSentSeconds = msgTxTime.tv_sec;
+      TxHeaderPtr->timeSentNanoSeconds = msgTxTime.tv_nsec;
+      TxHeaderPtr->opMode = opMode;
+
+      //pack the header into the network buffer
+      TxIntPtr  = (uint32_t *) (TxBuffer + (seg * segSize));
+      *TxIntPtr++  = htonl(TxHeaderPtr->sequenceNum);
+      *TxIntPtr++  = htonl(TxHeaderPtr->timeSentSeconds);
+      *TxIntPtr++  = htonl(TxHeaderPtr->timeSentNanoSeconds);
+      TxShortPtr  = (uint16_t *) TxIntPtr;
+      *TxShortPtr++  =  htons(TxHeaderPtr->opMode);
+      txMarker = 0x5555;
+      //Add a marker  
+      *TxShortPtr++  = htons(txMarker);
+    }
+
     numberOfTrials++;
     if ( (!loopForever) &&  (numberOfTrials > nIterations) )
     {
@@ -485,23 +732,42 @@ int main(int argc, char *argv[])
     printf("client: send seqNum:%d  opMode:%d \n",  TxHeaderPtr->sequenceNum, TxHeaderPtr->opMode);
 #endif
 
-    numBytes = sendto(sock, TxBuffer, messageSize, 0,
-      servAddr->ai_addr, servAddr->ai_addrlen);
+    if (useGSO) {
+      //One send, the kernel (or NIC) cuts it into segSize datagrams
+      txIov.iov_base = TxBuffer;
+      txIov.iov_len = txLength;
+      memset(&txMsg, 0, sizeof(txMsg));
+      txMsg.msg_name = servAddr->ai_addr;
+      txMsg.msg_namelen = servAddr->ai_addrlen;
+      txMsg.msg_iov = &txIov;
+      txMsg.msg_iovlen = 1;
+      txMsg.msg_control = txControl;
+      txMsg.msg_controllen = sizeof(txControl);
+      cmsg = CMSG_FIRSTHDR(&txMsg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      *(uint16_t *)CMSG_DATA(cmsg) = (uint16_t)segSize;
+      numBytes = sendmsg(sock, &txMsg, 0);
+    } else {
+      numBytes = sendto(sock, TxBuffer, messageSize, 0,
+        servAddr->ai_addr, servAddr->ai_addrlen);
+    }
     if (numBytes < 0) {
         TxErrorCount++;
 //#ifdef TRACEME
-        perror("client: sendto error \n");
+        LOG_ERRNO(LOG_CAT_TX_ERROR, errno, "client: sendto error");
 //#endif
         continue;
     }
-    else if (numBytes != messageSize){
+    else if (numBytes != txLength){
 //#ifdef TRACEME
-      printf("client: sendto return %d not equal to messageSize:%d \n", (int32_t) numBytes,messageSize);
+      LOG_EVENT(LOG_CAT_TX_ERROR, "client: sendto return %d not equal to messageSize:%d", numBytes, txLength);
 //#endif
         continue;
     }
 
-    totalPacketsSent++;
+    totalPacketsSent += segCount;
     totalBytesSent+=numBytes;
     timeOfLastTxedMsg = wallTime;
     if (timeOfFirstTxedMsg == -1.0)
@@ -509,98 +775,30 @@ int main(int argc, char *argv[])
       timeOfFirstTxedMsg = wallTime;
     }
 
-    //If opModeRTT -  
+    //The replies are taken by the event loop while waiting for the next send
     if (opMode == opModeRTT)
     {
-
-      // Receive a response
-
-      // Set length of from address structure (in-out parameter)
-      fromAddrLen = sizeof(fromAddr);
-      alarm(TIMEOUT_SECS); // Set the timeout
-
-      //returns -1 on error else bytes received
-      rc =  recvfrom(sock, RxBuffer, messageSize, 0, (struct sockaddr *) &fromAddr, &fromAddrLen);
-      if (rc == ERROR) 
-      {
-        if (errno == EINTR) {     // Alarm went off
-//#ifdef TRACEME
-          printf("client: recvfrom error EINTR, numberTOs:%d \n",numberTOs);
-//#endif
-          rc = NOERROR;
-          continue;
-        } else {
-          RxErrorCount++;
-//#ifdef TRACEME
-          perror("client: recvfrom other error \n");
-//#endif
-        }
-      } else 
-      {
-        //succeeded!
-        totalPacketsRxed++;
-        numBytes=rc;
-        RxedMsgSize = rc;
-        alarm(0);
-        if (RxedMsgSize != messageSize)
-        {
-          printf("client: HARD ERROR, opModeRTT but did not receive a valid msg?  RxedMsgSize:%d  messageSize:%d \n", RxedMsgSize, messageSize);
-        }
- //Obtain RTT sample
-        Tstop =  getTimestampD();
-        RTTSample= Tstop - Tstart;
-        RTTSum += RTTSample;
-        numberRTTSamples++;
-        //Init the filter
-        if (numberRTTSamples == 1) {
-          smoothedRTT = RTTSample;
-        } else {
-          smoothedRTT = alpha*RTTSample + (1-alpha)*smoothedRTT;
-        }
-        rc = NOERROR;
-        receivedCount++;
-        wallTime = getCurTimeD();
-
-        RxIntPtr  = (uint32_t *) RxBuffer;
-        RxHeaderPtr->sequenceNum =  ntohl(*RxIntPtr++);
-        RxHeaderPtr->timeSentSeconds =  ntohl(*RxIntPtr++);
-        RxHeaderPtr->timeSentNanoSeconds  =  ntohl(*RxIntPtr++);
-
-        RxShortPtr  = (uint16_t *)RxIntPtr;
-        RxHeaderPtr->opMode = ntohs(*RxShortPtr++);
-        RxedOpMode = RxHeaderPtr->opMode;
-
-#ifdef TRACEME
-        printf("%f %d %d %4.9f %4.9f %d %d\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, RTTSample, smoothedRTT, receivedCount,  numberRTTSamples);
-#endif
-
-        if (doSampleOutput)
-        {
-          fprintf(outputFID, "%f %d %d %4.9f %4.9f %d %d\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, RTTSample, smoothedRTT, receivedCount,  numberRTTSamples);
-        }
-
-
-
-#ifdef TRACEME
-        printf("client: succeeded to recv %d bytes from server \n", (int) numBytes);
-        printf("Rxed: %d %d %d %d \n", 
-             RxHeaderPtr->sequenceNum, (int32_t)RxHeaderPtr->opMode,
-             RxHeaderPtr->timeSentSeconds, RxHeaderPtr->timeSentNanoSeconds);
-#endif
-      }  //else succeeded to recvfrom
-
+      for (seg = 0; seg < segCount; seg++)
+        probeTableSent(&probes, firstSeqOfMsg + seg, Tstart);
     }
 
     //delay requested amount
 
-    //This busyWaits until time delayTime (based on clock_gettime with CLOCK_MONOTONIC)
+    //Sleeps, then spins, until nextWakeUpTimeD (CLOCK_MONOTONIC_RAW)
     nextWakeUpTimeD += iterationDelay;
-    rc = busyWait(nextWakeUpTimeD);
+    if (opMode == opModeRTT)
+      probeWait(sock, RxBuffer, messageSize, nextWakeUpTimeD, segCount, false);
+    else
+      pacerWait(&pacer, nextWakeUpTimeD);
 
     //rc = nanosleep((const struct timespec*)&reqDelay, &remDelay);
 
   }  //while loopFlag true
 
+  //The replies still in flight, until they arrive or time out
+  if (opMode == opModeRTT)
+    probeWait(sock, RxBuffer, messageSize, getTimestampD() + TIMEOUT_SECS, 0, true);
+
   //Send a message to the server so it can exit...
   // Will be a reduced size: 16 octets
   int32_t reducedControlMsgSize=16;
@@ -648,9 +846,303 @@ int main(int argc, char *argv[])
   exit(0);
 }
 
-// Handler for SIGALRM
-void CatchAlarm(int ignored) {
-  numberTOs++;
+/*************************************************************
+*
+* Function: void recordRTTSample(double RTTSample, int32_t RxedMsgSize)
+* 
+* Summary: Adds an RTT sample to the statistics (mean, smoothed, the
+*          histogram and the delay variation) and writes its line to
+*          the output file.  RxedOpMode is the reply's.
+*
+***************************************************************/
+void recordRTTSample(double RTTSample, int32_t RxedMsgSize)
+{
+  RTTSum += RTTSample;
+  numberRTTSamples++;
+  latencyHistogramRecord(&RTTHist, (int64_t)(RTTSample * 1000000000.0));
+  //Init the filter
+  if (numberRTTSamples == 1) {
+    smoothedRTT = RTTSample;
+    minRTT = RTTSample;
+  } else {
+    smoothedRTT = alpha*RTTSample + (1-alpha)*smoothedRTT;
+    //Consecutive samples, a timeout in between does not break the pair
+    RTTJitter += (fabs(RTTSample - lastRTTSample) - RTTJitter) * RTT_JITTER_GAIN;
+    IPDVAbsSum += fabs(RTTSample - lastRTTSample);
+    numberIPDV++;
+    if (RTTSample < minRTT)
+      minRTT = RTTSample;
+  }
+  lastRTTSample = RTTSample;
+  receivedCount++;
+  wallTime = getCurTimeD();
+
+#ifdef TRACEME
+  printf("%f %d %d %4.9f %4.9f %d %d\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, RTTSample, smoothedRTT, receivedCount,  numberRTTSamples);
+#endif
+
+  if (doSampleOutput)
+  {
+    fprintf(outputFID, "%f %d %d %4.9f %4.9f %d %d\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, RTTSample, smoothedRTT, receivedCount,  numberRTTSamples);
+  }
+}
+
+/*************************************************************
+*
+* Function: void eventLoopInit(int sock)
+* 
+* Summary: Creates the opModeRTT event loop:  an epoll set with the
+*          socket and the pacing timerfd
+*
+***************************************************************/
+void eventLoopInit(int sock)
+{
+  struct epoll_event event;
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0)
+    DieWithSystemMessage("epoll_create1() failed");
+  pacingTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (pacingTimerFd < 0)
+    DieWithSystemMessage("timerfd_create() failed");
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = sock;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &event) < 0)
+    DieWithSystemMessage("epoll_ctl() failed for the socket");
+  event.data.fd = pacingTimerFd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pacingTimerFd, &event) < 0)
+    DieWithSystemMessage("epoll_ctl() failed for the timerfd");
+}
+
+/*************************************************************
+*
+* Function: void probeReceive(int sock, char *RxBuffer, int32_t bufferSize)
+* 
+* Summary: Takes every reply that is waiting on the socket and matches
+*          it to its probe by the echoed sequence number.  Only answered
+*          probes are RTT samples, see ProbeTable.h for the others.
+*
+***************************************************************/
+void probeReceive(int sock, char *RxBuffer, int32_t bufferSize)
+{
+  struct sockaddr_storage fromAddr;
+  socklen_t fromAddrLen = 0;
+  ssize_t numBytes = 0;
+  double RTTSample = 0.0;
+  uint32_t seq = 0;
+
+  while (true) {
+    fromAddrLen = sizeof(fromAddr);
+    numBytes = recvfrom(sock, RxBuffer, bufferSize, MSG_DONTWAIT, (struct sockaddr *) &fromAddr, &fromAddrLen);
+    if (numBytes < 0) {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+        RxErrorCount++;
+        LOG_ERRNO(LOG_CAT_RX_ERROR, errno, "client: recvfrom other error");
+      }
+      return;
+    }
+    totalPacketsRxed++;
+    if (numBytes < (ssize_t)MESSAGEMIN) {
+      RxErrorCount++;
+      LOG_EVENT(LOG_CAT_RX_ERROR, "client: reply of %d bytes is too short", numBytes);
+      continue;
+    }
+    seq = ntohl(*(uint32_t *)RxBuffer);
+    RxedOpMode = ntohs(*(uint16_t *)(RxBuffer + 3 * sizeof(uint32_t)));
+    if (probeTableReply(&probes, seq, getTimestampD(), &RTTSample) == PROBE_REPLY_ANSWERED)
+      recordRTTSample(RTTSample, (int32_t)numBytes);
+  }
+}
+
+/*************************************************************
+*
+* Function: void probeWait(int sock, char *RxBuffer, int32_t bufferSize,
+*                          double deadline, uint32_t needed, bool untilIdle)
+* 
+* Summary: The event loop between two sends:  takes replies and times
+*          out probes until deadline (getTimestampD() time) has passed
+*          and the window has room for needed more probes.  With
+*          untilIdle it returns as soon as nothing is outstanding.
+*
+* notes:  Sleeps in epoll_wait until a reply or the pacing timerfd,
+*         armed for the pacer's margin before the deadline (or the next
+*         probe timeout on the wheel), then polls the socket for the
+*         rest so the sends keep busyWait's pacing.  The timerfd's
+*         lateness tunes the margin, like the pacer's own sleeps.  It is
+*         armed relative:  getTimestampD() is CLOCK_MONOTONIC_RAW,
+*         which timerfd does not offer.  No signals, and one
+*         timerfd_settime per change of wake-up time rather than two
+*         alarm() calls per probe.
+*
+***************************************************************/
+void probeWait(int sock, char *RxBuffer, int32_t bufferSize, double deadline, uint32_t needed, bool untilIdle)
+{
+  struct epoll_event events[2];
+  struct itimerspec pacing;
+  uint64_t expirations = 0;
+  double start = getTimestampD();
+  double now = 0.0;
+  double wakeUp = 0.0;
+  double expiry = 0.0;
+  double armedWakeUp = -1.0;
+  uint32_t expired = 0;
+  bool heldBack = false;
+  int count = 0;
+  int i = 0;
+
+  memset(&pacing, 0, sizeof(pacing));
+  while (true) {
+    probeReceive(sock, RxBuffer, bufferSize);
+    now = getTimestampD();
+    expired = probeTableExpire(&probes, now);
+    if (expired > 0) {
+      numberTOs += expired;
+      LOG_EVENT(LOG_CAT_TIMEOUT, "client: %u probes timed out, numberTOs:%d", expired, numberTOs);
+    }
+    if (untilIdle && (probes.outstanding == 0))
+      return;
+    if (now >= deadline) {
+      if (probeTableHasRoom(&probes, needed)) {
+        //A send held back by the window is not late by the pacing
+        if (!untilIdle && !heldBack)
+          pacerRecordSend(&pacer, deadline, start, now);
+        return;
+      }
+      if (!heldBack)
+        probes.windowFull++;
+      heldBack = true;
+    }
+
+    //Sleep until the deadline or the next timeout, whichever is first.
+    //A reply ends the sleep early
+    wakeUp = deadline;
+    expiry = probeTableNextExpiry(&probes);
+    if ((expiry >= 0.0) && ((expiry < wakeUp) || (now >= deadline)))
+      wakeUp = expiry;
+    if (wakeUp - now <= pacerMargin(&pacer))
+      continue;
+    wakeUp -= pacerMargin(&pacer);
+    if (wakeUp != armedWakeUp) {
+      pacing.it_value.tv_sec = (time_t)floor(wakeUp - now);
+      pacing.it_value.tv_nsec = (long)((wakeUp - now - (double)pacing.it_value.tv_sec) * 1000000000.0);
+      if (timerfd_settime(pacingTimerFd, 0, &pacing, NULL) < 0)
+        DieWithSystemMessage("timerfd_settime() failed");
+      armedWakeUp = wakeUp;
+    }
+
+    count = epoll_wait(epollFd, events, 2, -1);
+    for (i = 0; i < count; i++) {
+      if (events[i].data.fd == pacingTimerFd) {
+        //May be left over from an earlier wait, then it is rearmed
+        if (read(pacingTimerFd, &expirations, sizeof(expirations)) > 0) {
+          if (armedWakeUp >= 0.0)
+            pacerObserveWake(&pacer, armedWakeUp, getTimestampD());
+          armedWakeUp = -1.0;
+        }
+      }
+    }
+  }
+}
+
+
+/*************************************************************
+*
+* Function: void batchSend(double iterationDelay, uint32_t nIterations,
+*                          bool loopForever, uint32_t sequenceNumber)
+* 
+* Summary: The opModeOWD send loop of the batch modes:  patches the
+*          sequence numbers and timestamps of sendBatchSize pre-built
+*          datagrams and sends them with one sendmmsg (txBatchSend).
+*
+*          -b:  batch k goes out at k * sendBatchSize * iterationDelay,
+*          so the requested rate holds at batch granularity;  a batch
+*          that is already late goes at once (the pacer counts it as
+*          behind, the sender is the limit).  One timestamp per batch:
+*          its datagrams do leave back to back, and the server's OWD
+*          and IPDV see them as the burst they are.
+*
+*          -T (SO_TXTIME):  each datagram is stamped with its departure
+*          time, iterationDelay apart, the first TXTIME_LEAD_SECS after
+*          the start, and the loop sleeps until the first of a window is
+*          due before queuing the next.  The qdisc holds at most two
+*          windows, under fq's default flow_limit of 100 packets as the
+*          window is at most TXTIME_MAX_WINDOW.  The header timestamp is the departure time
+*          (CLOCK_REALTIME) rather than the time of the sendmmsg, so the
+*          server's OWD does not count the time a datagram waited in the
+*          qdisc.  Returns after the last window has departed, so the
+*          terminate message does not overtake it.
+*
+* notes:  The clocks are read once per batch.  The send ends with the
+*         last batch's time slot (count * iterationDelay after its
+*         start), or when its sendmmsg returned if that is later, so the
+*         achieved rate counts every datagram of the last batch over
+*         the time they took.
+*
+***************************************************************/
+void batchSend(double iterationDelay, uint32_t nIterations, bool loopForever, uint32_t sequenceNumber)
+{
+  struct timespec monoTS;
+  struct timespec realTS;
+  struct timespec sentTS;
+  bool txTime = txBatch.txTime;
+  double departure = getTimestampD() + (txTime ? TXTIME_LEAD_SECS : 0.0);
+  double batchStart = 0.0;
+  double now = 0.0;
+  double offset = 0.0;
+  double wall = 0.0;
+  uint64_t monoNs = 0;
+  uint32_t count = 0;
+  uint32_t sent = 0;
+  uint32_t i = 0;
+
+  while (loopForever || (numberOfTrials < nIterations)) {
+    count = sendBatchSize;
+    if (!loopForever && (nIterations - numberOfTrials < count))
+      count = nIterations - numberOfTrials;
+    if (sequenceNumber > MAX_UINT32 - 1 - count) {
+      printf("client: HARD ERROR: Exceeded the sequence number range.... next seqNu:%d \n", sequenceNumber);
+      break;
+    }
+
+    now = getTimestampD();
+    (void) clock_gettime(CLOCK_MONOTONIC, &monoTS);
+    (void) clock_gettime(CLOCK_REALTIME, &realTS);
+    monoNs = (uint64_t)monoTS.tv_sec * 1000000000ULL + (uint64_t)monoTS.tv_nsec;
+    wall = convertTS2D(&realTS);
+    sentTS = realTS;
+    for (i = 0; i < count; i++) {
+      if (txTime) {
+        offset = departure + (double)i * iterationDelay - now;
+        wall = convertTS2D(&realTS) + offset;
+        (void) convertD2TS(&wall, &sentTS);
+        txBatchStamp(&txBatch, i, sequenceNumber + i, &sentTS, monoNs + (uint64_t)(int64_t)(offset * 1000000000.0));
+      } else
+        txBatchStamp(&txBatch, i, sequenceNumber + i, &sentTS, 0);
+      if (timeOfFirstTxedMsg == -1.0)
+        timeOfFirstTxedMsg = wall;
+    }
+    sent = txBatchSend(&txBatch, count);
+    if (sent < count) {
+      TxErrorCount += count - sent;
+      LOG_ERRNO(LOG_CAT_TX_ERROR, txBatch.lastErrno, "client: sendmmsg error");
+    }
+    numberOfTrials += count;
+    sequenceNumber += count;
+    totalPacketsSent += sent;
+    totalBytesSent += (uint64_t)sent * (uint64_t)txBatch.messageSize;
+    txBatchDrainErrors(&txBatch);
+
+    batchStart = departure;
+    departure += (double)count * iterationDelay;
+    timeOfLastTxedMsg = fmax(getCurTimeD(), convertTS2D(&realTS) + (departure - now));
+    pacerWait(&pacer, txTime ? batchStart : departure);
+  }
+
+  if (txTime)
+    pacerWait(&pacer, departure);
+  txBatchDrainErrors(&txBatch);
 }
 
 
@@ -661,6 +1153,11 @@ void clientCNTCCode()
   uint32_t totalLost = 0;
   double duration = 0.0;
   double avgSendrate = 0.0;
+  double achievedPPS = 0.0;
+  double requestedPPS = 0.0;
+  LatencyPercentiles RTT;
+  double meanIPDV = 0.0;
+  double p999PDV = 0.0;
 
   wallTime = getCurTimeD();
   endTime = wallTime;
@@ -670,7 +1167,10 @@ void clientCNTCCode()
   if (duration > 0.0) 
   {
     avgSendrate = ( (double)totalBytesSent * 8.0) / duration;
+    achievedPPS = (double)totalPacketsSent / duration;
   }
+  if (txBatch.messageSize > 0)
+    requestedPPS = requestedRate / ((double)txBatch.messageSize * 8.0);
 
   if (opMode == opModeRTT)
   {
@@ -679,21 +1179,51 @@ void clientCNTCCode()
     } 
 
 
-    totalLost=numberTOs;
+    //A late reply was counted when its probe timed out, it was not lost
+    totalLost = (uint32_t)probeTableLost(&probes);
     if (totalPacketsSent  >  0) {
       avgLossRate = ((double)totalLost) / (double)totalPacketsSent;
     }
 
   }
 
-  printf("wallTime duration avgRTT avgSendrate avgLossRate numberRTTSamples totalLost totalPacketsSent \n");
-  printf("%12.6f %6.6f %4.9f %12.0f %2.4f %d %d %d \n",
-          wallTime, duration, avgRTT, avgSendrate, avgLossRate, numberRTTSamples,totalLost,totalPacketsSent);
+  //Write out the queued messages before the summary
+  asyncLogFlush();
+  asyncLogPrintStats(stdout);
+  pacerPrintStats(&pacer, stdout);
+  if (sendBatchSize > 0) {
+    //behind:  batches already late, the sender is the limit.
+    //EAGAIN/ENOBUFS:  the socket buffer or device queue is
+    printf("sender: batch:%u requested:%.0f bps %.0f pps achieved:%.0f bps %.0f pps (%.1f%%) batches:%lu behind:%lu partial:%lu EAGAIN:%lu ENOBUFS:%lu unsent:%lu \n",
+          sendBatchSize, requestedRate, requestedPPS, avgSendrate, achievedPPS,
+          (requestedRate > 0.0) ? 100.0 * avgSendrate / requestedRate : 0.0,
+          txBatch.batches, pacer.behind, txBatch.partial, txBatch.eagain, txBatch.enobufs, txBatch.unsent);
+  }
+  if (txTimeWindow > 0)
+    printf("txtime: window:%u missed:%lu invalid:%lu \n", txTimeWindow, txBatch.txTimeMissed, txBatch.txTimeInvalid);
+  if (opMode == opModeRTT) {
+    printf("RTT probes: window:%u sent:%lu answered:%lu late:%lu duplicate:%lu stale:%lu lost:%lu unexpected:%lu windowFull:%lu \n",
+          probeWindow, probes.sent, probes.answered, probes.late, probes.duplicates, probes.stale,
+          probeTableLost(&probes), probes.unexpected, probes.windowFull);
+  }
+
+  //All zero unless opModeRTT
+  latencyHistogramPercentiles(&RTTHist, &RTT);
+  if (numberIPDV > 0)
+    meanIPDV = IPDVAbsSum / (double)numberIPDV;
+  if (numberRTTSamples > 0)
+    p999PDV = fmax(RTT.p999 - minRTT, 0.0);
+
+  printf("wallTime duration avgRTT avgSendrate avgLossRate numberRTTSamples totalLost totalPacketsSent p50RTT p90RTT p99RTT p999RTT jitter meanIPDV p999PDV \n");
+  printf("%12.6f %6.6f %4.9f %12.0f %2.4f %d %d %d %4.9f %4.9f %4.9f %4.9f %4.9f %4.9f %4.9f \n",
+          wallTime, duration, avgRTT, avgSendrate, avgLossRate, numberRTTSamples,totalLost,totalPacketsSent,
+          RTT.p50, RTT.p90, RTT.p99, RTT.p999, RTTJitter, meanIPDV, p999PDV);
 
   if (doSampleOutput )
   {
-    fprintf(outputFID,"%12.6f %6.6f %4.9f %12.0f %2.4f %d %d %d \n",
-          wallTime, duration, avgRTT, avgSendrate, avgLossRate, numberRTTSamples,totalLost,totalPacketsSent);
+    fprintf(outputFID,"%12.6f %6.6f %4.9f %12.0f %2.4f %d %d %d %4.9f %4.9f %4.9f %4.9f %4.9f %4.9f %4.9f \n",
+          wallTime, duration, avgRTT, avgSendrate, avgLossRate, numberRTTSamples,totalLost,totalPacketsSent,
+          RTT.p50, RTT.p90, RTT.p99, RTT.p999, RTTJitter, meanIPDV, p999PDV);
     fclose(outputFID);
   }
 
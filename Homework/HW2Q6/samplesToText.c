@@ -0,0 +1,152 @@
+/*********************************************************
+*
+* Module Name: samplesToText program
+*
+* File Name:  samplesToText.c
+*
+* Summary:  Converts the server's binary sample capture files
+*           (serverSamples.NNNN.bin, see SampleCapture.h) to the text
+*           layout of the old serverSamplesArray.dat, one sample per line:
+*             rxTime(secs) OWD(secs) seqNo
+*           which is what easyPlot.m and the other Octave scripts read.
+*
+* Invocation:
+*        samplesToText [-f flow] [-l] <capture file>... > serverSamplesArray.dat
+*
+*        -f flow : only the samples of this flow (the id on the server's
+*                  "flow" summary lines)
+*        -l      : long form, adds the size and flow columns
+*
+* Revisions:
+*   10/17/26: file version 2, compressed blocks
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "SampleCapture.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int convertFile(const char *path, bool filterFlow, uint32_t flowId, bool longForm, FILE *out);
+
+int main(int argc, char *argv[])
+{
+  bool filterFlow = false;
+  bool longForm = false;
+  uint32_t flowId = 0;
+  int opt = 0;
+  int rc = 0;
+  int i = 0;
+
+  while ((opt = getopt(argc, argv, "f:l")) != -1) {
+    switch (opt) {
+    case 'f':
+      filterFlow = true;
+      flowId = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'l':
+      longForm = true;
+      break;
+    default:
+      DieWithUserMessage("Parameter(s)", "[-f flow] [-l] <capture file>...");
+    }
+  }
+  if (optind >= argc)
+    DieWithUserMessage("Parameter(s)", "[-f flow] [-l] <capture file>...");
+
+  for (i = optind; i < argc; i++) {
+    if (convertFile(argv[i], filterFlow, flowId, longForm, stdout) == ERROR)
+      rc = 1;
+  }
+  return rc;
+}
+
+//Prints the samples of one file, block by block.  Stops at the header's
+//dataBytes or at the first bad block (a file cut short by a crash)
+static int convertFile(const char *path, bool filterFlow, uint32_t flowId, bool longForm, FILE *out)
+{
+  struct stat st;
+  const uint8_t *map = NULL;
+  const SampleFileHeader *header = NULL;
+  SampleRecord *records = NULL;
+  uint32_t maxRecords = 0;
+  size_t end = 0;
+  size_t pos = 0;
+  int rc = NOERROR;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    perror(path);
+    return ERROR;
+  }
+  if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(SampleFileHeader))) {
+    fprintf(stderr, "%s: not a sample capture file\n", path);
+    close(fd);
+    return ERROR;
+  }
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(path);
+    return ERROR;
+  }
+
+  header = (const SampleFileHeader *)map;
+  if ((header->magic != SAMPLE_FILE_MAGIC) || (header->version != SAMPLE_FILE_VERSION) ||
+      (header->columns != SAMPLE_COLUMNS)) {
+    fprintf(stderr, "%s: not a version %d sample capture file\n", path, SAMPLE_FILE_VERSION);
+    munmap((void *)map, (size_t)st.st_size);
+    return ERROR;
+  }
+
+  pos = header->headerSize;
+  end = pos + header->dataBytes;
+  if (end > (size_t)st.st_size)
+    end = (size_t)st.st_size;
+
+  while (pos + sizeof(SampleBlockHeader) <= end) {
+    const SampleBlockHeader *block = (const SampleBlockHeader *)(map + pos);
+    size_t paddedBytes = ((size_t)block->bytes + 7) & ~(size_t)7;
+    uint32_t i = 0;
+
+    if ((block->magic != SAMPLE_BLOCK_MAGIC) || (pos + sizeof(SampleBlockHeader) + paddedBytes > end))
+      break;
+    //Every group takes at least its count and width bytes
+    if (block->count > (block->bytes / (1 + SAMPLE_COLUMNS) + 1) * SAMPLE_GROUP_RECORDS) {
+      fprintf(stderr, "%s: bad block at offset %lu\n", path, (unsigned long)pos);
+      rc = ERROR;
+      break;
+    }
+    if (block->count > maxRecords) {
+      SampleRecord *bigger = realloc(records, (size_t)block->count * sizeof(SampleRecord));
+      if (bigger == NULL) {
+        rc = ERROR;
+        break;
+      }
+      records = bigger;
+      maxRecords = block->count;
+    }
+    if (sampleChunkDecode((const uint8_t *)(block + 1), block->bytes, block->count, records) == ERROR) {
+      fprintf(stderr, "%s: bad block at offset %lu\n", path, (unsigned long)pos);
+      rc = ERROR;
+      break;
+    }
+    for (i = 0; i < block->count; i++) {
+      const SampleRecord *r = &records[i];
+      if (filterFlow && (r->flow != flowId))
+        continue;
+      if (longForm)
+        fprintf(out, "%12.9f %4.9f %d %u %u \n", (double)r->rxTimeNs / 1000000000.0,
+                (double)r->owdNs / 1000000000.0, r->seq, r->size, r->flow);
+      else
+        fprintf(out, "%12.9f %4.9f %d \n", (double)r->rxTimeNs / 1000000000.0,
+                (double)r->owdNs / 1000000000.0, r->seq);
+    }
+    pos += sizeof(SampleBlockHeader) + paddedBytes;
+  }
+
+  free(records);
+  munmap((void *)map, (size_t)st.st_size);
+  return rc;
+}
@@ -8,7 +8,44 @@
 *    UDP-based performance tool, hardened against DDoS attacks.
 *  
 * Usage:
-*     server <service> [outputFile] [maxRate] [whitelist]
+*     server <service> [outputFile] [maxRate] [whitelist] [-b batchSize] [-w workers] [-p] [-u] [-g] [-t] [-c maxClients] [-B burst] [-R replayWindow] [-S samplesFileMB] [-I reportMs] [-L statsName] [-P ringRecords]
+*
+*     -b batchSize : number of datagrams drained per recvmmsg (and echoed
+*                    per sendmmsg).  1 (the default) uses recvfrom/sendto.
+*     -w workers   : number of receive threads, each with its own SO_REUSEPORT
+*                    socket.  A flow steering program keeps a client on one worker.
+*     -p           : pin worker i to cpu i
+*     -u           : use the io_uring engine (multishot recvmsg + provided
+*                    buffer ring, echoes via IORING_OP_SENDMSG).  Falls back
+*                    to the -b loops when the kernel lacks io_uring.
+*     -g           : enable UDP_GRO.  A client's GSO segments (client -g) arrive
+*                    coalesced, each segment is accounted separately and the
+*                    echoes go back as one UDP_SEGMENT (GSO) send.
+*     -t           : time arrivals with getCurTimeD() after the filters instead of
+*                    the kernel's SO_TIMESTAMPNS receive timestamp (the default).
+*     -c maxClients: number of client (source address+port) records kept, the least
+*                    recently used is evicted when full.  Default 1048576.
+*     -B burst     : packets a client may send back to back before maxRate applies.
+*                    Default maxRate (one second's worth).
+*     -R replayWindow: packets a late arrival may be behind the highest sequence
+*                    number and still be accepted (once).  Rounded up, default
+*                    960, at most 16320.  Duplicates and older packets are dropped.
+*     -S samplesFileMB: size at which the sample capture moves on to the next
+*                    file (CREATESAMPLEARRAYS), default 64.
+*     -I reportMs  : print an interval report line every reportMs milliseconds
+*                    (100 to 10000) for the interval just ended, see
+*                    intervalReportThread.  Off by default.
+*     -L statsName : publish live statistics (totals, OWD histogram, per flow
+*                    stats) in the shared memory segment /statsName every
+*                    100 ms, udpecho-stat statsName shows them.  Off by default.
+*     -P ringRecords: pipeline the accounting:  each worker only receives,
+*                    filters and echoes, and hands each packet to its stats
+*                    thread through a ring of ringRecords (rounded up to a
+*                    power of 2, at least 1024), see StatsRing.h.  Off by
+*                    default, the workers account inline.
+*
+*     The whitelist file holds one IPv4 or IPv6 address or CIDR prefix per
+*     line (# starts a comment).   kill -HUP reloads it without a restart.
 *
 * A1: 3/12/2025:  Prepping to add support for opMode 1    CBR behavior....NO ECHO!
 *                 Fixed iteration count off by 1,  cleaned up output a bit
@@ -28,9 +65,63 @@
 *             - Size validation
 *             - Authentication tokens
 *
-* Last updated: 5/8/2025
+* A5: 10/17/26 Added batched I/O (recvmmsg/sendmmsg), see -b batchSize.
+*              Per message processing moved into processRxedMessage so the
+*              classic and batched loops share the same accounting.
+*              Added SO_REUSEPORT worker threads (-w, -p).  The loss/OWD
+*              counters moved into a per worker WorkerState.
+*              Added the io_uring engine (-u), see rxLoopUring and UringHelper.c
+*              Added UDP GRO receive and GSO echo (-g), see processRxedDatagram
+*              OWD samples use the kernel receive timestamp (SO_TIMESTAMPNS)
+*              when there is one, see -t
+*              Clients and the whitelist use binary dual-stack NetAddrKeys
+*              (address+port), text is only formatted when logging
+*              The client table is a sharded hash table with LRU eviction (-c),
+*              see ClientTable.c
+*              Rate limiting is an integer GCRA token bucket (one word per
+*              client, under its shard lock), on a clock read once per
+*              batch (-B burst)
+*              The whitelist takes CIDR prefixes into a longest prefix match
+*              trie (PrefixTrie.c) and is reloaded on SIGHUP, the new trie
+*              is swapped in RCU style, see whitelistReloadThread
+*              Per packet messages (drops, errors, sequence warnings) go
+*              through the AsyncLog rings with per category rate limits
+*              Sequence, loss and OWD accounting is per flow (client
+*              address+port) in FlowSessions kept in the client table, so
+*              concurrent clients no longer corrupt each other's gap
+*              counts.  The summary lists the flows and then the aggregate
+*              The replay check is a sliding window bitmap per flow (-R,
+*              ReplayWindow.c):  reordered packets are accepted and
+*              accounted (RFC 4737 reordering extent histograms), only
+*              duplicates and packets behind the window are dropped
+*              CREATESAMPLEARRAYS no longer fills capped arrays that are
+*              printed at the end:  samples stream to rotating binary
+*              files (SampleCapture.c, -S), samplesToText converts them
+*              The captured samples are delta, zig-zag and bit-packed
+*              per column, the summary prints the bytes per sample
+*              OWD percentiles (p50 p90 p99 p99.9) per flow and overall,
+*              from LatencyHistograms, close the summary lines
+*              Interval reports (-I):  a reporter thread diffs the workers'
+*              running counters every interval, see intervalReportThread
+*              Live statistics in POSIX shared memory (-L), updated under a
+*              seqlock by liveStatsThread, read by udpecho-stat
+*              Loss and good run length histograms and a Gilbert-Elliott
+*              fit in the summary (FlowSession.c), CREATEGAPARRAY is off
+*              RFC 3550 jitter and RFC 5481 IPDV/PDV per flow, in the
+*              summary lines, the interval reports and the live stats
+*              Receive/statistics pipeline (-P):  the flow accounting, sample
+*              capture and outputFile lines move to a stats thread per
+*              worker fed through an SPSC ring (StatsRing.c), see statsThread
+*              SIGINT is taken by shutdownSignalThread (sigwait), not a
+*              handler:  CNTCCode takes locks and joins threads.  It runs
+*              once, whether SIGINT or a terminate signal gets there first
+*
+* Last updated: 10/17/2026
 *
 *********************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for recvmmsg/sendmmsg */
+#endif
 #include "UDPEcho.h"
 #include "AddressHelper.h"
 #include "utils.h"
@@ -40,47 +131,124 @@
 #include <arpa/inet.h>
 #include <sys/select.h>
 #include <pthread.h>
-
-#define MAX_WHITELISTED_IPS 100
-#define MAX_CLIENTS 1000
+#include <sched.h>          /* for cpu_set_t, CPU_SET */
+#include <linux/filter.h>   /* for the SO_ATTACH_REUSEPORT_CBPF program */
+#include <netinet/udp.h>    /* for UDP_GRO, UDP_SEGMENT */
+#include "UringHelper.h"
+#include "ClientTable.h"
+#include "ReplayWindow.h"
+#include "SampleCapture.h"
+#include "PrefixTrie.h"
+#include "AsyncLog.h"
+#include "StatsRing.h"
+#include "LiveStats.h"
+
+#define WHITELIST_LINE_SIZE 256
+#define DEFAULT_MAX_CLIENTS (1 << 20) // tracked sources, least recently used are evicted
 #define DEFAULT_MAX_RATE 1000 // Maximum packets per second per client
-#define TOKEN_BUCKET_REFILL_INTERVAL 0.01 // Refill token bucket every 10ms
+#define NANOS_PER_SEC 1000000000ULL
 #define CLIENT_TIMEOUT 300 // Seconds until a client connection times out
 #define AUTH_TOKEN_SIZE 16
 #define CONNECTION_LIFETIME 120 // 2 minutes max lifetime for a connection
 #define BUFFER_CLEANUP_INTERVAL 15 // Cleanup stale connections every 15 seconds
 
+#define DEFAULT_BATCH_SIZE 1 // 1 selects the classic recvfrom/sendto loop
+#define MAX_BATCH_SIZE 1024  // recvmmsg/sendmmsg vlen is capped at UIO_MAXIOV
+
+#define DEFAULT_NUM_WORKERS 1 // 1 runs the receive loop on the main thread only
+#define MAX_WORKERS 64
+#define CACHE_LINE_SIZE 64
+#define MAX_FLOWS_LISTED 256 // per flow lines in the summary
+#define MIN_REPORT_INTERVAL_MS 100
+#define MAX_REPORT_INTERVAL_MS 10000
+
+//Receive/echo engines
+#define IO_ENGINE_CLASSIC 0  // recvfrom/sendto
+#define IO_ENGINE_BATCHED 1  // recvmmsg/sendmmsg
+#define IO_ENGINE_URING 2    // io_uring multishot recvmsg + sendmsg
+
+#define URING_QUEUE_DEPTH 256
+#define URING_NUM_BUFFERS 256  // provided buffers per worker, must be a power of 2
+#define URING_BUF_GROUP 0
+#define URING_UD_RECV (1ULL << 32)  // user_data of the multishot recv
+#define URING_UD_SEND (2ULL << 32)  // user_data of an echo, low 16 bits are the buffer id
+
+//Per client verdicts, decided under the client's shard lock
+#define CLIENT_OK 0
+#define CLIENT_RATE_LIMITED 1
+#define CLIENT_TOO_LARGE 2
+#define CLIENT_AUTH_FAILED 3
+#define CLIENT_REPLAY 4
+
+//Possible outcomes of processRxedMessage
+#define RX_DROP 0       // counted as an error or dropped by a filter
+#define RX_DONE 1       // accounted for, nothing to send back
+#define RX_ECHO 2       // accounted for, the buffer holds the echo to send back
+#define RX_TERMINATE 3  // the client's terminate signal
+
+//Log categories, see serverLogCategories
+#define LOG_CAT_RX_ERROR 0
+#define LOG_CAT_TX_ERROR 1
+#define LOG_CAT_WHITELIST 2
+#define LOG_CAT_RATE_LIMIT 3
+#define LOG_CAT_AUTH 4
+#define LOG_CAT_REPLAY 5
+#define LOG_CAT_SEQUENCE 6
+#define LOG_CAT_CONTROL 7
+
+//Ancillary data buffers for recvmsg/sendmsg
+#define RX_CONTROL_SIZE 256
+#define TX_CONTROL_SIZE CMSG_SPACE(sizeof(uint16_t))  // one UDP_SEGMENT cmsg
+
 void CatchAlarm(int ignored);
 void CNTCCode();
 void* connectionCleanupThread(void* arg);
-bool isIPWhitelisted(const char* ip);
+void* intervalReportThread(void* arg);
+void* liveStatsThread(void* arg);
+void* statsThread(void* arg);
+bool isIPWhitelisted(const PrefixTrie* whitelist, const NetAddrKey* key);
+PrefixTrie* loadWhitelist(const char* filename);
+void* whitelistReloadThread(void* arg);
+void* shutdownSignalThread(void* arg);
 bool verifyAuthToken(const uint8_t* token, uint32_t seq);
 void generateResponseToken(uint8_t* token, uint32_t seq);
 
-// Rate limiting data structures
-typedef struct {
-    struct sockaddr_storage addr;
-    char ip[INET6_ADDRSTRLEN];
-    time_t lastSeen;
-    double tokenBucket;
-    double lastTokenRefill;
-    uint32_t packetsReceived;
-    uint32_t packetsDropped;
-    uint32_t lastSequenceNum;
-    bool authenticated;
-    uint8_t authToken[AUTH_TOKEN_SIZE];
-} ClientInfo;
-
 // Global variables
-int sock = -1;                         /* Socket descriptor */
 int bStop = 1;
 char* whitelist_file = NULL;
-char whitelisted_ips[MAX_WHITELISTED_IPS][INET6_ADDRSTRLEN];
-int whitelisted_count = 0;
+// The published whitelist.  Workers copy it at the start of each receive
+// batch, a reload swaps in a new trie and frees the old one once every
+// worker has finished the batch it was in (see whitelistReloadThread)
+PrefixTrie* activeWhitelist = NULL;
+uint32_t whitelistReloads = 0;
+pthread_t whitelist_reload_thread;
+pthread_t shutdown_signal_thread;
+// Set by the first CNTCCode, SIGINT and a terminate signal may race
+bool teardownStarted = false;
 int max_rate = DEFAULT_MAX_RATE;
-ClientInfo clients[MAX_CLIENTS];
-pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+int rate_burst = 0;            // packets, 0 means max_rate (one second's worth)
+uint64_t rateIntervalNs = 0;   // ns between packets at max_rate
+uint64_t rateBurstNs = 0;      // how far ahead of the clock a client may run
+// Rate limiting data structures, see ClientTable.h
+ClientTable clientTable;
+uint32_t maxClients = DEFAULT_MAX_CLIENTS;
+uint32_t replayWindow = REPLAY_WINDOW_DEFAULT;  // packets, see ReplayWindow.h
 pthread_t cleanup_thread;
+// Interval reports, 0 is off.  CNTCCode clears reportRunning so the
+// reporter does not print into the summary
+uint32_t reportIntervalMs = 0;
+bool reportRunning = false;
+pthread_t report_thread;
+// Live statistics segment (-L), see LiveStats.h.  Like the reports it
+// stops when CNTCCode starts
+char liveStatsName[NAME_MAX + 1] = "";
+LiveStatsSegment *liveStats = NULL;
+bool liveStatsRunning = false;
+pthread_t live_stats_thread;
+// Receive/statistics pipeline (-P), 0 is off.  CNTCCode clears
+// pipelineRunning, the stats threads drain their rings and exit
+uint32_t pipelineRecords = 0;
+bool pipelineRunning = false;
 bool use_whitelist = false;
 bool use_authentication = true;
 uint8_t server_secret_key[32] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 
@@ -88,36 +256,32 @@ uint8_t server_secret_key[32] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
                                 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x00,
                                 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
 
-double timeOfFirstRxedMsg = -1.0;
-double timeOfLastRxedMsg = -1.0;
+// Messages per second (and burst) each category may write, the rest are
+// counted and reported as rate limited
+const LogCategory serverLogCategories[] = {
+    {"rx-error",   20, 20},
+    {"tx-error",   20, 20},
+    {"whitelist",  10, 10},
+    {"rate-limit", 10, 10},
+    {"auth",       10, 10},
+    {"replay",     10, 20},
+    {"sequence",  100, 100},
+    {"control",     0, 0},
+};
 
 double startTime = 0.0;
 double endTime = 0.0;
 double  wallTime = 0.0;
-uint32_t largestSeqRecv = 0;
-uint64_t receivedCount = 0;
-uint32_t RxErrorCount = 0;
-uint32_t TxErrorCount = 0;
-uint32_t  numberOutOfOrder=0;
-uint32_t  packetsDroppedByRateLimit=0;
-uint32_t  packetsDroppedByAuth=0;
-uint32_t  packetsDroppedByWhitelist=0;
-
-uint32_t lastSeqNumber=0;
-uint32_t curSeqNumber=0;
-int32_t numberOfGaps=0;
-int32_t sumOfAllGaps=0;
-int32_t sizeCurGap=0;
-int32_t thisGap=0;
 
 //If defined, we record the size of each gap event
 //    A gap event is a loss event involving >0
 //    consecurtively lost packets 
-#define CREATEGAPARRAY 1 
+//Off by default:  the summary's run length histograms and Gilbert-Elliott
+//fit take constant memory, the array stops at MAX_GAPS
+//#define CREATEGAPARRAY 1 
 
 #ifdef CREATEGAPARRAY
 #define MAX_GAPS 128000
-uint32_t gapArrayIndex = 0;
 uint32_t *gapArraySize=NULL;
 uint32_t *gapArraySeqNo=NULL;
 double *gapArrayTS=NULL;
@@ -125,27 +289,16 @@ FILE *gapArrayFID =  NULL;
 char *gapArrayFile = "gapArray.dat";
 #endif
 
-double OWDSum = 0.0;
-uint32_t numberOWDSamples=0;
-double maxOWDSample = 0.0;
-double minOWDSample = 10000.0;
 
-
-//If defined, we record samples but in a manner that does not
-// cause file I/O until the end of the program
+//If defined, we record every sample without file I/O on the receive
+// path:  the samples stream to serverSamples.NNNN.bin (see SampleCapture.h),
+// samplesToText turns them into the old serverSamplesArray.dat text
 #define CREATESAMPLEARRAYS 1
 
-//After this number, we roll over ....
-#define MAX_SAMPLES 1024000
-
 #ifdef CREATESAMPLEARRAYS 
-int32_t sampleArrayIndex = 0;
-double *OWDSampleArrayTS=NULL;
-double *OWDSampleArray=NULL;
-uint32_t *seqNoArray=NULL;
-FILE *samplesArrayFID = NULL;
-char *samplesArrayFile = "serverSamplesArray.dat";
+char *samplesCaptureBase = "serverSamples";
 #endif
+uint32_t samplesFileMB = SAMPLE_DEFAULT_FILE_MB;
 
 //$A2
 FILE *resultsFID = NULL;
@@ -154,157 +307,291 @@ char *resultsOutputFile = "serverResults.dat";
 FILE *outputFID = NULL;
 char *outputFile = NULL;
 bool doSampleOutput = false;
-uint16_t RxedOpMode = opModeRTT;
-uint16_t rxMarker=0; 
 
-uint64_t totalBytesRxed = 0;
-uint32_t numberNegativeOWDSamples=0;
+double alpha = 0.10;
+
+//Batched I/O
+uint32_t batchSize = DEFAULT_BATCH_SIZE;
+bool useUring = false;
+
+//UDP GRO/GSO.  Every receive buffer is rxBufferSize plus MAX_MSG_HDR of
+//slack so the response token of a short (last) segment stays in bounds
+bool useGRO = false;
+uint32_t rxBufferSize = MAX_DATA_BUFFER;
+
+//Kernel receive timestamps (SO_TIMESTAMPNS), -t turns them off
+bool useKernelTimestamps = true;
+
+//What the ancillary data of one receive told us
+typedef struct {
+    uint16_t gsoSize;   //segment size of a GRO coalesced datagram, 0 if not coalesced
+    bool haveRxTimestamp;
+    double rxTimestamp; //kernel receive time, CLOCK_REALTIME like getCurTimeD()
+} RxControlInfo;
+
+//The workers' running totals, summed.  intervalReportThread keeps the
+//last one and reports the difference
+typedef struct {
+    uint64_t receivedCount;
+    uint64_t totalBytesRxed;
+    uint64_t OWDSamples;
+    int64_t OWDSumNs;
+    uint64_t lostPackets;
+    uint64_t recoveredPackets;
+    uint64_t gapsStarted;
+    int64_t jitterSumNs;
+    int64_t IPDVAbsSumNs;
+    uint64_t IPDVCount;
+    uint32_t packetsDroppedByRateLimit;
+    uint32_t packetsDroppedByAuth;
+    uint32_t packetsDroppedByWhitelist;
+    uint32_t packetsDroppedByReplay;
+    LatencyHistogram OWDHist;
+} IntervalTotals;
+
+//What an accepted packet did to its flow, copied out of the session
+//while its shard is locked
+typedef struct {
+    int outcome;        //FLOW_IN_ORDER, FLOW_OUT_OF_ORDER or FLOW_BAD_GAP
+    FlowArrival arrival;
+    uint64_t largestSeqRecv;
+    double smoothedOWD;
+    int32_t numberOfGaps;
+} FlowUpdate;
+
+//What CNTCCode hands listFlowSession for each flow
+typedef struct {
+    FlowSession *aggregate;
+    uint32_t printed;
+} FlowListing;
+
+/*
+  Per worker state.   Each worker owns one SO_REUSEPORT socket and is the
+  only writer of its WorkerState, so the per packet counters need no locks.
+  The struct is cache line aligned so neighbouring workers never share a line.
+  The sample and gap arrays are split into one slice per worker.
+  The per flow statistics are not here but in the client table's sessions,
+  a flow's packets may reach any worker.
+  With the pipeline (-P) the worker's stats thread is the only writer of
+  the running totals and the sample producer, the worker of the rest.
+  CNTCCode merges all workers and all flows into the summary.
+*/
+
+// The counters other threads read while the worker runs (the reporter,
+// the live statistics).  Each has a single writer, so a relaxed load,
+// add and store publishes it:  no locked instruction, a plain add on
+// x86-64, yet no data race with the readers' relaxed loads.
+#define STAT_ADD(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+#define STAT_INC(counter) STAT_ADD(counter, 1)
+
+typedef struct {
+    int id;
+    int sock;
+    pthread_t thread;
+
+    //Read once per receive batch (refreshWorkerClock), not per packet
+    uint64_t clockNs;    //CLOCK_MONOTONIC, for the rate limiter
+    time_t clockSec;     //wall clock seconds, for client timeouts
+
+    //Odd while the worker is in a batch and may use its whitelist copy,
+    //even while it waits for packets.  See workerOnline/workerOffline
+    uint64_t rcuState;
+    const PrefixTrie *whitelist;
+
+    //The sequence, gap and OWD accounting is per flow, in the client
+    //table's FlowSessions.  These count what this worker handled
+    uint64_t receivedCount;
+    uint64_t totalBytesRxed;
+    uint32_t RxErrorCount;
+    uint32_t TxErrorCount;
+    uint32_t packetsDroppedByRateLimit;
+    uint32_t packetsDroppedByAuth;
+    uint32_t packetsDroppedByWhitelist;
+    uint32_t packetsDroppedByReplay;
+
+    //Running totals for the interval reports, the reporter reads them
+    //(relaxed, a count may be a packet behind) and reports the difference
+    //to the last interval.  Written with STAT_ADD/STAT_INC and
+    //latencyHistogramRecordShared, as are the drop and error counts.  The sequence and OWD accounting is per flow,
+    //these are this worker's share of it
+    uint64_t OWDSamples;
+    int64_t OWDSumNs;
+    uint64_t lostPackets;       //sequence numbers skipped
+    uint64_t recoveredPackets;  //late arrivals, skipped before
+    uint64_t gapsStarted;
+    int64_t jitterSumNs;        //the flow's jitter after each arrival
+    int64_t IPDVAbsSumNs;
+    uint64_t IPDVCount;
+    LatencyHistogram OWDHist;
+
+    //rxBatchMsgs/rxBatchCount is the average batch fill
+    uint64_t rxBatchCount;
+    uint64_t rxBatchMsgs;
+    uint64_t txBatchCount;
+    uint64_t txBatchMsgs;
+
+    int ioEngine;
+    uint64_t uringRecvArms;
+    uint64_t uringNoBuffers;
+
+    uint64_t groDatagrams;   //coalesced datagrams received
+    uint64_t groSegments;    //segments they carried
+    uint64_t gsoEchoes;      //echoes sent as one UDP_SEGMENT send
+
+    //getCurTimeD() at processing time less the kernel receive timestamp
+    double kernelTsGapSum;
+    double kernelTsGapMax;
+    uint64_t kernelTsSamples;
+    uint64_t userTsSamples;  //no kernel timestamp, timed in userspace
+
+#ifdef CREATEGAPARRAY
+    uint32_t gapArrayBase;    //first slot of this worker's slice
+    uint32_t gapArrayIndex;   //number of slots used
+    uint32_t gapArrayMax;
+#endif
+#ifdef CREATESAMPLEARRAYS
+    SampleProducer *samples;  //NULL if the capture could not start
+#endif
+
+    //The pipeline (-P), NULL when the worker accounts inline
+    StatsRing *statsRing;
+    pthread_t statsThread;
+    uint64_t staleRecords;    //their session was gone, see clientTableLockSession
+} __attribute__((aligned(CACHE_LINE_SIZE))) WorkerState;
+
+WorkerState workers[MAX_WORKERS];
+uint32_t numWorkers = DEFAULT_NUM_WORKERS;
+bool pinWorkers = false;
+
+int processRxedMessage(WorkerState *ws, char *buffer, ssize_t numBytesRcvd, struct sockaddr_storage *clntAddr,
+                       RxControlInfo *rxInfo);
+int processRxedDatagram(WorkerState *ws, char *buffer, ssize_t numBytesRcvd, struct sockaddr_storage *clntAddr,
+                        RxControlInfo *rxInfo, size_t *echoLen);
+void updateFlowSession(ClientShard *shard, FlowSession *session, const StatsRecord *rec, FlowUpdate *update);
+void accountFlowUpdate(WorkerState *ws, const StatsRecord *rec, const NetAddrKey *clientKey, const FlowUpdate *update);
+void accountStatsBatch(WorkerState *ws, uint32_t count);
+void parseRxControl(struct msghdr *msg, RxControlInfo *rxInfo);
+bool setTxSegmentControl(struct msghdr *msg, char *controlBuffer, size_t echoLen, uint16_t gsoSize);
+void rxLoopClassic(WorkerState *ws);
+void rxLoopBatched(WorkerState *ws);
+int rxLoopUring(WorkerState *ws);
+void* workerThread(void* arg);
+void refreshWorkerClock(WorkerState *ws);
+void workerOnline(WorkerState *ws);
+void workerOffline(WorkerState *ws);
+int openWorkerSocket(struct addrinfo *servAddr, WorkerState *ws);
+void attachSteeringProgram(int sock, int family);
+void listFlowSession(const FlowSession *session, void *arg);
+void readIntervalTotals(IntervalTotals *t);
+void publishFlowSession(const FlowSession *session, void *arg);
 
 //uncomment to see debug output
 //#define TRACE 1
 
 // Initialize client tracking data structures
 void initClientTracking() {
-    int i;
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        memset(&clients[i], 0, sizeof(ClientInfo));
-        clients[i].lastSeen = 0;
-        clients[i].tokenBucket = max_rate;
-        clients[i].lastTokenRefill = getCurTimeD();
-        clients[i].packetsReceived = 0;
-        clients[i].packetsDropped = 0;
-        clients[i].authenticated = false;
+    if (clientTableInit(&clientTable, maxClients, replayWindow) != NOERROR) {
+        DieWithSystemMessage("malloc() failed for the client table");
     }
+    printf("Tracking up to %u clients in %d shards, replay window %u packets\n",
+           clientTable.capacity, CLIENT_TABLE_SHARDS, clientTable.shards[0].replay.size);
+}
+
+// A new client, or one back after timing out, starts with a full bucket
+void resetClient(ClientHot* client, time_t now) {
+    client->lastSeen = (uint32_t)now;
+    client->rateTat = 0;
+    client->packetsReceived = 0;
+    client->packetsDropped = 0;
+    client->authenticated = false;
 }
 
-// Load whitelist from file
-bool loadWhitelist(const char* filename) {
+// Load whitelist from file into a new trie, NULL if it can not be read
+PrefixTrie* loadWhitelist(const char* filename) {
     FILE* file = fopen(filename, "r");
     if (!file) {
         perror("Failed to open whitelist file");
-        return false;
+        return NULL;
     }
     
-    char line[INET6_ADDRSTRLEN];
-    whitelisted_count = 0;
+    PrefixTrie* trie = prefixTrieCreate();
+    if (!trie) {
+        printf("Out of memory for the whitelist\n");
+        fclose(file);
+        return NULL;
+    }
+
+    char line[WHITELIST_LINE_SIZE];
+    uint8_t addr[16];
+    int prefixLen = 0;
+    uint32_t skipped = 0;
     
-    while (fgets(line, sizeof(line), file) && whitelisted_count < MAX_WHITELISTED_IPS) {
-        // Remove newline character
-        line[strcspn(line, "\n")] = 0;
-        if (strlen(line) > 0) {
-            strncpy(whitelisted_ips[whitelisted_count], line, INET6_ADDRSTRLEN);
-            whitelisted_count++;
+    while (fgets(line, sizeof(line), file)) {
+        // Drop comments and surrounding white space
+        line[strcspn(line, "#\r\n")] = 0;
+        char* entry = line + strspn(line, " \t");
+        entry[strcspn(entry, " \t")] = 0;
+        if (strlen(entry) > 0) {
+            if (parseAddrPrefix(entry, addr, &prefixLen) != NOERROR) {
+                if (skipped++ < 10)
+                    printf("Skipping invalid whitelist entry: %s\n", entry);
+                continue;
+            }
+            if (prefixTrieInsert(trie, addr, prefixLen) != NOERROR) {
+                printf("Out of memory for the whitelist\n");
+                prefixTrieFree(trie);
+                fclose(file);
+                return NULL;
+            }
         }
     }
     
     fclose(file);
-    printf("Loaded %d whitelisted IPs\n", whitelisted_count);
-    return true;
+    printf("Loaded %u IPv4 and %u IPv6 whitelist prefixes (%u skipped, %lu KB)\n",
+           trie->v4Prefixes, trie->v6Prefixes, skipped, (unsigned long)(prefixTrieSize(trie) / 1024));
+    return trie;
 }
 
-// Check if IP is in whitelist
-bool isIPWhitelisted(const char* ip) {
+// Check if IP is in whitelist (any port)
+bool isIPWhitelisted(const PrefixTrie* whitelist, const NetAddrKey* key) {
     if (!use_whitelist) return true;
     
-    int i;
-    for (i = 0; i < whitelisted_count; i++) {
-        if (strcmp(ip, whitelisted_ips[i]) == 0) {
-            return true;
-        }
-    }
-    return false;
+    return prefixTrieLookup(whitelist, key) >= 0;
 }
 
-// Find or create client entry
-int findOrCreateClient(const struct sockaddr_storage* addr) {
-    char ip[INET6_ADDRSTRLEN];
-    int rc = getFirstV4IPAddress((struct sockaddr*)addr, ip, sizeof(ip));
-    if (rc == ERROR) {
-        return -1;
-    }
-    
-    time_t now = time(NULL);
-    int oldest_idx = 0;
-    time_t oldest_time = now;
-    int empty_idx = -1;
-    int i;
-    
-    pthread_mutex_lock(&clients_mutex);
-    
-    // Look for existing client or empty slot
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].lastSeen == 0) {
-            if (empty_idx == -1) empty_idx = i;
-            continue;
-        }
-        
-        if (now - clients[i].lastSeen > CLIENT_TIMEOUT) {
-            // This client has timed out
-            if (oldest_time > clients[i].lastSeen) {
-                oldest_time = clients[i].lastSeen;
-                oldest_idx = i;
-            }
-            continue;
-        }
-        
-        if (strcmp(clients[i].ip, ip) == 0) {
-            // Found existing client
-            pthread_mutex_unlock(&clients_mutex);
-            return i;
-        }
+// Sets up the integer limiter from max_rate and rate_burst
+void initRateLimit() {
+    if (rate_burst <= 0) {
+        rate_burst = max_rate;
     }
-    
-    // Create new client entry
-    int new_idx;
-    if (empty_idx != -1) {
-        new_idx = empty_idx;
-    } else {
-        new_idx = oldest_idx;
+    rateIntervalNs = NANOS_PER_SEC / (uint64_t)max_rate;
+    if (rateIntervalNs == 0) {
+        rateIntervalNs = 1;
     }
-    
-    memcpy(&clients[new_idx].addr, addr, sizeof(struct sockaddr_storage));
-    strncpy(clients[new_idx].ip, ip, INET6_ADDRSTRLEN);
-    clients[new_idx].lastSeen = now;
-    clients[new_idx].tokenBucket = max_rate;
-    clients[new_idx].lastTokenRefill = getCurTimeD();
-    clients[new_idx].packetsReceived = 0;
-    clients[new_idx].packetsDropped = 0;
-    clients[new_idx].authenticated = false;
-    clients[new_idx].lastSequenceNum = 0;
-    
-    pthread_mutex_unlock(&clients_mutex);
-    return new_idx;
+    rateBurstNs = (uint64_t)(rate_burst - 1) * rateIntervalNs;
 }
 
-// Apply rate limiting
-bool checkRateLimit(int client_idx) {
-    double now = getCurTimeD();
-    
-    pthread_mutex_lock(&clients_mutex);
-    
-    // Refill token bucket
-    double elapsed = now - clients[client_idx].lastTokenRefill;
-    double tokens_to_add = elapsed * max_rate;
-    clients[client_idx].tokenBucket += tokens_to_add;
-    if (clients[client_idx].tokenBucket > max_rate) {
-        clients[client_idx].tokenBucket = max_rate;
-    }
-    clients[client_idx].lastTokenRefill = now;
-    
-    // Check if we have tokens
-    if (clients[client_idx].tokenBucket >= 1.0) {
-        clients[client_idx].tokenBucket -= 1.0;
-        clients[client_idx].lastSeen = time(NULL);
-        clients[client_idx].packetsReceived++;
-        
-        pthread_mutex_unlock(&clients_mutex);
-        return true;
+/*
+  Apply rate limiting.  The token bucket is kept as a GCRA theoretical
+  arrival time (TAT) in integer nanoseconds: each packet pushes the TAT
+  one interval ahead, and a packet is dropped if the TAT would run more
+  than the burst ahead of the clock.   That is the whole bucket in one
+  word:  one compare and one store.   It is not lock-free, the caller
+  holds the client's shard lock (clientTableAcquire), which serializes
+  the limiter along with the counters.   nowNs is the worker's per batch
+  clock (CLOCK_MONOTONIC).
+*/
+bool checkRateLimit(ClientHot* client, uint64_t nowNs, time_t nowSec) {
+    uint64_t base = (client->rateTat > nowNs) ? client->rateTat : nowNs;
+
+    if (base - nowNs > rateBurstNs) {
+        client->packetsDropped++;
+        return false;
     }
-    
-    clients[client_idx].packetsDropped++;
-    pthread_mutex_unlock(&clients_mutex);
-    packetsDroppedByRateLimit++;
-    return false;
+    client->rateTat = base + rateIntervalNs;
+    client->lastSeen = (uint32_t)nowSec;
+    client->packetsReceived++;
+    return true;
 }
 
 // Simple HMAC-like auth token verification
@@ -327,7 +614,6 @@ bool verifyAuthToken(const uint8_t* token, uint32_t seq) {
         return true;
     }
     
-    packetsDroppedByAuth++;
     return false;
 }
 
@@ -342,80 +628,416 @@ void generateResponseToken(uint8_t* token, uint32_t seq) {
     }
 }
 
+// Reloads the whitelist on SIGHUP.  SIGHUP is blocked in every other thread,
+// so the reload happens here and not in a signal handler.  The new trie is
+// published with one pointer swap.  The old one is freed after a grace
+// period: each worker that was in a batch at the swap must go back to
+// waiting for packets first, after which it can only hold the new trie.
+void* whitelistReloadThread(void* arg) {
+    sigset_t hangup;
+    int sig = 0;
+    uint32_t i;
+
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    for (;;) {
+        if (sigwait(&hangup, &sig) != 0)
+            continue;
+        if (!use_whitelist) {
+            printf("SIGHUP: no whitelist in use, nothing to reload\n");
+            continue;
+        }
+
+        PrefixTrie* newTrie = loadWhitelist(whitelist_file);
+        if (!newTrie) {
+            printf("SIGHUP: whitelist reload failed, keeping the current one\n");
+            continue;
+        }
+        PrefixTrie* oldTrie = __atomic_exchange_n(&activeWhitelist, newTrie, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        // Grace period
+        for (i = 0; i < numWorkers; i++) {
+            uint64_t state = __atomic_load_n(&workers[i].rcuState, __ATOMIC_ACQUIRE);
+            if (state & 1) {
+                while (__atomic_load_n(&workers[i].rcuState, __ATOMIC_ACQUIRE) == state)
+                    usleep(100);
+            }
+        }
+        prefixTrieFree(oldTrie);
+        whitelistReloads++;
+        printf("SIGHUP: whitelist reloaded\n");
+    }
+}
+
+// Takes SIGINT, which is blocked in every other thread, and runs
+// CNTCCode.  A handler could not:  CNTCCode locks the client table shards
+// and joins threads, a handler interrupting a worker that holds a shard
+// lock would deadlock.
+void* shutdownSignalThread(void* arg) {
+    sigset_t interrupt;
+    int sig = 0;
+
+    sigemptyset(&interrupt);
+    sigaddset(&interrupt, SIGINT);
+    while (sigwait(&interrupt, &sig) != 0)
+        ;
+    CNTCCode();
+    return NULL;
+}
+
 // Cleanup thread to remove stale client entries
 void* connectionCleanupThread(void* arg) {
     while (!bStop) {
         sleep(BUFFER_CLEANUP_INTERVAL);
         
-        time_t now = time(NULL);
-        int cleaned = 0;
-        
-        pthread_mutex_lock(&clients_mutex);
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i].lastSeen != 0 && now - clients[i].lastSeen > CLIENT_TIMEOUT) {
-                memset(&clients[i], 0, sizeof(ClientInfo));
-                clients[i].lastSeen = 0;
-                cleaned++;
-            }
-        }
-        pthread_mutex_unlock(&clients_mutex);
+        // Only the expired clients are visited, from each shard's LRU tail
+        uint32_t cleaned = clientTableExpire(&clientTable, time(NULL), CLIENT_TIMEOUT);
         
         if (cleaned > 0) {
-            printf("Cleaned up %d stale client entries\n", cleaned);
+            printf("Cleaned up %u stale client entries\n", cleaned);
         }
     }
     
     return NULL;
 }
 
-int main(int argc, char *argv[]) {
+// Sums the workers' running totals, reading each counter once
+void readIntervalTotals(IntervalTotals *t) {
+    uint32_t w = 0;
+    uint32_t b = 0;
+
+    memset(t, 0, sizeof(IntervalTotals));
+    for (w = 0; w < numWorkers; w++) {
+        WorkerState *ws = &workers[w];
+        t->receivedCount += __atomic_load_n(&ws->receivedCount, __ATOMIC_RELAXED);
+        t->totalBytesRxed += __atomic_load_n(&ws->totalBytesRxed, __ATOMIC_RELAXED);
+        t->OWDSamples += __atomic_load_n(&ws->OWDSamples, __ATOMIC_RELAXED);
+        t->OWDSumNs += __atomic_load_n(&ws->OWDSumNs, __ATOMIC_RELAXED);
+        t->lostPackets += __atomic_load_n(&ws->lostPackets, __ATOMIC_RELAXED);
+        t->recoveredPackets += __atomic_load_n(&ws->recoveredPackets, __ATOMIC_RELAXED);
+        t->gapsStarted += __atomic_load_n(&ws->gapsStarted, __ATOMIC_RELAXED);
+        t->jitterSumNs += __atomic_load_n(&ws->jitterSumNs, __ATOMIC_RELAXED);
+        t->IPDVAbsSumNs += __atomic_load_n(&ws->IPDVAbsSumNs, __ATOMIC_RELAXED);
+        t->IPDVCount += __atomic_load_n(&ws->IPDVCount, __ATOMIC_RELAXED);
+        t->packetsDroppedByRateLimit += __atomic_load_n(&ws->packetsDroppedByRateLimit, __ATOMIC_RELAXED);
+        t->packetsDroppedByAuth += __atomic_load_n(&ws->packetsDroppedByAuth, __ATOMIC_RELAXED);
+        t->packetsDroppedByWhitelist += __atomic_load_n(&ws->packetsDroppedByWhitelist, __ATOMIC_RELAXED);
+        t->packetsDroppedByReplay += __atomic_load_n(&ws->packetsDroppedByReplay, __ATOMIC_RELAXED);
+        for (b = 0; b < LATENCY_HIST_BUCKETS; b++)
+            t->OWDHist.counts[b] += __atomic_load_n(&ws->OWDHist.counts[b], __ATOMIC_RELAXED);
+        if (__atomic_load_n(&ws->OWDHist.maxValue, __ATOMIC_RELAXED) > t->OWDHist.maxValue)
+            t->OWDHist.maxValue = __atomic_load_n(&ws->OWDHist.maxValue, __ATOMIC_RELAXED);
+    }
+}
 
-  int32_t rc = NOERROR;
+/***********************************************************
+* Function: void* intervalReportThread(void* arg)
+*
+* Explanation: Every reportIntervalMs prints one line for the interval
+*              just ended:  the difference between the workers' running
+*              totals now and at the last report.  The receive path only
+*              bumps its own counters, so reporting costs it nothing.
+*              The wakeups are absolute (CLOCK_MONOTONIC), a slow print
+*              does not shift the following intervals.
+*
+*              lost is the sequence numbers skipped less the late arrivals
+*              (clamped at 0, a packet may be skipped in one interval and
+*              arrive in the next), gaps the loss events that started.  The
+*              OWD percentiles come from the difference of the histograms.
+*              jitter is the mean over the interval's arrivals of their
+*              flow's RFC 3550 jitter, meanIPDV the mean IPDV magnitude.
+*
+**************************************************/
+void* intervalReportThread(void* arg) {
+    static IntervalTotals last;
+    static IntervalTotals now;
+    struct timespec wakeup;
+    double lastTime = getTimestampD();
+    uint32_t b = 0;
+
+    readIntervalTotals(&last);
+    printf("interval: time \tsecs \trxCount \tpps \tavgTh \tlost \tlossRate \tgaps \tmeanOWD \tp50OWD \tp99OWD \tp999OWD \tjitter \tmeanIPDV \tdropRate \tdropAuth \tdropWL \tdropReplay\n");
+    clock_gettime(CLOCK_MONOTONIC, &wakeup);
+
+    while (__atomic_load_n(&reportRunning, __ATOMIC_RELAXED)) {
+        uint64_t rx = 0;
+        uint64_t lost = 0;
+        uint64_t skipped = 0;
+        uint64_t recovered = 0;
+        uint64_t OWDSamples = 0;
+        double meanOWD = 0.0;
+        double jitter = 0.0;
+        double meanIPDV = 0.0;
+        double secs = 0.0;
+        double nowTime = 0.0;
+        LatencyPercentiles OWD;
+
+        wakeup.tv_nsec += (long)(reportIntervalMs % 1000) * 1000000L;
+        wakeup.tv_sec += reportIntervalMs / 1000 + wakeup.tv_nsec / 1000000000L;
+        wakeup.tv_nsec %= 1000000000L;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR)
+            ;
+        if (!__atomic_load_n(&reportRunning, __ATOMIC_RELAXED))
+            break;
+
+        readIntervalTotals(&now);
+        nowTime = getTimestampD();
+        secs = nowTime - lastTime;
+
+        rx = now.receivedCount - last.receivedCount;
+        skipped = now.lostPackets - last.lostPackets;
+        recovered = now.recoveredPackets - last.recoveredPackets;
+        lost = (skipped > recovered) ? skipped - recovered : 0;
+        OWDSamples = now.OWDSamples - last.OWDSamples;
+        if (OWDSamples > 0)
+            meanOWD = (double)(now.OWDSumNs - last.OWDSumNs) / (double)OWDSamples / 1000000000.0;
+        if (OWDSamples > 0)
+            jitter = (double)(now.jitterSumNs - last.jitterSumNs) / (double)OWDSamples / 1000000000.0;
+        if (now.IPDVCount > last.IPDVCount)
+            meanIPDV = (double)(now.IPDVAbsSumNs - last.IPDVAbsSumNs) / (double)(now.IPDVCount - last.IPDVCount) / 1000000000.0;
+
+        //last becomes the interval's histogram, then the totals again.
+        //There is no maximum per interval, the percentiles are bucket tops
+        last.OWDHist.total = 0;
+        last.OWDHist.maxValue = UINT64_MAX;
+        for (b = 0; b < LATENCY_HIST_BUCKETS; b++) {
+            last.OWDHist.counts[b] = now.OWDHist.counts[b] - last.OWDHist.counts[b];
+            last.OWDHist.total += last.OWDHist.counts[b];
+        }
+        latencyHistogramPercentiles(&last.OWDHist, &OWD);
+
+        printf("interval: %12.6f \t%3.3f \t%9lu \t%9.0f \t%12.0f \t%9lu \t%3.6f \t%9lu \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%04.9f \t%9u \t%9u \t%9u \t%9u\n",
+               getCurTimeD(), secs, rx, (secs > 0.0) ? (double)rx / secs : 0.0,
+               (secs > 0.0) ? (double)(now.totalBytesRxed - last.totalBytesRxed) * 8.0 / secs : 0.0,
+               lost, (rx + lost > 0) ? (double)lost / (double)(rx + lost) : 0.0,
+               now.gapsStarted - last.gapsStarted, meanOWD, OWD.p50, OWD.p99, OWD.p999, jitter, meanIPDV,
+               now.packetsDroppedByRateLimit - last.packetsDroppedByRateLimit,
+               now.packetsDroppedByAuth - last.packetsDroppedByAuth,
+               now.packetsDroppedByWhitelist - last.packetsDroppedByWhitelist,
+               now.packetsDroppedByReplay - last.packetsDroppedByReplay);
+        fflush(stdout);
+
+        last = now;
+        lastTime = nowTime;
+    }
 
-  char *buffer  = NULL;
-  updatedMessageHeader msgHeader;
-  updatedMessageHeader *msgHeaderPtr=&msgHeader;
-  uint32_t *myBufferIntPtr  = NULL;
-  uint16_t *myBufferShortPtr  = NULL;
-  uint32_t msgMinSize = (uint32_t) MESSAGEMIN;
-  uint8_t *authTokenPtr = NULL;
+    return NULL;
+}
 
-  double OWDSample = 0.0;
-  double smoothedOWD = 0.0;
-  double alpha = 0.10;
-  double sendTime = 0.0;
+/***********************************************************
+* Function: void publishFlowSession(const FlowSession *session, void *arg)
+*
+* Explanation: clientTableForEachSessionUpTo callback for liveStatsThread,
+*              copies a flow into the body being built (under the flow's
+*              shard lock).  The walk stops at LIVE_STATS_MAX_FLOWS
+*
+**************************************************/
+void publishFlowSession(const FlowSession *session, void *arg) {
+    LiveStatsBody *body = (LiveStatsBody *)arg;
+    LiveFlowStats *f = NULL;
+
+    if (body->numFlows >= LIVE_STATS_MAX_FLOWS)
+        return;
+    f = &body->flows[body->numFlows++];
+    addrKeyToString(&session->key, f->addr, sizeof(f->addr));
+    f->flowId = session->flowId;
+    f->receivedCount = session->receivedCount;
+    f->totalBytesRxed = session->totalBytesRxed;
+    f->largestSeqRecv = session->largestSeqRecv;
+    f->numberOutOfOrder = session->numberOutOfOrder;
+    f->numberOfGaps = session->numberOfGaps;
+    f->sumOfAllGaps = session->sumOfAllGaps;
+    f->numberNegativeOWDSamples = session->numberNegativeOWDSamples;
+    f->timeOfFirstRxedMsg = session->timeOfFirstRxedMsg;
+    f->timeOfLastRxedMsg = session->timeOfLastRxedMsg;
+    f->meanOWD = (session->numberOWDSamples > 0) ? session->OWDSum / (double)session->numberOWDSamples : 0.0;
+    f->minOWD = (session->numberOWDSamples > 0) ? session->minOWDSample : 0.0;
+    f->maxOWD = session->maxOWDSample;
+    f->smoothedOWD = session->smoothedOWD;
+    flowSessionOWDPercentiles(session, &f->OWD);
+    f->jitter = session->jitter;
+    f->meanAbsIPDV = (session->numberIPDV > 0) ? session->IPDVAbsSum / (double)session->numberIPDV : 0.0;
+}
 
-  ssize_t numBytesRcvd  = 0;
-  uint32_t RxedMsgSize = 0;
+/***********************************************************
+* Function: void* liveStatsThread(void* arg)
+*
+* Explanation: Every LIVE_STATS_INTERVAL_MS builds the live statistics
+*              from the workers' running totals (as the interval reports
+*              do) and the client table's sessions, then publishes them
+*              with one seqlock protected copy into the segment.  Only
+*              this thread writes the segment.
+*
+**************************************************/
+void* liveStatsThread(void* arg) {
+    static IntervalTotals totals;
+    static LiveStatsBody body;
+    ClientTableStats clientStats;
+    struct timespec wakeup;
+    uint32_t w = 0;
+
+    memset(&body, 0, sizeof(body));
+    body.pid = (uint32_t)getpid();
+    body.numWorkers = numWorkers;
+    body.startTime = startTime;
+    clock_gettime(CLOCK_MONOTONIC, &wakeup);
+
+    while (__atomic_load_n(&liveStatsRunning, __ATOMIC_RELAXED)) {
+        readIntervalTotals(&totals);
+        body.updateTime = getCurTimeD();
+        body.updates++;
+        body.receivedCount = totals.receivedCount;
+        body.totalBytesRxed = totals.totalBytesRxed;
+        body.OWDSamples = totals.OWDSamples;
+        body.OWDSumNs = totals.OWDSumNs;
+        body.lostPackets = totals.lostPackets;
+        body.recoveredPackets = totals.recoveredPackets;
+        body.gapsStarted = totals.gapsStarted;
+        body.packetsDroppedByRateLimit = totals.packetsDroppedByRateLimit;
+        body.packetsDroppedByAuth = totals.packetsDroppedByAuth;
+        body.packetsDroppedByWhitelist = totals.packetsDroppedByWhitelist;
+        body.packetsDroppedByReplay = totals.packetsDroppedByReplay;
+        body.RxErrorCount = 0;
+        body.TxErrorCount = 0;
+        for (w = 0; w < numWorkers; w++) {
+            body.RxErrorCount += __atomic_load_n(&workers[w].RxErrorCount, __ATOMIC_RELAXED);
+            body.TxErrorCount += __atomic_load_n(&workers[w].TxErrorCount, __ATOMIC_RELAXED);
+        }
+        body.OWDHist = totals.OWDHist;
+        body.OWDHist.total = totals.OWDSamples;
+
+        clientTableGetStats(&clientTable, &clientStats);
+        body.clientsTracked = clientStats.count;
+        body.liveFlows = clientStats.liveFlows;
+        body.numFlows = 0;
+        clientTableForEachSessionUpTo(&clientTable, publishFlowSession, &body, LIVE_STATS_MAX_FLOWS);
+
+        liveStatsPublish(liveStats, &body);
+
+        wakeup.tv_nsec += LIVE_STATS_INTERVAL_MS * 1000000L;
+        wakeup.tv_sec += wakeup.tv_nsec / 1000000000L;
+        wakeup.tv_nsec %= 1000000000L;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR)
+            ;
+    }
 
-  // Test for correct number of arguments
-  if (argc < 2) 
-    DieWithUserMessage("Parameter(s)", "<Server Port/Service> [outputFile] [maxRate] [whitelist]");
+    return NULL;
+}
 
-  char *service = argv[1]; // First arg: local port/service
+int main(int argc, char *argv[]) {
 
-  if (argc >= 3) {
-    outputFile = argv[2];
+  int opt;
+  int i;
+  sigset_t signalSet;
+
+  // Options may appear anywhere on the command line, the rest are positional
+  while ((opt = getopt(argc, argv, "b:w:pugtc:B:R:S:I:L:P:")) != -1) {
+    switch (opt) {
+    case 'b':
+      batchSize = (uint32_t) atoi(optarg);
+      if (batchSize < 1)
+        batchSize = DEFAULT_BATCH_SIZE;
+      if (batchSize > MAX_BATCH_SIZE)
+        batchSize = MAX_BATCH_SIZE;
+      break;
+    case 'w':
+      numWorkers = (uint32_t) atoi(optarg);
+      if (numWorkers < 1)
+        numWorkers = DEFAULT_NUM_WORKERS;
+      if (numWorkers > MAX_WORKERS)
+        numWorkers = MAX_WORKERS;
+      break;
+    case 'p':
+      pinWorkers = true;
+      break;
+    case 'u':
+      useUring = true;
+      break;
+    case 'g':
+      useGRO = true;
+      rxBufferSize = GRO_BUFFER_SIZE;
+      break;
+    case 't':
+      useKernelTimestamps = false;
+      break;
+    case 'c':
+      maxClients = (uint32_t) atoi(optarg);
+      if (maxClients < CLIENT_TABLE_SHARDS)
+        maxClients = CLIENT_TABLE_SHARDS;
+      break;
+    case 'B':
+      rate_burst = atoi(optarg);
+      break;
+    case 'R':
+      replayWindow = (uint32_t) atoi(optarg);
+      break;
+    case 'S':
+      samplesFileMB = (uint32_t) atoi(optarg);
+      break;
+    case 'I':
+      reportIntervalMs = (uint32_t) atoi(optarg);
+      if ((reportIntervalMs > 0) && (reportIntervalMs < MIN_REPORT_INTERVAL_MS))
+        reportIntervalMs = MIN_REPORT_INTERVAL_MS;
+      if (reportIntervalMs > MAX_REPORT_INTERVAL_MS)
+        reportIntervalMs = MAX_REPORT_INTERVAL_MS;
+      break;
+    case 'L':
+      snprintf(liveStatsName, sizeof(liveStatsName), "%s%s", (optarg[0] == '/') ? "" : "/", optarg);
+      break;
+    case 'P':
+      pipelineRecords = (uint32_t) atoi(optarg);
+      break;
+    default:
+      DieWithUserMessage("Parameter(s)", "<Server Port/Service> [outputFile] [maxRate] [whitelist] [-b batchSize] [-w workers] [-p] [-u] [-g] [-t] [-c maxClients] [-B burst] [-R replayWindow] [-S samplesFileMB] [-I reportMs] [-L statsName] [-P ringRecords]");
+    }
+  }
+
+  // Test for correct number of arguments
+  if (argc - optind < 1) 
+    DieWithUserMessage("Parameter(s)", "<Server Port/Service> [outputFile] [maxRate] [whitelist] [-b batchSize] [-w workers] [-p] [-u] [-g] [-t] [-c maxClients] [-B burst] [-R replayWindow] [-S samplesFileMB] [-I reportMs] [-L statsName] [-P ringRecords]");
+
+  char *service = argv[optind]; // First arg: local port/service
+
+  // SIGHUP is only taken by whitelistReloadThread and SIGINT by
+  // shutdownSignalThread (sigwait), every thread (the log and sample
+  // writers too) inherits the mask.  An ignored signal is discarded even
+  // while blocked, and a shell starts background jobs with SIGINT ignored
+  signal(SIGINT, SIG_DFL);
+  sigemptyset(&signalSet);
+  sigaddset(&signalSet, SIGHUP);
+  sigaddset(&signalSet, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &signalSet, NULL);
+
+  // Per packet messages are queued and written by the log thread
+  if (asyncLogInit(serverLogCategories, sizeof(serverLogCategories) / sizeof(serverLogCategories[0]), stdout) != NOERROR)
+    printf("server: log thread not started, messages are written inline\n");
+
+  if (argc - optind >= 2) {
+    outputFile = argv[optind + 1];
     doSampleOutput = true;
   } else {
     doSampleOutput = false;
   }
   
   // Parse max rate if provided
-  if (argc >= 4) {
-    max_rate = atoi(argv[3]);
+  if (argc - optind >= 3) {
+    max_rate = atoi(argv[optind + 2]);
     if (max_rate <= 0) {
       max_rate = DEFAULT_MAX_RATE;
     }
     printf("Setting max rate to %d packets per second per client\n", max_rate);
   }
+  initRateLimit();
+  printf("Rate limit %d packets per second per client, burst %d\n", max_rate, rate_burst);
   
   // Load whitelist if provided
-  if (argc >= 5) {
-    whitelist_file = argv[4];
-    if (loadWhitelist(whitelist_file)) {
+  if (argc - optind >= 4) {
+    whitelist_file = argv[optind + 3];
+    activeWhitelist = loadWhitelist(whitelist_file);
+    if (activeWhitelist) {
       use_whitelist = true;
-      printf("Whitelist enabled with %d IPs\n", whitelisted_count);
+      printf("Whitelist enabled, kill -HUP %d reloads it\n", (int)getpid());
     }
   }
 
@@ -443,27 +1065,13 @@ int main(int argc, char *argv[]) {
   }
 
 #ifdef CREATESAMPLEARRAYS
-  sampleArrayIndex = 0;
-  seqNoArray = malloc(MAX_SAMPLES * sizeof(uint32_t));
-  if (!seqNoArray) {
-    DieWithSystemMessage("malloc() failed for seqNoArray");
-  }
-  memset(seqNoArray, 0, (MAX_SAMPLES * sizeof(uint32_t)));
-  
-  OWDSampleArrayTS = malloc(MAX_SAMPLES * sizeof(double));
-  if (!OWDSampleArrayTS) {
-    DieWithSystemMessage("malloc() failed for OWDSampleArrayTS");
-  }
-  
-  OWDSampleArray = malloc(MAX_SAMPLES * sizeof(double));
-  if (!OWDSampleArray) {
-    DieWithSystemMessage("malloc() failed for OWDSampleArray");
-  }
-  memset(OWDSampleArray, 0, (MAX_SAMPLES * sizeof(double)));
+  if (sampleCaptureInit(samplesCaptureBase, numWorkers, samplesFileMB) != NOERROR)
+    printf("server: sample capture not started, no samples are recorded\n");
+  else
+    printf("Capturing samples to %s.NNNN.bin, %u MB per file\n", samplesCaptureBase, samplesFileMB);
 #endif
 
 #ifdef CREATEGAPARRAY
-  gapArrayIndex = 0;
   gapArraySize = malloc(MAX_GAPS * sizeof(uint32_t));
   if (!gapArraySize) {
     DieWithSystemMessage("malloc() failed for gapArraySize");
@@ -480,40 +1088,46 @@ int main(int argc, char *argv[]) {
   }
 #endif
 
-  // Init memory for first send
-  buffer = malloc((size_t)MAX_DATA_BUFFER);
-  if (buffer == NULL) {
-    printf("server: HARD ERROR malloc of %d bytes failed\n", MAX_DATA_BUFFER);
-    exit(1);
+  //Each worker gets its own sample producer and slice of the gap arrays
+  for (i = 0; i < numWorkers; i++) {
+    WorkerState *ws = &workers[i];
+    memset(ws, 0, sizeof(WorkerState));
+    ws->id = i;
+    ws->sock = -1;
+#ifdef CREATESAMPLEARRAYS
+    ws->samples = sampleCaptureProducer(i);
+#endif
+#ifdef CREATEGAPARRAY
+    ws->gapArrayMax = MAX_GAPS / numWorkers;
+    ws->gapArrayBase = i * ws->gapArrayMax;
+#endif
+    if (pipelineRecords > 0) {
+      ws->statsRing = statsRingCreate(pipelineRecords);
+      if (ws->statsRing == NULL)
+        printf("server: worker %d: stats ring not allocated, it accounts inline\n", i);
+    }
   }
-  memset(buffer, 0, MAX_DATA_BUFFER);
-
-  signal(SIGINT, CNTCCode);
-
-  // Create socket for incoming connections
-  sock = socket(servAddr->ai_family, servAddr->ai_socktype, servAddr->ai_protocol);
-  if (sock < 0)
-    DieWithSystemMessage("socket() failed");
 
-  // Bind to the local address
-  if (bind(sock, servAddr->ai_addr, servAddr->ai_addrlen) < 0)
-    DieWithSystemMessage("bind() failed");
+  // Create one socket per worker for incoming connections.  The sockets are
+  // bound in worker order, which is also their index in the SO_REUSEPORT group
+  for (i = 0; i < numWorkers; i++) {
+    if (openWorkerSocket(servAddr, &workers[i]) < 0)
+      DieWithSystemMessage("socket setup failed");
+  }
 
   // Free address list allocated by getaddrinfo()
   freeaddrinfo(servAddr);
 
-  // Set receive timeout to prevent blocking indefinitely
-  struct timeval tv;
-  tv.tv_sec = 5;  // 5 second timeout
-  tv.tv_usec = 0;
-  if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-    DieWithSystemMessage("setsockopt() failed");
-  }
-
   // Start cleanup thread
   if (pthread_create(&cleanup_thread, NULL, connectionCleanupThread, NULL) != 0) {
     DieWithSystemMessage("Failed to create cleanup thread");
   }
+  if (pthread_create(&whitelist_reload_thread, NULL, whitelistReloadThread, NULL) != 0) {
+    DieWithSystemMessage("Failed to create whitelist reload thread");
+  }
+  if (pthread_create(&shutdown_signal_thread, NULL, shutdownSignalThread, NULL) != 0) {
+    DieWithSystemMessage("Failed to create shutdown signal thread");
+  }
 
   if (doSampleOutput) {
     printf("server: open output file %s\n", outputFile);
@@ -526,357 +1140,1541 @@ int main(int argc, char *argv[]) {
   wallTime = getCurTimeD();
   startTime = wallTime;
   printf("Server started. Press Ctrl+C to exit.\n");
-  
-  for (;;) { 
-    struct sockaddr_storage clntAddr; // Client address
-    char addrBuffer[INET6_ADDRSTRLEN];
-    // Set Length of client address structure (in-out parameter)
-    socklen_t clntAddrLen = sizeof(clntAddr);
 
-    // Block until receive message from a client
-    numBytesRcvd = recvfrom(sock, buffer, MAX_DATA_BUFFER, 0,
-        (struct sockaddr *) &clntAddr, &clntAddrLen);
-        
-    if (numBytesRcvd < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        // Timeout occurred, continue to allow cleanup thread to run
+  if (batchSize > 1) {
+    printf("server: batched I/O, up to %d datagrams per recvmmsg/sendmmsg\n", batchSize);
+  }
+  if (numWorkers > 1) {
+    printf("server: %d SO_REUSEPORT workers %s\n", numWorkers, pinWorkers ? "(pinned)" : "");
+  }
+  if (useGRO) {
+    printf("server: UDP GRO receive, GSO echo (%d byte receive buffers)\n", rxBufferSize);
+  }
+  if (liveStatsName[0] != '\0') {
+    liveStats = liveStatsCreate(liveStatsName);
+    if (liveStats == NULL) {
+      printf("server: live statistics segment %s not created: %s\n", liveStatsName, strerror(errno));
+    } else {
+      printf("server: live statistics in %s, see udpecho-stat\n", liveStatsName);
+      liveStatsRunning = true;
+      if (pthread_create(&live_stats_thread, NULL, liveStatsThread, NULL) != 0) {
+        DieWithSystemMessage("Failed to create live statistics thread");
+      }
+    }
+  }
+  if (pipelineRecords > 0) {
+    pipelineRunning = true;
+    for (i = 0; i < numWorkers; i++) {
+      if (workers[i].statsRing == NULL)
         continue;
+      if (pthread_create(&workers[i].statsThread, NULL, statsThread, &workers[i]) != 0) {
+        DieWithSystemMessage("Failed to create stats thread");
       }
-      RxErrorCount++;
-      perror("server: Error on recvfrom");
-      continue;
-    } else if (numBytesRcvd < msgMinSize) {
-      RxErrorCount++;
-      printf("server: Error on recvfrom, received (%d) less than MIN (%d)\n", 
-             (int32_t)numBytesRcvd, msgMinSize);
-      continue;
     }
-    
-    // Get client IP address for logging
-    rc = getFirstV4IPAddress((struct sockaddr*)&clntAddr, addrBuffer, sizeof(addrBuffer));
-    if (rc == ERROR) {
-      RxErrorCount++;
-      printf("server: Error getting client IP address\n");
-      continue;
+    printf("server: pipeline, a stats thread per worker behind a %u record ring\n",
+           (workers[0].statsRing != NULL) ? workers[0].statsRing->size : 0);
+  }
+  if (reportIntervalMs > 0) {
+    reportRunning = true;
+    if (pthread_create(&report_thread, NULL, intervalReportThread, NULL) != 0) {
+      DieWithSystemMessage("Failed to create interval report thread");
     }
-    
-    // Check if client is whitelisted
-    if (!isIPWhitelisted(addrBuffer)) {
-      packetsDroppedByWhitelist++;
-      if (packetsDroppedByWhitelist % 100 == 1) {  // Log only occasionally to prevent log flooding
-        printf("server: Dropped packet from non-whitelisted IP: %s\n", addrBuffer);
-      }
-      continue;
+  }
+
+  //Worker 0 runs on the main thread
+  for (i = 1; i < numWorkers; i++) {
+    if (pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]) != 0) {
+      DieWithSystemMessage("Failed to create worker thread");
     }
-    
-    // Find or create client record and apply rate limiting
-    int client_idx = findOrCreateClient(&clntAddr);
-    if (client_idx < 0) {
-      RxErrorCount++;
-      printf("server: Error tracking client connection\n");
-      continue;
+  }
+  workers[0].thread = pthread_self();
+  workerThread(&workers[0]);
+
+  return 0;
+}
+
+/*************************************************************
+*
+* Function: int openWorkerSocket(struct addrinfo *servAddr, WorkerState *ws)
+* 
+* Summary: Creates and binds the worker's socket.  With more than one
+*          worker every socket joins the same SO_REUSEPORT group and the
+*          first one carries the flow steering program.
+*
+* outputs:  
+*   returns ERROR or NOERROR, fills in ws->sock
+*
+***************************************************************/
+int openWorkerSocket(struct addrinfo *servAddr, WorkerState *ws) 
+{
+  int on = 1;
+  struct timeval tv;
+
+  ws->sock = socket(servAddr->ai_family, servAddr->ai_socktype, servAddr->ai_protocol);
+  if (ws->sock < 0) {
+    perror("socket() failed");
+    return ERROR;
+  }
+
+  if (numWorkers > 1) {
+    if (setsockopt(ws->sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+      perror("setsockopt(SO_REUSEPORT) failed");
+      return ERROR;
     }
-    
-    // Apply rate limiting
-    if (!checkRateLimit(client_idx)) {
-      if (clients[client_idx].packetsDropped % 100 == 1) {  // Log only occasionally
-        printf("server: Rate limiting dropped packet from %s\n", addrBuffer);
-      }
-      continue;
+    //The group takes the program from whichever member has it
+    if (ws->id == 0)
+      attachSteeringProgram(ws->sock, servAddr->ai_family);
+  }
+
+  //Without GRO the kernel still delivers every segment, just one at a time
+  if (useGRO) {
+    if (setsockopt(ws->sock, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+      perror("server: setsockopt(UDP_GRO) failed, segments arrive one at a time");
     }
-    
-    // Validate message size more strictly
-    if (numBytesRcvd > MAX_DATA_BUFFER) {
-      RxErrorCount++;
-      printf("server: Packet too large (%d bytes) from %s\n", (int32_t)numBytesRcvd, addrBuffer);
-      continue;
+  }
+
+  //Without a kernel timestamp an arrival is timed in processRxedMessage
+  if (useKernelTimestamps) {
+    if (setsockopt(ws->sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+      perror("server: setsockopt(SO_TIMESTAMPNS) failed, using userspace timestamps");
+    }
+  }
+
+  // Bind to the local address
+  if (bind(ws->sock, servAddr->ai_addr, servAddr->ai_addrlen) < 0) {
+    perror("bind() failed");
+    return ERROR;
+  }
+
+  // Set receive timeout to prevent blocking indefinitely
+  tv.tv_sec = 5;  // 5 second timeout
+  tv.tv_usec = 0;
+  if (setsockopt(ws->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    perror("setsockopt() failed");
+    return ERROR;
+  }
+  return NOERROR;
+}
+
+/*************************************************************
+*
+* Function: void attachSteeringProgram(int sock, int family)
+* 
+* Summary: Attaches a classic BPF program to the SO_REUSEPORT group that
+*          picks the worker socket from a hash of the source address.
+*          All datagrams from one client therefore land on one worker and
+*          its per client state never crosses cores.
+*
+* notes: 
+*   The program runs with the UDP header already pulled, so the IP header
+*   is reached through SKF_NET_OFF.   The port is left out of the hash
+*   so every client (address+port) of one host lands on the same worker.
+*   If the attach fails the kernel's default 4-tuple hash is used - a
+*   client still stays on one worker.
+*
+***************************************************************/
+void attachSteeringProgram(int sock, int family) 
+{
+  struct sock_filter code[] = {
+    /* A = IP version */
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 2, 0),
+    /* IPv4: A = saddr */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_JUMP(BPF_JMP | BPF_JA, 10, 0, 0),
+    /* IPv6: A = the four words of saddr xor'ed together */
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* fold the high bits down:  A ^= A >> 16;  A ^= A >> 8 */
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 8),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    /* return the socket index */
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, numWorkers),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+    perror("server: setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed, using the kernel hash");
+  }
+}
+
+/*************************************************************
+*
+* Function: void* workerThread(void* arg)
+* 
+* Summary: Optionally pins the worker to a CPU and runs its receive loop.
+*
+***************************************************************/
+void* workerThread(void* arg) 
+{
+  WorkerState *ws = (WorkerState *)arg;
+
+  if (pinWorkers) {
+    cpu_set_t cpus;
+    long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    CPU_ZERO(&cpus);
+    CPU_SET(ws->id % (numCPUs > 0 ? numCPUs : 1), &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      printf("server: worker %d could not be pinned\n", ws->id);
     }
+  }
+
+  if (useUring) {
+    if (rxLoopUring(ws) == ERROR) {
+      printf("server: worker %d: io_uring unavailable (%s), falling back to %s\n", ws->id,
+             strerror(errno), (batchSize > 1) ? "recvmmsg" : "recvfrom");
+    }
+  }
+
+  if (batchSize > 1) {
+    ws->ioEngine = IO_ENGINE_BATCHED;
+    rxLoopBatched(ws);
+  } else {
+    ws->ioEngine = IO_ENGINE_CLASSIC;
+    rxLoopClassic(ws);
+  }
+  return NULL;
+}
+
+/*************************************************************
+*
+* Function: void refreshWorkerClock(WorkerState *ws)
+* 
+* Summary: Reads the clocks the per packet checks use.  Called once per
+*          receive batch so the rate limiter and the client table do not
+*          cost clock reads per packet.
+*
+***************************************************************/
+void refreshWorkerClock(WorkerState *ws) 
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ws->clockNs = (uint64_t)ts.tv_sec * NANOS_PER_SEC + (uint64_t)ts.tv_nsec;
+  ws->clockSec = time(NULL);
+}
+
+/*************************************************************
+*
+* Function: void workerOnline(WorkerState *ws)
+* 
+* Summary: Called when a receive returns, before the batch is processed.
+*          Marks the worker as in a batch and takes its copy of the
+*          published whitelist, which it may use until workerOffline.
+*
+* notes:  the fence orders the rcuState store before the pointer load,
+*         pairing with the fence after the swap in whitelistReloadThread.
+*         A worker that loaded the old trie is therefore seen as in a batch.
+*
+***************************************************************/
+void workerOnline(WorkerState *ws) 
+{
+  __atomic_store_n(&ws->rcuState, ws->rcuState + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  ws->whitelist = __atomic_load_n(&activeWhitelist, __ATOMIC_ACQUIRE);
+}
+
+/*************************************************************
+*
+* Function: void workerOffline(WorkerState *ws)
+* 
+* Summary: Called before blocking in a receive.  The worker drops its
+*          whitelist copy, ending any grace period that waits on it.
+*
+***************************************************************/
+void workerOffline(WorkerState *ws) 
+{
+  ws->whitelist = NULL;
+  if (ws->rcuState & 1)
+    __atomic_store_n(&ws->rcuState, ws->rcuState + 1, __ATOMIC_RELEASE);
+}
+
+/*************************************************************
+*
+* Function: int processRxedMessage(WorkerState *ws, char *buffer, ssize_t numBytesRcvd,
+*                                  struct sockaddr_storage *clntAddr, RxControlInfo *rxInfo)
+* 
+* Summary: Runs one received datagram through the filters (whitelist,
+*          rate limit, auth, replay) and the loss/OWD accounting, or with
+*          the pipeline hands the accounting to the stats thread.
+*
+* Inputs:
+*   WorkerState *ws : the worker that received the datagram
+*   char *buffer : the datagram, followed by at least MAX_MSG_HDR bytes
+*                  the response token may be written into
+*   ssize_t numBytesRcvd : the number of valid bytes in the buffer
+*   struct sockaddr_storage *clntAddr : the sender
+*   RxControlInfo *rxInfo : the receive's ancillary data
+*
+* outputs:  
+*   returns RX_DROP, RX_DONE, RX_ECHO or RX_TERMINATE.
+*   On RX_ECHO the response token has been written into the buffer
+*   and the first numBytesRcvd bytes must be sent back to clntAddr.
+*
+***************************************************************/
+int processRxedMessage(WorkerState *ws, char *buffer, ssize_t numBytesRcvd, struct sockaddr_storage *clntAddr,
+                       RxControlInfo *rxInfo) 
+{
+  int32_t rc = NOERROR;
+  updatedMessageHeader msgHeader;
+  updatedMessageHeader *msgHeaderPtr=&msgHeader;
+  uint32_t *myBufferIntPtr  = NULL;
+  uint16_t *myBufferShortPtr  = NULL;
+  uint32_t msgMinSize = (uint32_t) MESSAGEMIN;
+  uint8_t *authTokenPtr = NULL;
+  NetAddrKey clientKey;
+  ClientHot *client = NULL;
+  ClientShard *shard = NULL;
+  bool created = false;
+  int verdict = CLIENT_OK;
+  time_t now = 0;
+  FlowSession *session = NULL;
+  StatsRecord record;
+  FlowUpdate update;
+  int replayOutcome = REPLAY_NEW;
+  uint32_t reorderExtent = 0;
+  uint32_t lateBy = 0;
+  bool terminate = false;
+  //Copied out of the session while the shard is locked
+  uint32_t lastSeqNumber = 0;
+
+  double rxWallTime = 0.0;
+  double processingTime = 0.0;
+  uint32_t RxedMsgSize = 0;
+  uint16_t RxedOpMode = opModeRTT;
+  uint16_t rxMarker=0; 
+  uint32_t curSeqNumber=0;
+
+  if (numBytesRcvd < msgMinSize) {
+    STAT_INC(ws->RxErrorCount);
+    LOG_EVENT(LOG_CAT_RX_ERROR, "server: Error on recvfrom, received (%d) less than MIN (%d)",
+              numBytesRcvd, msgMinSize);
+    return RX_DROP;
+  }
     
-    // Else no error on the recv
-    RxedMsgSize = numBytesRcvd;
+  // Binary client identity, no per packet text formatting
+  rc = getAddrKey((struct sockaddr*)clntAddr, &clientKey);
+  if (rc == ERROR) {
+    STAT_INC(ws->RxErrorCount);
+    LOG_EVENT(LOG_CAT_RX_ERROR, "server: Error getting client IP address");
+    return RX_DROP;
+  }
     
-    // Parse message header
-    myBufferIntPtr = (uint32_t *)buffer;
-    //unpack to fill in the rx header info
-    msgHeaderPtr->sequenceNum = ntohl(*myBufferIntPtr++);
-    msgHeaderPtr->timeSentSeconds = ntohl(*myBufferIntPtr++);
-    msgHeaderPtr->timeSentNanoSeconds = ntohl(*myBufferIntPtr++);
-
-    myBufferShortPtr = (uint16_t *)myBufferIntPtr;
-    msgHeaderPtr->opMode = ntohs(*myBufferShortPtr++);
-    RxedOpMode = msgHeaderPtr->opMode;
-    rxMarker = ntohs(*myBufferShortPtr++);
+  // Check if client is whitelisted
+  if (!isIPWhitelisted(ws->whitelist, &clientKey)) {
+    STAT_INC(ws->packetsDroppedByWhitelist);
+    LOG_ADDR(LOG_CAT_WHITELIST, &clientKey, "server: Dropped packet from non-whitelisted IP: %s");
+    return RX_DROP;
+  }
     
-    // Get pointer to auth token (16 bytes after the header)
-    authTokenPtr = (uint8_t*)(myBufferShortPtr + 1);
+  // Else no error on the recv
+  RxedMsgSize = numBytesRcvd;
     
-    // Verify token (only for established clients)
-    if (clients[client_idx].packetsReceived > 1 && !verifyAuthToken(authTokenPtr, msgHeaderPtr->sequenceNum)) {
-      if (packetsDroppedByAuth % 100 == 1) {  // Log only occasionally
-        printf("server: Authentication failed for packet from %s\n", addrBuffer);
-      }
-      continue;
-    } else {
-      clients[client_idx].authenticated = true;
-    }
+  // Parse message header
+  myBufferIntPtr = (uint32_t *)buffer;
+  //unpack to fill in the rx header info
+  msgHeaderPtr->sequenceNum = ntohl(*myBufferIntPtr++);
+  msgHeaderPtr->timeSentSeconds = ntohl(*myBufferIntPtr++);
+  msgHeaderPtr->timeSentNanoSeconds = ntohl(*myBufferIntPtr++);
+
+  myBufferShortPtr = (uint16_t *)myBufferIntPtr;
+  msgHeaderPtr->opMode = ntohs(*myBufferShortPtr++);
+  RxedOpMode = msgHeaderPtr->opMode;
+  rxMarker = ntohs(*myBufferShortPtr++);
     
-    // Check for sequence number anomalies (potential replay attacks)
-    if (clients[client_idx].packetsReceived > 1 && 
-        msgHeaderPtr->sequenceNum <= clients[client_idx].lastSequenceNum) {
-      RxErrorCount++;
-      printf("server: Potential replay attack - out of order packet or duplicate from %s\n", addrBuffer);
-      continue;
+  // Get pointer to auth token (16 bytes after the header)
+  authTokenPtr = (uint8_t*)(myBufferShortPtr + 1);
+
+  //The kernel timestamp leaves out the time spent queued and in the filters
+  processingTime = getCurTimeD();
+  rxWallTime = rxInfo->haveRxTimestamp ? rxInfo->rxTimestamp : processingTime;
+  curSeqNumber = msgHeaderPtr->sequenceNum;
+
+  // Find or create the client record.  Rate limiting, size, auth and
+  // replay checks and the flow's accounting all run under its shard
+  // lock, the logging and sample output after
+  now = ws->clockSec;
+  client = clientTableAcquire(&clientTable, &clientKey, clntAddr, now, &created, &shard);
+  if (!created && (now - (time_t)client->lastSeen > CLIENT_TIMEOUT)) {
+    created = true;
+    clientTableRestartSession(shard, client, now);
+  }
+  if (created) {
+    resetClient(client, now);
+  }
+
+  if (!checkRateLimit(client, ws->clockNs, now)) {
+    // Apply rate limiting
+    verdict = CLIENT_RATE_LIMITED;
+  } else if (numBytesRcvd > MAX_DATA_BUFFER) {
+    // Validate message size more strictly
+    verdict = CLIENT_TOO_LARGE;
+  } else if (client->packetsReceived > 1 && !verifyAuthToken(authTokenPtr, msgHeaderPtr->sequenceNum)) {
+    // Verify token (only for established clients)
+    verdict = CLIENT_AUTH_FAILED;
+  } else {
+    client->authenticated = true;
+    // Sliding window replay check:  a late (reordered) packet inside the
+    // window is accepted once, duplicates and older packets are not
+    replayOutcome = replayWindowUpdate(&shard->replay, clientTableReplayBits(shard, client),
+                                       &client->replayTop, curSeqNumber);
+    if ((replayOutcome == REPLAY_DUPLICATE) || (replayOutcome == REPLAY_TOO_OLD)) {
+      verdict = CLIENT_REPLAY;
+      lateBy = client->replayTop - curSeqNumber;
+    } else if (replayOutcome == REPLAY_LATE) {
+      lateBy = client->replayTop - curSeqNumber;
+      reorderExtent = replayWindowCountAbove(&shard->replay, clientTableReplayBits(shard, client),
+                                             client->replayTop, curSeqNumber);
     }
-    clients[client_idx].lastSequenceNum = msgHeaderPtr->sequenceNum;
+  }
+
+  session = clientTableSession(shard, client);
+  if (verdict == CLIENT_REPLAY) {
+    if (replayOutcome == REPLAY_DUPLICATE)
+      session->numberDuplicates++;
+    else
+      session->numberTooOld++;
+  }
+  if (verdict == CLIENT_OK) {
+    // The client signal to quit is counted but is not a sample
+    terminate = (curSeqNumber == MAX_UINT32);
+    memset(&record, 0, sizeof(record));
+    record.rxWallTime = rxWallTime;
+    record.timeSentSeconds = msgHeaderPtr->timeSentSeconds;
+    record.timeSentNanoSeconds = msgHeaderPtr->timeSentNanoSeconds;
+    record.seq = curSeqNumber;
+    record.size = RxedMsgSize;
+    record.flowId = session->flowId;
+    record.entry = clientTableEntry(shard, client);
+    record.reorderExtent = reorderExtent;
+    record.lateBy = lateBy;
+    record.shard = (uint16_t)clientTableShardIndex(&clientTable, shard);
+    record.opMode = RxedOpMode;
+    record.flags = terminate ? STATS_RECORD_TERMINATE : 0;
+    // With the pipeline the stats thread updates the session later
+    if (ws->statsRing == NULL)
+      updateFlowSession(shard, session, &record, &update);
+    lastSeqNumber = session->lastSeqNumber;
+  }
+  clientTableRelease(shard);
+
+  switch (verdict) {
+  case CLIENT_RATE_LIMITED:
+    STAT_INC(ws->packetsDroppedByRateLimit);
+    LOG_ADDR(LOG_CAT_RATE_LIMIT, &clientKey, "server: Rate limiting dropped packet from %s");
+    return RX_DROP;
+
+  case CLIENT_TOO_LARGE:
+    STAT_INC(ws->RxErrorCount);
+    LOG_ADDR(LOG_CAT_RX_ERROR, &clientKey, "server: Packet too large (%d bytes) from %s", numBytesRcvd);
+    return RX_DROP;
+
+  case CLIENT_AUTH_FAILED:
+    STAT_INC(ws->packetsDroppedByAuth);
+    LOG_ADDR(LOG_CAT_AUTH, &clientKey, "server: Authentication failed for packet from %s");
+    return RX_DROP;
+
+  case CLIENT_REPLAY:
+    STAT_INC(ws->packetsDroppedByReplay);
+    if (replayOutcome == REPLAY_DUPLICATE)
+      LOG_ADDR(LOG_CAT_REPLAY, &clientKey, "server: Potential replay attack - duplicate seq:%u from %s", curSeqNumber);
+    else
+      LOG_ADDR(LOG_CAT_REPLAY, &clientKey, "server: Potential replay attack - seq:%u is %u behind, outside the replay window, from %s",
+               curSeqNumber, lateBy);
+    return RX_DROP;
+
+  default:
+    break;
+  }
 
-    // Process remaining packet
-    wallTime = getCurTimeD();
-    totalBytesRxed += RxedMsgSize;
-    receivedCount++;
+  // Process remaining packet
+  if (rxInfo->haveRxTimestamp) {
+    double tsGap = processingTime - rxInfo->rxTimestamp;
+    ws->kernelTsGapSum += tsGap;
+    if (tsGap > ws->kernelTsGapMax)
+      ws->kernelTsGapMax = tsGap;
+    ws->kernelTsSamples++;
+  } else {
+    ws->userTsSamples++;
+  }
+  STAT_ADD(ws->totalBytesRxed, RxedMsgSize);
+  STAT_INC(ws->receivedCount);
     
-    // Check if this is the client signal to quit
-    if (msgHeaderPtr->sequenceNum == MAX_UINT32) {
-      printf("server: client TERMINATE signal (size:%d) arrived from client:%s curSeqNumber:%d lastSeqNumber:%d opMode:%d, Marker:0x%04x\n", 
-         RxedMsgSize, addrBuffer, msgHeaderPtr->sequenceNum, lastSeqNumber, (int32_t)RxedOpMode, rxMarker);
-      //To compute stats ...
-      CNTCCode();
-    } else {
-      //Make sure we record this here and NOT if we detect the TERMINATE 
-      timeOfLastRxedMsg = wallTime;
-      if (timeOfFirstRxedMsg == -1.0) {
-        timeOfFirstRxedMsg = wallTime;
-      }
-      
-      //Current wallclock time - packet send time
-      sendTime = ((double)msgHeaderPtr->timeSentSeconds + (((double)msgHeaderPtr->timeSentNanoSeconds)/1000000000.0));
-      OWDSample = wallTime - sendTime;
+  // Check if this is the client signal to quit
+  if (terminate) {
+    if (ws->statsRing != NULL)
+      statsRingPush(ws->statsRing, &record);
+    LOG_ADDR(LOG_CAT_CONTROL, &clientKey,
+       "server: client TERMINATE signal (size:%d) arrived from client:%s curSeqNumber:%d lastSeqNumber:%d opMode:%d, Marker:0x%04x",
+       RxedMsgSize, curSeqNumber, lastSeqNumber, RxedOpMode, rxMarker);
+    //The caller computes the stats (CNTCCode) once any pending echoes are out
+    return RX_TERMINATE;
+  }
+
+  // The echo does not wait for the flow accounting:  with the pipeline
+  // a bad gap (FLOW_BAD_GAP) is only seen after the packet went back, so
+  // inline it is echoed too.  Only the outputFile line is left out.
+  if (ws->statsRing != NULL) {
+    // The stats thread does the rest, a full ring drops the record (counted)
+    statsRingPush(ws->statsRing, &record);
+  } else {
+    accountFlowUpdate(ws, &record, &clientKey, &update);
+  }
+
+#ifdef TRACE 
+  printf("server: Rx %d bytes from ", (int32_t) numBytesRcvd);
+  fputs(" client ", stdout);
+  PrintSocketAddress((struct sockaddr *) clntAddr, stdout);
+  fputc('\n', stdout);
+#endif
+
+  if (RxedOpMode == opModeRTT) {
+    // Generate server auth token for response
+    generateResponseToken(authTokenPtr, msgHeaderPtr->sequenceNum);
+    return RX_ECHO;
+  }
 
-      if (OWDSample < 0)
-        numberNegativeOWDSamples++;
+  return RX_DONE;
+}
+
+/*************************************************************
+*
+* Function: void updateFlowSession(ClientShard *shard, FlowSession *session,
+*                                  const StatsRecord *rec, FlowUpdate *update)
+* 
+* Summary: The flow's share of an accepted packet:  its counts and, unless
+*          it is the terminate signal, the sequence, gap and OWD accounting.
+*          Called with the session's shard locked, by the worker or (with
+*          the pipeline) by its stats thread.  A session's first packet
+*          counts it in the shard's liveFlows.
+*
+***************************************************************/
+void updateFlowSession(ClientShard *shard, FlowSession *session, const StatsRecord *rec, FlowUpdate *update) 
+{
+  double sendTime = ((double)rec->timeSentSeconds + (((double)rec->timeSentNanoSeconds)/1000000000.0));
+
+  update->outcome = FLOW_IN_ORDER;
+  session->totalBytesRxed += rec->size;
+  if (session->receivedCount++ == 0)
+    clientTableSessionStarted(shard);
+  if ((rec->flags & STATS_RECORD_TERMINATE) == 0) {
+    update->outcome = flowSessionRecord(session, rec->seq, sendTime, rec->rxWallTime, alpha, &update->arrival);
+    if (update->outcome == FLOW_OUT_OF_ORDER)
+      flowSessionReordered(session, rec->reorderExtent, rec->lateBy);
+  }
+  update->largestSeqRecv = session->largestSeqRecv;
+  update->smoothedOWD = session->smoothedOWD;
+  update->numberOfGaps = session->numberOfGaps;
+}
 
-      if (OWDSample > maxOWDSample)
-        maxOWDSample = OWDSample;
-      if (OWDSample < minOWDSample)
-        minOWDSample = OWDSample;
+/*************************************************************
+*
+* Function: void accountFlowUpdate(WorkerState *ws, const StatsRecord *rec,
+*                                  const NetAddrKey *clientKey, const FlowUpdate *update)
+* 
+* Summary: What follows a data packet's updateFlowSession, after the
+*          shard lock is released:  the worker's running totals, the
+*          sample capture, the sequence messages and the outputFile line.
+*          A FLOW_BAD_GAP packet is logged but not written out.
+*
+***************************************************************/
+void accountFlowUpdate(WorkerState *ws, const StatsRecord *rec, const NetAddrKey *clientKey, const FlowUpdate *update) 
+{
+  const FlowArrival *arrival = &update->arrival;
+  int64_t OWDNs = (int64_t)(arrival->OWDSample * 1000000000.0);
+
+  STAT_INC(ws->OWDSamples);
+  STAT_ADD(ws->OWDSumNs, OWDNs);
+  latencyHistogramRecordShared(&ws->OWDHist, OWDNs);
+  if (arrival->thisGap > 0)
+    STAT_ADD(ws->lostPackets, arrival->thisGap);
+  STAT_ADD(ws->gapsStarted, arrival->gapStarted);
+  if (update->outcome == FLOW_OUT_OF_ORDER)
+    STAT_INC(ws->recoveredPackets);
+  STAT_ADD(ws->jitterSumNs, (int64_t)(arrival->jitter * 1000000000.0));
+  if (arrival->haveIPDV) {
+    STAT_ADD(ws->IPDVAbsSumNs, (int64_t)(fabs(arrival->IPDV) * 1000000000.0));
+    STAT_INC(ws->IPDVCount);
+  }
 
 #ifdef CREATESAMPLEARRAYS
-      //Update the array
-      if (sampleArrayIndex < MAX_SAMPLES) {
-        OWDSampleArrayTS[sampleArrayIndex] = wallTime;
-        OWDSampleArray[sampleArrayIndex] = OWDSample;
-        seqNoArray[sampleArrayIndex] = msgHeaderPtr->sequenceNum;
-        sampleArrayIndex++;
-      }
+  if (ws->samples != NULL) {
+    SampleRecord sample;
+    sample.rxTimeNs = (uint64_t)(rec->rxWallTime * 1000000000.0);
+    sample.owdNs = OWDNs;
+    sample.seq = rec->seq;
+    sample.size = rec->size;
+    sample.flow = rec->flowId;
+    sampleCaptureAppend(ws->samples, &sample);
+  }
 #endif
 
-      OWDSum += OWDSample;
-      numberOWDSamples++;
-
-      //Init the filter
-      if (numberOWDSamples == 1) {
-        smoothedOWD = OWDSample;
-      } else {
-        smoothedOWD = alpha*OWDSample + (1-alpha)*smoothedOWD;
-      }
+  // A late packet is accounted and echoed like any other
+  if (update->outcome == FLOW_OUT_OF_ORDER) {
+    LOG_ADDR(LOG_CAT_SEQUENCE, clientKey, "server: Out of order packet detected from %s: cur:%d last:%d extent:%u",
+             rec->seq, arrival->lastSeqNumber, rec->reorderExtent);
+  }
 
-      if (msgHeaderPtr->sequenceNum > largestSeqRecv)
-        largestSeqRecv = msgHeaderPtr->sequenceNum;
+#ifdef CREATEGAPARRAY
+  if ((arrival->gapEnded > 0) && (ws->gapArrayIndex < ws->gapArrayMax)) {
+    gapArraySize[ws->gapArrayBase + ws->gapArrayIndex] = arrival->gapEnded;
+    gapArraySeqNo[ws->gapArrayBase + ws->gapArrayIndex] = rec->seq;
+    gapArrayTS[ws->gapArrayBase + ws->gapArrayIndex] = rec->rxWallTime;
+    ws->gapArrayIndex++;
+  }
+#endif
 
-      curSeqNumber = msgHeaderPtr->sequenceNum;
-      if (curSeqNumber <= lastSeqNumber) {
-        numberOutOfOrder++;
-        printf("server: Out of order packet detected: cur:%d last:%d\n", curSeqNumber, lastSeqNumber);
-        continue;  // Skip further processing for out-of-order packets
-      }
+  if (update->outcome == FLOW_BAD_GAP) {
+    LOG_ADDR(LOG_CAT_SEQUENCE, clientKey, "server: Warning: bad gap:%d?? numberOfGaps:%d from %s",
+             arrival->thisGap, update->numberOfGaps);
+    return;
+  }
 
-      //sizeCurGap 0 means not in a gap
-      thisGap = curSeqNumber - lastSeqNumber - 1;
+#ifdef TRACE 
+  printf("%f %d %d %d %d %d.%d %3.9f %3.9f\n", rec->rxWallTime, (int32_t)rec->opMode, rec->size, (uint32_t)update->largestSeqRecv, 
+       rec->seq, rec->timeSentSeconds, rec->timeSentNanoSeconds, arrival->OWDSample, update->smoothedOWD);
+#endif
 
-      if ((thisGap > 0) && (sizeCurGap > 0)) {
-        //if true, stay in the current active gap
-        sizeCurGap += thisGap;
-      }
+  if (doSampleOutput) {
+    fprintf(outputFID, "%f %d %d %d %d %d.%d %3.9f %3.9f\n", rec->rxWallTime, (int32_t)rec->opMode, rec->size, (uint32_t)update->largestSeqRecv, 
+       rec->seq, rec->timeSentSeconds, rec->timeSentNanoSeconds, arrival->OWDSample, update->smoothedOWD);
+  }
+}
 
-      if ((thisGap > 0) && (sizeCurGap == 0)) {
-        //if true, start this new active gap
-        numberOfGaps++;
-        sizeCurGap = thisGap;
-      }
+/*************************************************************
+*
+* Function: void accountStatsBatch(WorkerState *ws, uint32_t count)
+* 
+* Summary: The stats thread's side of processRxedMessage for the next
+*          count (at most STATS_RING_BATCH) records of the worker's ring:
+*          finds each record's session again and accounts the packet as
+*          the worker would have inline.  A run of records in one shard
+*          takes its lock once.  The sessions are all updated first, the
+*          accountFlowUpdate part follows once the lock is released.  A
+*          record whose client was removed or restarted since it was
+*          queued is counted as stale.
+*
+***************************************************************/
+void accountStatsBatch(WorkerState *ws, uint32_t count) 
+{
+  FlowUpdate updates[STATS_RING_BATCH];
+  NetAddrKey clientKeys[STATS_RING_BATCH];
+  bool accounted[STATS_RING_BATCH];
+  ClientShard *shard = NULL;
+  FlowSession *session = NULL;
+  const StatsRecord *rec = NULL;
+  uint32_t i = 0;
+
+  for (i = 0; i < count; i++) {
+    rec = statsRingAt(ws->statsRing, i);
+    if ((shard != NULL) && (rec->shard == clientTableShardIndex(&clientTable, shard))) {
+      session = clientTableFindSession(shard, rec->entry, rec->flowId);
+    } else {
+      if (shard != NULL)
+        clientTableRelease(shard);
+      shard = NULL;
+      session = clientTableLockSession(&clientTable, rec->shard, rec->entry, rec->flowId, &shard);
+    }
+    accounted[i] = (session != NULL);
+    if (session == NULL) {
+      ws->staleRecords++;
+      continue;
+    }
+    updateFlowSession(shard, session, rec, &updates[i]);
+    clientKeys[i] = session->key;
+  }
+  if (shard != NULL)
+    clientTableRelease(shard);
 
-      if ((thisGap == 0) && (sizeCurGap > 0)) {
-        //if true, end the active gap.... 
-        sumOfAllGaps += sizeCurGap;
+  for (i = 0; i < count; i++) {
+    rec = statsRingAt(ws->statsRing, i);
+    if (accounted[i] && ((rec->flags & STATS_RECORD_TERMINATE) == 0))
+      accountFlowUpdate(ws, rec, &clientKeys[i], &updates[i]);
+  }
+}
 
-#ifdef CREATEGAPARRAY
-        if (gapArrayIndex < MAX_GAPS) {
-          gapArraySize[gapArrayIndex] = sizeCurGap;
-          gapArraySeqNo[gapArrayIndex] = curSeqNumber;
-          gapArrayTS[gapArrayIndex] = wallTime;
-          gapArrayIndex++;
+/*************************************************************
+*
+* Function: void* statsThread(void* arg)
+* 
+* Summary: A worker's stats thread (-P):  pops its ring in batches of up
+*          to STATS_RING_BATCH records and accounts them.  Polls every
+*          STATS_RING_IDLE_NS while the ring is empty.  Once CNTCCode
+*          clears pipelineRunning it drains the ring and exits.
+*
+***************************************************************/
+void* statsThread(void* arg) 
+{
+    WorkerState *ws = (WorkerState *)arg;
+    struct timespec idle = {0, STATS_RING_IDLE_NS};
+    uint32_t count = 0;
+    bool running = true;
+
+    while (true) {
+        running = __atomic_load_n(&pipelineRunning, __ATOMIC_ACQUIRE);
+        count = statsRingAvailable(ws->statsRing, STATS_RING_BATCH);
+        if (count == 0) {
+            if (!running)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
         }
-#endif
-        sizeCurGap = 0;
-      }
+        accountStatsBatch(ws, count);
+        statsRingConsume(ws->statsRing, count);
+    }
+    return NULL;
+}
+
+/*************************************************************
+*
+* Function: int processRxedDatagram(WorkerState *ws, char *buffer, ssize_t numBytesRcvd,
+*                                   struct sockaddr_storage *clntAddr,
+*                                   RxControlInfo *rxInfo, size_t *echoLen)
+* 
+* Summary: Splits a GRO coalesced datagram back into the client's
+*          segments and runs each one through processRxedMessage, so
+*          the sequence, gap and OWD accounting sees every segment.
+*          The segments share the coalesced datagram's receive timestamp.
+*          A datagram that was not coalesced is passed straight through.
+*
+* Inputs:
+*   rxInfo : from parseRxControl, gsoSize is the segment size
+*
+* outputs:  
+*   returns RX_TERMINATE if a segment was the terminate signal, else
+*   RX_ECHO if anything has to be sent back, else RX_DONE.
+*   *echoLen is the number of bytes at the front of the buffer to echo.
+*
+* notes: 
+*   The segments being echoed are compacted to the front of the buffer.
+*   All segments are gsoSize bytes except possibly the last, and so are
+*   the echoed ones, so the echo can go back as one GSO send.
+*   Echoes ahead of a terminate signal are still reported in *echoLen.
+*   A datagram whose segments are shorter than GSO_MIN_SEGMENT is
+*   dropped, there is no room for the response token in them.
+*
+***************************************************************/
+int processRxedDatagram(WorkerState *ws, char *buffer, ssize_t numBytesRcvd, struct sockaddr_storage *clntAddr,
+                        RxControlInfo *rxInfo, size_t *echoLen) 
+{
+  ssize_t offset = 0;
+  ssize_t segLen = 0;
+  size_t echoed = 0;
+  int outcome = RX_DONE;
+
+  *echoLen = 0;
+  if ((rxInfo->gsoSize == 0) || (numBytesRcvd <= rxInfo->gsoSize)) {
+    outcome = processRxedMessage(ws, buffer, numBytesRcvd, clntAddr, rxInfo);
+    if (outcome == RX_ECHO)
+      *echoLen = numBytesRcvd;
+    return outcome;
+  }
 
-      if (thisGap < 0) {
-        printf("server: Warning: bad gap:%d?? numberOfGaps:%d\n", thisGap, numberOfGaps);
+  //The response token written into a segment shorter than that would
+  //overwrite the next segment's header
+  if (rxInfo->gsoSize < GSO_MIN_SEGMENT) {
+    STAT_INC(ws->RxErrorCount);
+    LOG_EVENT(LOG_CAT_RX_ERROR, "server: Dropped GRO datagram, segment size %d less than MIN (%d)",
+              rxInfo->gsoSize, GSO_MIN_SEGMENT);
+    return RX_DONE;
+  }
+
+  ws->groDatagrams++;
+  while (offset < numBytesRcvd) {
+    segLen = numBytesRcvd - offset;
+    if (segLen > rxInfo->gsoSize)
+      segLen = rxInfo->gsoSize;
+    ws->groSegments++;
+
+    int segOutcome = processRxedMessage(ws, buffer + offset, segLen, clntAddr, rxInfo);
+    if (segOutcome == RX_TERMINATE) {
+      outcome = RX_TERMINATE;
+      break;
+    }
+    if (segOutcome == RX_ECHO) {
+      if (echoed != (size_t)offset)
+        memmove(buffer + echoed, buffer + offset, segLen);
+      echoed += segLen;
+    }
+    offset += segLen;
+  }
+
+  *echoLen = echoed;
+  if (outcome != RX_TERMINATE)
+    outcome = (echoed > 0) ? RX_ECHO : RX_DONE;
+  return outcome;
+}
+
+/*************************************************************
+*
+* Function: void parseRxControl(struct msghdr *msg, RxControlInfo *rxInfo)
+* 
+* Summary: Pulls what the server uses out of a receive's ancillary data.
+*
+***************************************************************/
+void parseRxControl(struct msghdr *msg, RxControlInfo *rxInfo) 
+{
+  struct cmsghdr *cmsg = NULL;
+
+  memset(rxInfo, 0, sizeof(RxControlInfo));
+  if (msg->msg_control == NULL)
+    return;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+      int gsoSize = 0;
+      memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+      rxInfo->gsoSize = (uint16_t)gsoSize;
+    } else if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      rxInfo->rxTimestamp = (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+      rxInfo->haveRxTimestamp = true;
+    }
+  }
+}
+
+/*************************************************************
+*
+* Function: bool setTxSegmentControl(struct msghdr *msg, char *controlBuffer,
+*                                    size_t echoLen, uint16_t gsoSize)
+* 
+* Summary: Sets up the echo's ancillary data.  An echo of more than one
+*          segment carries a UDP_SEGMENT cmsg so the kernel (or NIC)
+*          splits it back into the client's segments.
+*
+* Inputs:
+*   controlBuffer : at least TX_CONTROL_SIZE bytes
+*
+* outputs:  
+*   returns true if the echo goes out as a GSO send
+*
+***************************************************************/
+bool setTxSegmentControl(struct msghdr *msg, char *controlBuffer, size_t echoLen, uint16_t gsoSize) 
+{
+  struct cmsghdr *cmsg = NULL;
+
+  if ((gsoSize == 0) || (echoLen <= gsoSize)) {
+    msg->msg_control = NULL;
+    msg->msg_controllen = 0;
+    return false;
+  }
+
+  memset(controlBuffer, 0, TX_CONTROL_SIZE);
+  msg->msg_control = controlBuffer;
+  msg->msg_controllen = TX_CONTROL_SIZE;
+  cmsg = CMSG_FIRSTHDR(msg);
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(uint16_t));
+  return true;
+}
+
+/*************************************************************
+*
+* Function: void rxLoopClassic(WorkerState *ws)
+* 
+* Summary: The original receive loop - one recvmsg and (in opModeRTT)
+*          one sendmsg per datagram.  Never returns.
+*
+* notes: 
+*   recvmsg/sendmsg rather than recvfrom/sendto only to carry the
+*   UDP_GRO / UDP_SEGMENT ancillary data.
+*
+***************************************************************/
+void rxLoopClassic(WorkerState *ws) 
+{
+  char *buffer  = NULL;
+  ssize_t numBytesRcvd  = 0;
+  char rxControl[RX_CONTROL_SIZE];
+  char txControl[TX_CONTROL_SIZE];
+  struct iovec rxIov;
+  struct iovec txIov;
+  struct msghdr rxMsg;
+  struct msghdr txMsg;
+  RxControlInfo rxInfo;
+  size_t echoLen = 0;
+
+  // Init memory for first send
+  buffer = malloc((size_t)rxBufferSize + MAX_MSG_HDR);
+  if (buffer == NULL) {
+    printf("server: HARD ERROR malloc of %d bytes failed\n", rxBufferSize + MAX_MSG_HDR);
+    exit(1);
+  }
+  memset(buffer, 0, (size_t)rxBufferSize + MAX_MSG_HDR);
+
+  for (;;) { 
+    struct sockaddr_storage clntAddr; // Client address
+
+    rxIov.iov_base = buffer;
+    rxIov.iov_len = rxBufferSize;
+    memset(&rxMsg, 0, sizeof(rxMsg));
+    rxMsg.msg_name = &clntAddr;
+    // Set Length of client address structure (in-out parameter)
+    rxMsg.msg_namelen = sizeof(clntAddr);
+    rxMsg.msg_iov = &rxIov;
+    rxMsg.msg_iovlen = 1;
+    rxMsg.msg_control = rxControl;
+    rxMsg.msg_controllen = sizeof(rxControl);
+
+    // Block until receive message from a client
+    workerOffline(ws);
+    numBytesRcvd = recvmsg(ws->sock, &rxMsg, 0);
+    workerOnline(ws);
+        
+    if (numBytesRcvd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // Timeout occurred, continue to allow cleanup thread to run
         continue;
       }
+      STAT_INC(ws->RxErrorCount);
+      LOG_ERRNO(LOG_CAT_RX_ERROR, errno, "server: Error on recvmsg");
+      continue;
+    }
+    refreshWorkerClock(ws);
+    parseRxControl(&rxMsg, &rxInfo);
+
+    int outcome = processRxedDatagram(ws, buffer, numBytesRcvd, &clntAddr, &rxInfo, &echoLen);
+
+    if (echoLen > 0) {
+      // Send received datagram back to the client
+      txIov.iov_base = buffer;
+      txIov.iov_len = echoLen;
+      memset(&txMsg, 0, sizeof(txMsg));
+      txMsg.msg_name = &clntAddr;
+      txMsg.msg_namelen = rxMsg.msg_namelen;
+      txMsg.msg_iov = &txIov;
+      txMsg.msg_iovlen = 1;
+      if (setTxSegmentControl(&txMsg, txControl, echoLen, rxInfo.gsoSize))
+        ws->gsoEchoes++;
+
+      ssize_t numBytesSent = sendmsg(ws->sock, &txMsg, 0);
+      if (numBytesSent < 0) {
+        STAT_INC(ws->TxErrorCount);
+        LOG_ERRNO(LOG_CAT_TX_ERROR, errno, "server: Error on sendmsg");
+      }
+      else if ((size_t)numBytesSent != echoLen) {
+        STAT_INC(ws->TxErrorCount);
+        LOG_EVENT(LOG_CAT_TX_ERROR, "server: Error on sendmsg, only sent %d rather than %d", numBytesSent, echoLen);
+      }
+    }
 
-      lastSeqNumber = curSeqNumber;
+    if (outcome == RX_TERMINATE) {
+      //To compute stats ...
+      CNTCCode();
+    }
+  } //main loop
+}
 
-#ifdef TRACE 
-      printf("%f %d %d %d %d %d.%d %3.9f %3.9f\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, largestSeqRecv, 
-           msgHeaderPtr->sequenceNum, msgHeaderPtr->timeSentSeconds, msgHeaderPtr->timeSentNanoSeconds, OWDSample, smoothedOWD);
-#endif
+/*************************************************************
+*
+* Function: void rxLoopBatched(WorkerState *ws)
+* 
+* Summary: Drains up to batchSize datagrams per recvmmsg, runs each
+*          through processRxedMessage and then returns every echo
+*          of the batch with (normally) a single sendmmsg.
+*          Never returns.
+*
+* notes: 
+*   MSG_WAITFORONE blocks for the first datagram only, so a lightly
+*   loaded server does not sit on a partially filled batch.
+*   Echo buffers are the rx buffers themselves - the batch is fully
+*   sent before the next recvmmsg reuses them.
+*   Each message has its own rx and tx ancillary data buffer for
+*   UDP_GRO / UDP_SEGMENT.
+*
+***************************************************************/
+void rxLoopBatched(WorkerState *ws) 
+{
+  struct mmsghdr *rxMsgs = calloc(batchSize, sizeof(struct mmsghdr));
+  struct iovec *rxIovs = calloc(batchSize, sizeof(struct iovec));
+  struct sockaddr_storage *rxAddrs = calloc(batchSize, sizeof(struct sockaddr_storage));
+  struct mmsghdr *txMsgs = calloc(batchSize, sizeof(struct mmsghdr));
+  struct iovec *txIovs = calloc(batchSize, sizeof(struct iovec));
+  size_t rxStride = (size_t)rxBufferSize + MAX_MSG_HDR;
+  char *rxBuffers = malloc((size_t)batchSize * rxStride);
+  char *rxControls = malloc((size_t)batchSize * RX_CONTROL_SIZE);
+  char *txControls = malloc((size_t)batchSize * TX_CONTROL_SIZE);
+  RxControlInfo rxInfo;
+  size_t echoLen = 0;
+  int numRxed = 0;
+  int numEchoes = 0;
+  int numSent = 0;
+  int i = 0;
+  bool terminate = false;
+
+  if (!rxMsgs || !rxIovs || !rxAddrs || !txMsgs || !txIovs || !rxBuffers || !rxControls || !txControls) {
+    printf("server: HARD ERROR malloc of %d batch buffers failed\n", batchSize);
+    exit(1);
+  }
+  memset(rxBuffers, 0, (size_t)batchSize * rxStride);
+
+  for (;;) {
+    for (i = 0; i < batchSize; i++) {
+      rxIovs[i].iov_base = rxBuffers + ((size_t)i * rxStride);
+      rxIovs[i].iov_len = rxBufferSize;
+      rxMsgs[i].msg_hdr.msg_name = &rxAddrs[i];
+      rxMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+      rxMsgs[i].msg_hdr.msg_iov = &rxIovs[i];
+      rxMsgs[i].msg_hdr.msg_iovlen = 1;
+      rxMsgs[i].msg_hdr.msg_control = rxControls + ((size_t)i * RX_CONTROL_SIZE);
+      rxMsgs[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+      rxMsgs[i].msg_hdr.msg_flags = 0;
+    }
 
-      if (doSampleOutput) {
-        fprintf(outputFID, "%f %d %d %d %d %d.%d %3.9f %3.9f\n", wallTime, (int32_t)RxedOpMode, RxedMsgSize, largestSeqRecv, 
-           msgHeaderPtr->sequenceNum, msgHeaderPtr->timeSentSeconds, msgHeaderPtr->timeSentNanoSeconds, OWDSample, smoothedOWD);
+    workerOffline(ws);
+    numRxed = recvmmsg(ws->sock, rxMsgs, batchSize, MSG_WAITFORONE, NULL);
+    workerOnline(ws);
+    if (numRxed < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // Timeout occurred, continue to allow cleanup thread to run
+        continue;
       }
+      STAT_INC(ws->RxErrorCount);
+      LOG_ERRNO(LOG_CAT_RX_ERROR, errno, "server: Error on recvmmsg");
+      continue;
+    }
+    ws->rxBatchCount++;
+    ws->rxBatchMsgs += numRxed;
+    refreshWorkerClock(ws);
+
+    numEchoes = 0;
+    for (i = 0; i < numRxed; i++) {
+      parseRxControl(&rxMsgs[i].msg_hdr, &rxInfo);
+      int outcome = processRxedDatagram(ws, rxIovs[i].iov_base, rxMsgs[i].msg_len, &rxAddrs[i], &rxInfo, &echoLen);
+      if (echoLen > 0) {
+        txIovs[numEchoes].iov_base = rxIovs[i].iov_base;
+        txIovs[numEchoes].iov_len = echoLen;
+        memset(&txMsgs[numEchoes], 0, sizeof(struct mmsghdr));
+        txMsgs[numEchoes].msg_hdr.msg_name = &rxAddrs[i];
+        txMsgs[numEchoes].msg_hdr.msg_namelen = rxMsgs[i].msg_hdr.msg_namelen;
+        txMsgs[numEchoes].msg_hdr.msg_iov = &txIovs[numEchoes];
+        txMsgs[numEchoes].msg_hdr.msg_iovlen = 1;
+        if (setTxSegmentControl(&txMsgs[numEchoes].msg_hdr, txControls + ((size_t)numEchoes * TX_CONTROL_SIZE),
+                                echoLen, rxInfo.gsoSize))
+          ws->gsoEchoes++;
+        numEchoes++;
+      }
+      if (outcome == RX_TERMINATE) {
+        terminate = true;
+        break;
+      }
+    }
 
-#ifdef TRACE 
-      printf("server: Rx %d bytes from ", (int32_t) numBytesRcvd);
-      fputs(" client ", stdout);
-      PrintSocketAddress((struct sockaddr *) &clntAddr, stdout);
-      fputc('\n', stdout);
-#endif
-
-      if (RxedOpMode == opModeRTT) {
-        // Generate server auth token for response
-        generateResponseToken(authTokenPtr, msgHeaderPtr->sequenceNum);
-        
-        // Send received datagram back to the client
-        ssize_t numBytesSent = sendto(sock, buffer, numBytesRcvd, 0,
-          (struct sockaddr *) &clntAddr, sizeof(clntAddr));
-        if (numBytesSent < 0) {
-          TxErrorCount++;
-          perror("server: Error on sendto ");
-          continue;
-        }
-        else if (numBytesSent != numBytesRcvd) {
-          TxErrorCount++;
-          printf("server: Error on sendto, only sent %d rather than %d ",(int32_t)numBytesSent,(int32_t)numBytesRcvd);
-          continue;
+    //sendmmsg may stop short, and stops at the first datagram that fails
+    numSent = 0;
+    while (numSent < numEchoes) {
+      int rc = sendmmsg(ws->sock, &txMsgs[numSent], numEchoes - numSent, 0);
+      if (rc < 0) {
+        STAT_INC(ws->TxErrorCount);
+        LOG_ERRNO(LOG_CAT_TX_ERROR, errno, "server: Error on sendmmsg");
+        numSent++;   //skip the failed datagram
+        continue;
+      }
+      ws->txBatchCount++;
+      ws->txBatchMsgs += rc;
+      for (i = numSent; i < numSent + rc; i++) {
+        if (txMsgs[i].msg_len != txIovs[i].iov_len) {
+          STAT_INC(ws->TxErrorCount);
+          LOG_EVENT(LOG_CAT_TX_ERROR, "server: Error on sendmmsg, only sent %d rather than %d",
+                    txMsgs[i].msg_len, txIovs[i].iov_len);
         }
       }
-    }  //else not the client terminate signal 
+      numSent += rc;
+    }
+
+    if (terminate) {
+      //To compute stats ...
+      CNTCCode();
+    }
   } //main loop
 }
 
-void CNTCCode() 
+/*************************************************************
+*
+* Function: int rxLoopUring(WorkerState *ws)
+* 
+* Summary: io_uring receive/echo engine.  A single multishot recvmsg
+*          draws buffers from a registered provided-buffer ring, each
+*          datagram goes through processRxedMessage exactly as in the
+*          other loops, and echoes are queued as IORING_OP_SENDMSG
+*          straight out of the receive buffer.  One io_uring_enter per
+*          loop both submits the queued echoes and waits for more
+*          completions, so steady state costs no per packet syscalls.
+*
+* outputs:  
+*   returns ERROR (errno set) if the ring could not be set up - the
+*   caller then falls back to the recvmmsg/recvfrom loops.
+*   Otherwise never returns.
+*
+* notes: 
+*   A buffer is recycled once its datagram is dropped/accounted, or
+*   once the echo's send completion arrives.
+*   Datagrams completing after the terminate signal are not processed,
+*   matching the classic loop which stops at the terminate signal.
+*
+***************************************************************/
+int rxLoopUring(WorkerState *ws) 
 {
-  double  duration = 0.0;
-  double avgLossRate1  = 0.0;
-  double avgLossRate2  = 0.0;
-  double avgGapSize=0.0;
-  double avgLossEventRate=0.0;
-  int32_t i=0;
+  UringContext ring;
+  UringContext *u = &ring;
+  struct msghdr rxMsgTemplate;
+  struct msghdr *txMsgs = NULL;
+  struct iovec *txIovs = NULL;
+  char *txControls = NULL;
+  struct msghdr rxControlMsg;
+  RxControlInfo rxInfo;
+  size_t echoLen = 0;
+  struct io_uring_sqe *sqe = NULL;
+  struct io_uring_cqe *cqe = NULL;
+  struct io_uring_recvmsg_out *rxOut = NULL;
+  uint32_t bufSize = 0;
+  uint32_t numCompletions = 0;
+  uint32_t numEchoes = 0;
+  uint32_t sendsInFlight = 0;
+  bool armRecv = true;
+  bool terminate = false;
+  int rc = NOERROR;
+
+  if (uringInit(u, URING_QUEUE_DEPTH) == ERROR)
+    return ERROR;
+
+  memset(&rxMsgTemplate, 0, sizeof(rxMsgTemplate));
+  rxMsgTemplate.msg_namelen = sizeof(struct sockaddr_storage);
+  rxMsgTemplate.msg_controllen = (useGRO || useKernelTimestamps) ? RX_CONTROL_SIZE : 0;
+
+  //Each buffer holds the recvmsg header, the source address, the ancillary
+  //data and the datagram (plus the token slack)
+  bufSize = sizeof(struct io_uring_recvmsg_out) + rxMsgTemplate.msg_namelen + rxMsgTemplate.msg_controllen +
+            rxBufferSize + MAX_MSG_HDR;
+  bufSize = (bufSize + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+  if (uringSetupBufRing(u, URING_BUF_GROUP, URING_NUM_BUFFERS, bufSize) == ERROR) {
+    int savedErrno = errno;
+    uringExit(u);
+    errno = savedErrno;
+    return ERROR;
+  }
+
+  txMsgs = calloc(URING_NUM_BUFFERS, sizeof(struct msghdr));
+  txIovs = calloc(URING_NUM_BUFFERS, sizeof(struct iovec));
+  txControls = calloc(URING_NUM_BUFFERS, TX_CONTROL_SIZE);
+  if (!txMsgs || !txIovs || !txControls) {
+    printf("server: HARD ERROR malloc of io_uring send state failed\n");
+    exit(1);
+  }
+
+  ws->ioEngine = IO_ENGINE_URING;
+  printf("server: worker %d using io_uring (%d buffers of %d bytes)\n", ws->id, URING_NUM_BUFFERS, bufSize);
+
+  for (;;) {
+    if (armRecv) {
+      sqe = uringGetSqe(u);
+      if (sqe == NULL) {
+        (void) uringSubmit(u, 0);
+        sqe = uringGetSqe(u);
+      }
+      if (sqe != NULL) {
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = ws->sock;
+        sqe->addr = (uint64_t)(uintptr_t)&rxMsgTemplate;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+        sqe->user_data = URING_UD_RECV;
+        ws->uringRecvArms++;
+        armRecv = false;
+      }
+    }
 
-  //Estimate loss based on total observed drops
-  uint32_t totalLost2 = 0;
+    if (numEchoes > 0)
+      ws->txBatchCount++;
+    workerOffline(ws);
+    rc = uringSubmit(u, 1);
+    workerOnline(ws);
+    if (rc == ERROR) {
+      STAT_INC(ws->RxErrorCount);
+      LOG_ERRNO(LOG_CAT_RX_ERROR, errno, "server: Error on io_uring_enter");
+      continue;
+    }
+    refreshWorkerClock(ws);
+
+    numCompletions = 0;
+    numEchoes = 0;
+    while ((cqe = uringPeekCqe(u)) != NULL) {
+      uint64_t userData = cqe->user_data;
+      int32_t res = cqe->res;
+      uint32_t cqeFlags = cqe->flags;
+      uringCqeSeen(u);
+
+      if (userData != URING_UD_RECV) {
+        //An echo completed - its buffer can be reused
+        uint16_t bufId = (uint16_t)(userData & 0xffff);
+        if (res < 0) {
+          STAT_INC(ws->TxErrorCount);
+          LOG_ERRNO(LOG_CAT_TX_ERROR, -res, "server: Error on io_uring sendmsg");
+        } else if ((size_t)res != txIovs[bufId].iov_len) {
+          STAT_INC(ws->TxErrorCount);
+          LOG_EVENT(LOG_CAT_TX_ERROR, "server: Error on io_uring sendmsg, only sent %d rather than %d",
+                    res, txIovs[bufId].iov_len);
+        }
+        sendsInFlight--;
+        uringRecycleBuffer(u, bufId);
+        continue;
+      }
 
-  //Estimate loss based on best guess of number the client sent
-  uint32_t totalLost1 = 0;
-  uint32_t numberOfTrials;
+      //The multishot recv ends on errors and when it runs out of buffers
+      if (!(cqeFlags & IORING_CQE_F_MORE))
+        armRecv = true;
 
-  double avgOWD = 0.0; 
-  double avgThroughput = 0.0;
+      if (res < 0) {
+        if (res == -ENOBUFS) {
+          ws->uringNoBuffers++;
+        } else {
+          STAT_INC(ws->RxErrorCount);
+          LOG_ERRNO(LOG_CAT_RX_ERROR, -res, "server: Error on io_uring recvmsg");
+        }
+        continue;
+      }
+      if (!(cqeFlags & IORING_CQE_F_BUFFER))
+        continue;
 
-  //estimate number of trials (only the sender knows this for sure)
-  //based on largest seq number seen
-  numberOfTrials = largestSeqRecv;
+      uint16_t bufId = (uint16_t)(cqeFlags >> IORING_CQE_BUFFER_SHIFT);
+      rxOut = (struct io_uring_recvmsg_out *)uringBuffer(u, bufId);
+      char *rxName = (char *)(rxOut + 1);
+      char *rxPayload = rxName + rxMsgTemplate.msg_namelen + rxMsgTemplate.msg_controllen;
+      numCompletions++;
 
-  wallTime = getCurTimeD();
-  duration = timeOfLastRxedMsg - timeOfFirstRxedMsg;
+      if (terminate) {
+        uringRecycleBuffer(u, bufId);
+        continue;
+      }
+      if (rxOut->flags & MSG_TRUNC) {
+        STAT_INC(ws->RxErrorCount);
+        LOG_EVENT(LOG_CAT_RX_ERROR, "server: Error on io_uring recvmsg, %d byte datagram truncated", rxOut->payloadlen);
+        uringRecycleBuffer(u, bufId);
+        continue;
+      }
 
-  //Compute avgThroughput 
-  if (duration > 0.0) {
-    avgThroughput = ((double)totalBytesRxed * 8.0) / duration;
-  }
+      //Wrap the ancillary data so the CMSG macros can walk it
+      memset(&rxControlMsg, 0, sizeof(rxControlMsg));
+      if (rxOut->controllen > 0) {
+        rxControlMsg.msg_control = rxName + rxMsgTemplate.msg_namelen;
+        rxControlMsg.msg_controllen = rxOut->controllen;
+      }
+      parseRxControl(&rxControlMsg, &rxInfo);
+
+      int outcome = processRxedDatagram(ws, rxPayload, rxOut->payloadlen, (struct sockaddr_storage *)rxName,
+                                        &rxInfo, &echoLen);
+      if (outcome == RX_TERMINATE)
+        terminate = true;
+      if (echoLen == 0) {
+        uringRecycleBuffer(u, bufId);
+        continue;
+      }
 
-  if (numberOWDSamples > 0)
-  {
-    avgOWD = OWDSum / (double)numberOWDSamples;
-  }
+      sqe = uringGetSqe(u);
+      if (sqe == NULL) {
+        (void) uringSubmit(u, 0);
+        sqe = uringGetSqe(u);
+      }
+      if (sqe == NULL) {
+        STAT_INC(ws->TxErrorCount);
+        LOG_EVENT(LOG_CAT_TX_ERROR, "server: Error io_uring SQ full, echo dropped");
+        uringRecycleBuffer(u, bufId);
+        continue;
+      }
+      txIovs[bufId].iov_base = rxPayload;
+      txIovs[bufId].iov_len = echoLen;
+      memset(&txMsgs[bufId], 0, sizeof(struct msghdr));
+      txMsgs[bufId].msg_name = rxName;
+      txMsgs[bufId].msg_namelen = rxOut->namelen;
+      txMsgs[bufId].msg_iov = &txIovs[bufId];
+      txMsgs[bufId].msg_iovlen = 1;
+      if (setTxSegmentControl(&txMsgs[bufId], txControls + ((size_t)bufId * TX_CONTROL_SIZE),
+                              echoLen, rxInfo.gsoSize))
+        ws->gsoEchoes++;
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = ws->sock;
+      sqe->addr = (uint64_t)(uintptr_t)&txMsgs[bufId];
+      sqe->len = 1;
+      sqe->user_data = URING_UD_SEND | bufId;
+      sendsInFlight++;
+      numEchoes++;
+      ws->txBatchMsgs++;
+    }
 
-  if (numberOfTrials >= receivedCount)
-    totalLost1 = numberOfTrials - receivedCount;
-  else 
-    totalLost1 = 0;
+    if (numCompletions > 0) {
+      ws->rxBatchCount++;
+      ws->rxBatchMsgs += numCompletions;
+    }
 
-  totalLost2 = sumOfAllGaps;
+    //Let the echoes that are already queued go out before the summary
+    if (terminate && sendsInFlight == 0) {
+      CNTCCode();
+    }
+  } //main loop
+}
 
-  if (numberOfTrials > 0)
-    avgLossRate1 = (double)totalLost1 / (double)numberOfTrials;
+/***********************************************************
+* Function: void listFlowSession(const FlowSession *session, void *arg)
+*
+* Explanation: clientTableForEachSession callback for CNTCCode:  merges
+*              the flow into the aggregate and prints its summary line,
+*              the first MAX_FLOWS_LISTED flows only
+*
+**************************************************/
+void listFlowSession(const FlowSession *session, void *arg)
+{
+  FlowListing *listing = (FlowListing *)arg;
+  FlowSummary summary;
+  char addrString[INET6_ADDRSTRLEN + 8];
+
+  flowSessionMerge(listing->aggregate, session);
+  if (listing->printed >= MAX_FLOWS_LISTED)
+    return;
+  listing->printed++;
+  flowSessionSummarize(session, &summary);
+  printf("flow %s id:%u \t", addrKeyToString(&session->key, addrString, sizeof(addrString)), session->flowId);
+  flowSessionPrint(stdout, session, &summary);
+}
 
-  if (receivedCount >  0) {
-    avgLossRate2 = ((double)totalLost2) / (double)((receivedCount + totalLost2) * 1.0);
-    avgLossEventRate = ((double)numberOfGaps) / (double)((double)receivedCount + (double)totalLost2);
+void CNTCCode() 
+{
+  uint32_t w=0;
+
+  //Merged over all flows:  those still in the client table and those
+  //that timed out or were evicted
+  FlowSession aggregate;
+  FlowSummary summary;
+  FlowListing listing = {0, 0};
+  uint32_t liveFlows = 0;
+  uint32_t retiredFlows = 0;
+
+  //Merged over all workers
+  uint32_t RxErrorCount = 0;
+  uint32_t TxErrorCount = 0;
+  uint32_t packetsDroppedByRateLimit = 0;
+  uint32_t packetsDroppedByAuth = 0;
+  uint32_t packetsDroppedByWhitelist = 0;
+  uint32_t packetsDroppedByReplay = 0;
+  uint64_t rxBatchCount = 0;
+  uint64_t rxBatchMsgs = 0;
+  uint64_t txBatchCount = 0;
+  uint64_t txBatchMsgs = 0;
+  uint64_t uringRecvArms = 0;
+  uint64_t uringNoBuffers = 0;
+  uint32_t uringWorkers = 0;
+  uint64_t groDatagrams = 0;
+  uint64_t groSegments = 0;
+  uint64_t gsoEchoes = 0;
+  double kernelTsGapSum = 0.0;
+  double kernelTsGapMax = 0.0;
+  uint64_t kernelTsSamples = 0;
+  uint64_t userTsSamples = 0;
+  ClientTableStats clientStats;
+
+  // Only the first caller tears down, the others wait here for its exit()
+  if (__atomic_exchange_n(&teardownStarted, true, __ATOMIC_ACQ_REL)) {
+    for (;;)
+      pause();
   }
 
-  if (numberOfGaps > 0) {
-    avgGapSize = (double)sumOfAllGaps / (double)numberOfGaps;
+  // Write out the queued messages before the summary
+  __atomic_store_n(&reportRunning, false, __ATOMIC_RELAXED);
+  if (__atomic_exchange_n(&liveStatsRunning, false, __ATOMIC_ACQ_REL)) {
+    pthread_join(live_stats_thread, NULL);
+    liveStatsRemove(liveStatsName, liveStats);
+  }
+  // The stats threads account what is still queued before the summary
+  if (__atomic_exchange_n(&pipelineRunning, false, __ATOMIC_ACQ_REL)) {
+    for (w = 0; w < numWorkers; w++) {
+      if (workers[w].statsRing != NULL)
+        pthread_join(workers[w].statsThread, NULL);
+    }
   }
+  asyncLogFlush();
+
+  for (w = 0; w < numWorkers; w++) {
+    WorkerState *ws = &workers[w];
+    RxErrorCount += ws->RxErrorCount;
+    TxErrorCount += ws->TxErrorCount;
+    packetsDroppedByRateLimit += ws->packetsDroppedByRateLimit;
+    packetsDroppedByAuth += ws->packetsDroppedByAuth;
+    packetsDroppedByWhitelist += ws->packetsDroppedByWhitelist;
+    packetsDroppedByReplay += ws->packetsDroppedByReplay;
+    rxBatchCount += ws->rxBatchCount;
+    rxBatchMsgs += ws->rxBatchMsgs;
+    txBatchCount += ws->txBatchCount;
+    txBatchMsgs += ws->txBatchMsgs;
+    uringRecvArms += ws->uringRecvArms;
+    uringNoBuffers += ws->uringNoBuffers;
+    groDatagrams += ws->groDatagrams;
+    groSegments += ws->groSegments;
+    gsoEchoes += ws->gsoEchoes;
+    kernelTsGapSum += ws->kernelTsGapSum;
+    kernelTsSamples += ws->kernelTsSamples;
+    userTsSamples += ws->userTsSamples;
+    if (ws->kernelTsGapMax > kernelTsGapMax)
+      kernelTsGapMax = ws->kernelTsGapMax;
+    if (ws->ioEngine == IO_ENGINE_URING)
+      uringWorkers++;
+  }
+
+  wallTime = getCurTimeD();
+
+  printf("\nFlow Statistics:\n");
+  flowSessionInit(&aggregate, NULL, 0);
+  listing.aggregate = &aggregate;
+  liveFlows = clientTableForEachSession(&clientTable, listFlowSession, &listing);
+  if (listing.printed < liveFlows)
+    printf("... %u more flows not listed\n", liveFlows - listing.printed);
+  retiredFlows = aggregate.numberOfFlows;
+  clientTableMergeRetired(&clientTable, &aggregate);
+  retiredFlows = aggregate.numberOfFlows - retiredFlows;
+  printf("Flows: %u active, %u timed out or evicted\n", liveFlows, retiredFlows);
+  flowSessionSummarize(&aggregate, &summary);
 
   // Print security stats
   printf("\nSecurity Statistics:\n");
   printf("Packets dropped by rate limit: %u\n", packetsDroppedByRateLimit);
   printf("Packets dropped by whitelist: %u\n", packetsDroppedByWhitelist);
+  if (use_whitelist) {
+    printf("Whitelist reloads: %u\n", whitelistReloads);
+  }
   printf("Packets dropped by authentication: %u\n", packetsDroppedByAuth);
-  printf("Out-of-order packets: %u\n\n", numberOutOfOrder);
+  printf("Packets dropped by replay window: %u\n", packetsDroppedByReplay);
+  printf("Out-of-order packets: %u\n", aggregate.numberOutOfOrder);
+  flowSessionPrintReordering(stdout, &aggregate);
+  flowSessionPrintLossModel(stdout, &aggregate);
+  flowSessionPrintDelayVariation(stdout, &aggregate, &summary);
+  printf("Rx errors: %u  Tx errors: %u\n", RxErrorCount, TxErrorCount);
+  clientTableGetStats(&clientTable, &clientStats);
+  printf("Clients tracked: %u of %u, LRU evictions: %lu, expired: %lu\n",
+      clientStats.count, clientStats.capacity, clientStats.evictions, clientStats.expirations);
+  asyncLogPrintStats(stdout);
+  printf("\n");
+
+  if (numWorkers > 1) {
+    printf("Worker Statistics:\n");
+    for (w = 0; w < numWorkers; w++) {
+      printf("worker %2d: rxCount:%9lu rxBytes:%12lu RxErrors:%u TxErrors:%u\n",
+          w, workers[w].receivedCount, workers[w].totalBytesRxed,
+          workers[w].RxErrorCount, workers[w].TxErrorCount);
+    }
+    printf("\n");
+  }
 
-  printf("duration \tmeanOWD \tminOWD     \tmaxOWD    \tavgTh    \tavgLR2    \tavgGapSz    \tavgLER    \tnumOfGps    \ttotLost2    \tavgLR1    \ttotLost1    \trxCount \tnumberNegativeOWDs  \n");
-  printf("%6.2f \t\t%04.9f \t%04.9f \t%04.9f \t%12.0f \t%03.6f \t%03.6f \t%03.6f \t%9d \t%9d \t%3.6f \t%9d  \t%9ld \t%9d \n",
-        duration, avgOWD, minOWDSample, maxOWDSample, avgThroughput, avgLossRate2, avgGapSize, avgLossEventRate, numberOfGaps, totalLost2, avgLossRate1, totalLost1, receivedCount, numberNegativeOWDSamples);
+  if (uringWorkers > 0) {
+    printf("io_uring I/O Statistics (%u of %u workers):\n", uringWorkers, numWorkers);
+    printf("io_uring_enter waits: %lu for %lu datagrams, avg completions per wait: %3.2f\n",
+        rxBatchCount, rxBatchMsgs,
+        (rxBatchCount > 0) ? (double)rxBatchMsgs / (double)rxBatchCount : 0.0);
+    printf("echo submissions: %lu for %lu echoes, recv arms: %lu, out of buffers: %lu\n\n",
+        txBatchCount, txBatchMsgs, uringRecvArms, uringNoBuffers);
+  } else if (batchSize > 1) {
+    printf("Batched I/O Statistics (batchSize:%u):\n", batchSize);
+    printf("recvmmsg calls: %lu for %lu datagrams, avg batch fill: %3.2f (%3.1f%%)\n",
+        rxBatchCount, rxBatchMsgs,
+        (rxBatchCount > 0) ? (double)rxBatchMsgs / (double)rxBatchCount : 0.0,
+        (rxBatchCount > 0) ? 100.0 * (double)rxBatchMsgs / (double)(rxBatchCount * batchSize) : 0.0);
+    printf("sendmmsg calls: %lu for %lu echoes\n\n", txBatchCount, txBatchMsgs);
+  }
+
+  //How long an arrival waits in the server before it is accounted
+  printf("Receive timestamps: kernel:%lu userspace:%lu", kernelTsSamples, userTsSamples);
+  if (kernelTsSamples > 0) {
+    printf("  mean kernel to userspace gap: %4.9f max: %4.9f",
+        kernelTsGapSum / (double)kernelTsSamples, kernelTsGapMax);
+  }
+  printf("\n\n");
+
+  if (useGRO) {
+    printf("UDP GRO/GSO Statistics:\n");
+    printf("coalesced datagrams: %lu carrying %lu segments, avg segments per datagram: %3.2f, GSO echoes: %lu\n\n",
+        groDatagrams, groSegments,
+        (groDatagrams > 0) ? (double)groSegments / (double)groDatagrams : 0.0, gsoEchoes);
+  }
+
+  if (pipelineRecords > 0) {
+    printf("Pipeline Statistics:\n");
+    for (w = 0; w < numWorkers; w++) {
+      StatsRing *ring = workers[w].statsRing;
+      if (ring == NULL) {
+        printf("worker %2d: no stats ring, accounted inline\n", w);
+        continue;
+      }
+      printf("worker %2d: records:%lu high water:%lu of %u dropped (stats thread behind):%lu stale:%lu\n",
+          w, ring->pushed, ring->highWater, ring->size, ring->dropped, workers[w].staleRecords);
+    }
+    printf("\n");
+  }
+
+  printf("duration \tmeanOWD \tminOWD     \tmaxOWD    \tavgTh    \tavgLR2    \tavgGapSz    \tavgLER    \tnumOfGps    \ttotLost2    \tavgLR1    \ttotLost1    \trxCount \tnumberNegativeOWDs \tp50OWD    \tp90OWD    \tp99OWD    \tp999OWD    \tjitter    \tmeanIPDV    \tp999PDV  \n");
+  flowSessionPrint(stdout, &aggregate, &summary);
 
   if (doSampleOutput) {
-    fprintf(outputFID, "%6.2f \t\t%04.9f \t%04.9f \t%04.9f \t%12.0f \t%03.6f \t%03.6f \t%03.6f \t%9d \t%9d \t%3.6f \t%9d  \t%9ld \t%9d \n",
-        duration, avgOWD, minOWDSample, maxOWDSample, avgThroughput, avgLossRate2, avgGapSize, avgLossEventRate, numberOfGaps, totalLost2, avgLossRate1, totalLost1, receivedCount, numberNegativeOWDSamples);
+    flowSessionPrint(outputFID, &aggregate, &summary);
     fclose(outputFID);
   }
 
   resultsFID = fopen(resultsOutputFile, "a");
   if (resultsFID) {
-    fprintf(resultsFID, "%6.2f \t\t%04.9f \t%04.9f \t%04.9f \t%12.0f \t%03.6f \t%03.6f \t%03.6f \t%9d \t%9d \t%3.6f \t%9d  \t%9ld \t%9d \n",
-          duration, avgOWD, minOWDSample, maxOWDSample, avgThroughput, avgLossRate2, avgGapSize, avgLossEventRate, numberOfGaps, totalLost2, avgLossRate1, totalLost1, receivedCount, numberNegativeOWDSamples);
+    flowSessionPrint(resultsFID, &aggregate, &summary);
     fclose(resultsFID);
   }
 
 #ifdef CREATESAMPLEARRAYS
-  printf("server: CREATESAMPLEARRAYS: open samplesArrayFile:%s with %d entries\n", samplesArrayFile, sampleArrayIndex);
-  samplesArrayFID = fopen(samplesArrayFile, "w");
-  if (samplesArrayFID) {
-    for(i = 0; i < sampleArrayIndex; i++) {
-      fprintf(samplesArrayFID, "%12.9f %4.9f %d \n", OWDSampleArrayTS[i], OWDSampleArray[i], seqNoArray[i]);
-    }
-    fclose(samplesArrayFID);
-  }
+  SampleCaptureStats captureStats;
+  sampleCaptureClose();
+  sampleCaptureGetStats(&captureStats);
+  printf("server: CREATESAMPLEARRAYS: %lu samples written to %u %s.NNNN.bin files, %lu dropped (writer behind)\n",
+         captureStats.written, captureStats.files, samplesCaptureBase, captureStats.dropped);
+  if (captureStats.written > 0)
+    printf("server: CREATESAMPLEARRAYS: %3.2f bytes per sample compressed, %u raw\n",
+           (double)captureStats.writtenBytes / (double)captureStats.written, (uint32_t)sizeof(SampleRecord));
 #endif
 
 #ifdef CREATEGAPARRAY
+  int32_t i = 0;
+  uint32_t gapArrayIndex = 0;
+  for (w = 0; w < numWorkers; w++)
+    gapArrayIndex += workers[w].gapArrayIndex;
   gapArrayFID = fopen(gapArrayFile, "w");
   if (gapArrayFID) {
-    printf(" --->> numberOfGaps:%d gapArrayIndex:%d \n", numberOfGaps, gapArrayIndex);
-    for(i = 0; i < gapArrayIndex; i++) {
-      fprintf(gapArrayFID, "%12.9f %d %d \n", gapArrayTS[i], gapArraySize[i], gapArraySeqNo[i]);
+    printf(" --->> numberOfGaps:%d gapArrayIndex:%d \n", aggregate.numberOfGaps, gapArrayIndex);
+    for (w = 0; w < numWorkers; w++) {
+      int32_t base = workers[w].gapArrayBase;
+      for(i = base; i < base + workers[w].gapArrayIndex; i++) {
+        fprintf(gapArrayFID, "%12.9f %d %d \n", gapArrayTS[i], gapArraySize[i], gapArraySeqNo[i]);
+      }
     }
     fclose(gapArrayFID);
   }
 #endif
 
-  // Clean up resources
-  if (sock >= 0) {
-    close(sock);
+  // Clean up resources.  The gap arrays and sample producers are left to exit(),
+  // other workers may still be writing into them.
+  for (w = 0; w < numWorkers; w++) {
+    if (workers[w].sock >= 0) {
+      close(workers[w].sock);
+    }
   }
   
-  if (seqNoArray) free(seqNoArray);
-  if (OWDSampleArrayTS) free(OWDSampleArrayTS);
-  if (OWDSampleArray) free(OWDSampleArray);
-  if (gapArraySize) free(gapArraySize);
-  if (gapArraySeqNo) free(gapArraySeqNo);
-  if (gapArrayTS) free(gapArrayTS);
-  
   // Signal cleanup thread to exit
   bStop = 0;
   pthread_join(cleanup_thread, NULL);
@@ -0,0 +1,140 @@
+/*********************************************************
+*
+* Module Name: udpecho-stat program
+*
+* File Name:  udpechoStat.c
+*
+* Summary:  Shows the live statistics a running server publishes with
+*           -L statsName (see LiveStats.h):  totals, rates since the
+*           last snapshot, OWD percentiles and the per flow table.
+*
+* Invocation:
+*        udpecho-stat [-i intervalMs] [-n count] [-f flows] <statsName>
+*
+*        -i intervalMs : take a snapshot every intervalMs, like top.  Without
+*                        it one snapshot is printed
+*        -n count      : stop after count snapshots
+*        -f flows      : list at most this many flows (default 20, 0 none)
+*
+* Revisions:
+*
+* Last update: 10/17/2026
+*
+*********************************************************/
+#include "UDPEcho.h"
+#include "utils.h"
+#include "LiveStats.h"
+
+#define STAT_DEFAULT_FLOWS 20
+#define STAT_MIN_INTERVAL_MS 100
+
+static void printSnapshot(const LiveStatsBody *now, const LiveStatsBody *last, uint32_t maxFlows);
+
+int main(int argc, char *argv[])
+{
+  static LiveStatsBody now;
+  static LiveStatsBody last;
+  const LiveStatsSegment *seg = NULL;
+  char name[NAME_MAX + 1];
+  uint32_t intervalMs = 0;
+  uint32_t count = 1;
+  uint32_t maxFlows = STAT_DEFAULT_FLOWS;
+  uint32_t taken = 0;
+  bool clearScreen = false;
+  int opt = 0;
+
+  while ((opt = getopt(argc, argv, "i:n:f:")) != -1) {
+    switch (opt) {
+    case 'i':
+      intervalMs = (uint32_t) atoi(optarg);
+      if (intervalMs < STAT_MIN_INTERVAL_MS)
+        intervalMs = STAT_MIN_INTERVAL_MS;
+      count = 0;
+      break;
+    case 'n':
+      count = (uint32_t) atoi(optarg);
+      break;
+    case 'f':
+      maxFlows = (uint32_t) atoi(optarg);
+      break;
+    default:
+      DieWithUserMessage("Parameter(s)", "[-i intervalMs] [-n count] [-f flows] <statsName>");
+    }
+  }
+  if (optind >= argc)
+    DieWithUserMessage("Parameter(s)", "[-i intervalMs] [-n count] [-f flows] <statsName>");
+
+  snprintf(name, sizeof(name), "%s%s", (argv[optind][0] == '/') ? "" : "/", argv[optind]);
+  seg = liveStatsOpen(name);
+  if (seg == NULL)
+    return 1;
+  clearScreen = (intervalMs > 0) && isatty(STDOUT_FILENO);
+
+  memset(&last, 0, sizeof(last));
+  while ((count == 0) || (taken < count)) {
+    if (liveStatsSnapshot(seg, &now) == ERROR) {
+      fprintf(stderr, "%s: no consistent snapshot, the server keeps it busy\n", name);
+      return 1;
+    }
+    taken++;
+    if (clearScreen)
+      printf("\033[H\033[2J");
+    printSnapshot(&now, (taken > 1) ? &last : NULL, maxFlows);
+    fflush(stdout);
+    if ((kill((pid_t)now.pid, 0) < 0) && (errno == ESRCH)) {
+      printf("server (pid %u) is gone, this is its last update\n", now.pid);
+      break;
+    }
+    last = now;
+    if (intervalMs == 0)
+      break;
+    usleep(intervalMs * 1000);
+  }
+  return 0;
+}
+
+//The totals, the rates since the last snapshot (if there is one) and
+//the first maxFlows flows
+static void printSnapshot(const LiveStatsBody *now, const LiveStatsBody *last, uint32_t maxFlows)
+{
+  LatencyPercentiles OWD;
+  uint64_t lost = (now->lostPackets > now->recoveredPackets) ? now->lostPackets - now->recoveredPackets : 0;
+  double meanOWD = (now->OWDSamples > 0) ? (double)now->OWDSumNs / (double)now->OWDSamples / 1000000000.0 : 0.0;
+  uint32_t i = 0;
+
+  latencyHistogramPercentiles(&now->OWDHist, &OWD);
+
+  printf("server pid %u, %u workers, up %3.1f s, update %lu (%3.3f s ago)\n",
+      now->pid, now->numWorkers, now->updateTime - now->startTime, now->updates,
+      getCurTimeD() - now->updateTime);
+  printf("rx: %lu packets %lu bytes", now->receivedCount, now->totalBytesRxed);
+  if ((last != NULL) && (now->updateTime > last->updateTime)) {
+    double secs = now->updateTime - last->updateTime;
+    printf("  rate: %3.0f pps %3.0f bps",
+        (double)(now->receivedCount - last->receivedCount) / secs,
+        (double)(now->totalBytesRxed - last->totalBytesRxed) * 8.0 / secs);
+  }
+  printf("\n");
+  printf("loss: %lu lost (%3.6f) in %lu gaps, %lu late arrivals\n",
+      lost, (now->receivedCount + lost > 0) ? (double)lost / (double)(now->receivedCount + lost) : 0.0,
+      now->gapsStarted, now->recoveredPackets);
+  printf("OWD: mean %4.9f p50 %4.9f p90 %4.9f p99 %4.9f p99.9 %4.9f (%lu samples)\n",
+      meanOWD, OWD.p50, OWD.p90, OWD.p99, OWD.p999, now->OWDSamples);
+  printf("drops: rate limit %u auth %u whitelist %u replay %u  errors: rx %u tx %u\n",
+      now->packetsDroppedByRateLimit, now->packetsDroppedByAuth, now->packetsDroppedByWhitelist,
+      now->packetsDroppedByReplay, now->RxErrorCount, now->TxErrorCount);
+  printf("clients tracked: %u, flows with packets: %u\n", now->clientsTracked, now->liveFlows);
+
+  if ((maxFlows == 0) || (now->numFlows == 0))
+    return;
+  printf("\n%-28s %6s %10s %8s %6s %10s %12s %12s %12s %12s\n",
+      "flow", "id", "rxCount", "lost", "gaps", "reordered", "meanOWD", "p99OWD", "p999OWD", "jitter");
+  for (i = 0; (i < now->numFlows) && (i < maxFlows); i++) {
+    const LiveFlowStats *f = &now->flows[i];
+    printf("%-28s %6u %10lu %8d %6d %10u %12.9f %12.9f %12.9f %12.9f\n",
+        f->addr, f->flowId, f->receivedCount, f->sumOfAllGaps, f->numberOfGaps,
+        f->numberOutOfOrder, f->meanOWD, f->OWD.p99, f->OWD.p999, f->jitter);
+  }
+  if (now->liveFlows > i)
+    printf("... %u more flows\n", now->liveFlows - i);
+}